@@ -0,0 +1,214 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_CONCURRENTCACHE_H
+#define JUNCTION_CONCURRENTCACHE_H
+
+#include <junction/Core.h>
+#include <junction/ConcurrentMap_Leapfrog.h>
+#include <junction/striped/Counter.h>
+#include <turf/Util.h>
+
+namespace junction {
+
+// A fixed-capacity concurrent cache, evicting with the CLOCK algorithm.
+// Every operation is lock-free, including eviction.
+//
+// The reference bit lives in bit 1 of the stored value, so it's read and cleared with the same CAS that
+// guards the value itself. Values must therefore keep their two low bits clear; pointers to objects
+// aligned to 4 bytes or more satisfy this. (Bit 0 of the value is the Redirect marker.)
+//
+// The CLOCK hand is a shared cell index. Whichever thread pushes the cache over capacity advances the
+// hand by one migration unit at a time, clearing reference bits and erasing cold entries as it goes.
+// Several threads can sweep at once; each one claims a separate range of cells.
+// Erased cells are purged from the table by the next TableMigration, as usual.
+//
+// Hits, misses and evictions are counted in striped::Counters, so that readers on different threads don't all
+// write to the same cache line.
+//
+// Evicted values are passed to an optional callback, together with their keys. As with any other value
+// removed from a Junction map, the callback must not free the value immediately: other threads may still
+// be reading it. Use DefaultQSBR.enqueue() instead.
+template <typename K, typename V, class KT = DefaultKeyTraits<K> >
+class ConcurrentCache {
+public:
+    typedef K Key;
+    typedef V Value;
+    typedef KT KeyTraits;
+    typedef DefaultValueTraits<V> ValueTraits;
+    typedef ConcurrentMap_Leapfrog<K, V, KT, ValueTraits> Map;
+    typedef typename Map::Hash Hash;
+    typedef typename Map::Details Details;
+    typedef typename ValueTraits::IntType IntType;
+    typedef void (*EvictFunc)(Key key, Value value, void* param);
+
+    static const IntType ReferencedBit = 2;
+    TURF_STATIC_ASSERT((ValueTraits::Redirect & ReferencedBit) == 0);
+
+    struct Stats {
+        ureg hits;
+        ureg misses;
+        ureg evictions;
+    };
+
+private:
+    Map m_map;
+    const ureg m_capacity;
+    EvictFunc m_evictFunc;
+    void* m_evictParam;
+    turf::Atomic<ureg> m_size;
+    turf::Atomic<ureg> m_hand;
+    striped::Counter m_hits;
+    striped::Counter m_misses;
+    striped::Counter m_evictions;
+
+    static Value encode(Value value) {
+        TURF_ASSERT((IntType(value) & (ReferencedBit | ValueTraits::Redirect)) == 0);
+        return Value(IntType(value) | ReferencedBit);
+    }
+
+    static Value decode(Value stored) {
+        return Value(IntType(stored) & ~ReferencedBit);
+    }
+
+public:
+    ConcurrentCache(ureg capacity, EvictFunc evictFunc = NULL, void* evictParam = NULL)
+        : m_map(turf::util::roundUpPowerOf2(capacity * 2)), m_capacity(capacity), m_evictFunc(evictFunc),
+          m_evictParam(evictParam), m_size(0), m_hand(0) {
+        TURF_ASSERT(capacity > 0);
+    }
+
+    // Returns NullValue on a miss.
+    // A hit only writes to the cell when the entry's reference bit was clear, so hot entries are read-only.
+    Value get(Key key) {
+        typename Map::Mutator mutator = m_map.find(key);
+        Value stored = mutator.getValue();
+        if (stored == Value(ValueTraits::NullValue)) {
+            m_misses.add(1);
+            return Value(ValueTraits::NullValue);
+        }
+        if ((IntType(stored) & ReferencedBit) == 0) {
+            // Give the entry a second chance. If the CAS fails, the entry was replaced, evicted or marked
+            // by another thread; return whatever we observed, just like a racing get() would.
+            mutator.compareExchangeValue(stored, Value(IntType(stored) | ReferencedBit));
+        }
+        m_hits.add(1);
+        return decode(stored);
+    }
+
+    // Returns the previous value, if any. New entries start with their reference bit set.
+    // If the insert pushes the cache over capacity, the calling thread advances the CLOCK hand.
+    // The value is always stored. That's why this uses compareExchangeValue() rather than exchangeValue(): when
+    // exchangeValue() loses a race, it lets the other write win, and the other write could be a sweep evicting the
+    // old entry, which would leave the cell empty.
+    Value assign(Key key, Value value) {
+        TURF_ASSERT(value != Value(ValueTraits::NullValue));
+        typename Map::Mutator mutator = m_map.insertOrFind(key);
+        Value oldStored = mutator.getValue();
+        for (;;) {
+            Value observed = mutator.compareExchangeValue(oldStored, encode(value));
+            if (observed == oldStored)
+                break;
+            // A racing write, sweep or eviction changed the cell. Try again against what it holds now.
+            oldStored = observed;
+        }
+        if (oldStored != Value(ValueTraits::NullValue))
+            return decode(oldStored);
+        if (m_size.fetchAdd(1, turf::Relaxed) >= m_capacity)
+            evict();
+        return Value(ValueTraits::NullValue);
+    }
+
+    Value erase(Key key) {
+        Value oldStored = m_map.erase(key);
+        if (oldStored == Value(ValueTraits::NullValue))
+            return Value(ValueTraits::NullValue);
+        m_size.fetchSub(1, turf::Relaxed);
+        return decode(oldStored);
+    }
+
+    // Advances the CLOCK hand until the cache is back within capacity.
+    // Two full revolutions are enough to clear every reference bit and then erase a cold entry, so the sweep
+    // is bounded even when other threads keep marking entries.
+    void evict() {
+        for (;;) {
+            typename Details::Table* table = m_map.m_root.load(turf::Consume);
+            ureg maxUnits = table->getNumMigrationUnits() * 2;
+            ureg unit = 0;
+            for (; unit < maxUnits; unit++) {
+                if (m_size.load(turf::Relaxed) <= m_capacity)
+                    return;
+                if (!sweepUnit(table))
+                    break; // The table was redirected. Start over in the new one.
+            }
+            if (unit == maxUnits)
+                return;
+        }
+    }
+
+    Stats getStats() const {
+        Stats stats;
+        stats.hits = m_hits.get();
+        stats.misses = m_misses.get();
+        stats.evictions = m_evictions.get();
+        return stats;
+    }
+
+    ureg getSize() const {
+        return m_size.load(turf::Relaxed);
+    }
+
+    ureg getCapacity() const {
+        return m_capacity;
+    }
+
+    Map& getMap() {
+        return m_map;
+    }
+
+private:
+    // Sweeps one migration unit worth of cells. Returns false if a Redirect was encountered, after helping
+    // with the migration.
+    bool sweepUnit(typename Details::Table* table) {
+        ureg sizeMask = table->sizeMask;
+        ureg startIdx = m_hand.fetchAdd(Details::TableMigrationUnitSize, turf::Relaxed);
+        for (ureg idx = startIdx; idx < startIdx + Details::TableMigrationUnitSize; idx++) {
+            typename Details::CellGroup* group = table->getCellGroups() + ((idx & sizeMask) >> 2);
+            typename Details::Cell* cell = group->cells + (idx & 3);
+            Hash hash = cell->hash.load(turf::Relaxed);
+            if (hash == KeyTraits::NullHash)
+                continue;
+            Value stored = cell->value.load(turf::Relaxed);
+            if (stored == Value(ValueTraits::NullValue))
+                continue;
+            if (stored == Value(ValueTraits::Redirect)) {
+                table->jobCoordinator.participate();
+                return false;
+            }
+            if (IntType(stored) & ReferencedBit) {
+                // Clear the reference bit. If the CAS fails, the cell was written concurrently; leave it alone.
+                cell->value.compareExchange(stored, Value(IntType(stored) & ~ReferencedBit), turf::Relaxed);
+            } else if (cell->value.compareExchangeStrong(stored, Value(ValueTraits::NullValue), turf::Consume)) {
+                // Erased a cold entry.
+                m_size.fetchSub(1, turf::Relaxed);
+                m_evictions.add(1);
+                if (m_evictFunc)
+                    m_evictFunc(KeyTraits::dehash(hash), stored, m_evictParam);
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace junction
+
+#endif // JUNCTION_CONCURRENTCACHE_H
@@ -0,0 +1,78 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_CONCURRENTCOUNTERMAP_H
+#define JUNCTION_CONCURRENTCOUNTERMAP_H
+
+#include <junction/Core.h>
+#include <junction/ConcurrentMap_Leapfrog.h>
+#include <turf/Util.h>
+
+namespace junction {
+
+// Value traits for maps that hold integer counts.
+// NullValue is zero, so a missing key reads as a count of zero, and a count that returns to zero erases the key.
+// The Redirect marker is moved to the most negative value so that small negative counts remain usable.
+template <class T>
+struct CounterValueTraits {
+    typedef T Value;
+    typedef typename turf::util::BestFit<T>::Unsigned IntType;
+    static const IntType NullValue = 0;
+    static const IntType Redirect = IntType(1) << (sizeof(IntType) * 8 - 1);
+};
+
+// A concurrent map from keys to integer counts.
+// Each add() looks up the key once, then retries its CAS on the same cell until it succeeds.
+template <typename K, typename V = sreg, class KT = DefaultKeyTraits<K> >
+class ConcurrentCounterMap {
+public:
+    typedef K Key;
+    typedef V Value;
+    typedef ConcurrentMap_Leapfrog<K, V, KT, CounterValueTraits<V> > Map;
+
+private:
+    Map m_map;
+
+public:
+    ConcurrentCounterMap(ureg capacity = Map::Details::InitialSize) : m_map(capacity) {
+    }
+
+    // Returns the count before the addition.
+    Value add(Key key, Value delta) {
+        typename Map::Mutator mutator = m_map.insertOrFind(key);
+        return mutator.fetchAdd(delta);
+    }
+
+    Value increment(Key key) {
+        return add(key, Value(1));
+    }
+
+    Value decrement(Key key) {
+        return add(key, Value(-1));
+    }
+
+    Value get(Key key) {
+        return m_map.get(key);
+    }
+
+    Value erase(Key key) {
+        return m_map.erase(key);
+    }
+
+    Map& getMap() {
+        return m_map;
+    }
+};
+
+} // namespace junction
+
+#endif // JUNCTION_CONCURRENTCOUNTERMAP_H
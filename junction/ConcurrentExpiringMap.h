@@ -0,0 +1,187 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_CONCURRENTEXPIRINGMAP_H
+#define JUNCTION_CONCURRENTEXPIRINGMAP_H
+
+#include <junction/Core.h>
+#include <junction/ConcurrentMap_Leapfrog.h>
+#include <turf/Util.h>
+
+namespace junction {
+
+// A concurrent map whose entries expire at a deadline.
+//
+// Time is measured in coarse ticks of the caller's choosing (seconds, for example), and only advances when
+// setCurrentTime() is called. An entry is expired once the current time reaches its deadline.
+//
+// Each cell holds a 64-bit word: the deadline in the upper 32 bits and the value in the lower 32 bits.
+// Because the deadline sits next to the value, checking it costs nothing extra on get(), and replacing or
+// erasing an entry atomically replaces its deadline too. Values must be 32-bit integers other than zero,
+// which is reserved for "not found". (Deadlines start at 1, so the stored word is never 0 or 1.)
+//
+// Expired entries are removed in three ways:
+// - Lazily, by get(), which erases the expired entry it finds.
+// - By the next TableMigration, which drops them instead of copying them to the new table.
+// - By sweep(), which a background thread can call periodically to erase them in chunks.
+// In every case, the optional callback is invoked exactly once per expired entry removed.
+template <typename K, typename V = u32, class KT = DefaultKeyTraits<K> >
+class ConcurrentExpiringMap {
+public:
+    typedef K Key;
+    typedef V Value;
+    typedef KT KeyTraits;
+    typedef ConcurrentMap_Leapfrog<K, u64, KT> Map;
+    typedef typename Map::Hash Hash;
+    typedef typename Map::Details Details;
+    typedef void (*ExpireFunc)(Key key, Value value, void* param);
+
+    TURF_STATIC_ASSERT(sizeof(Value) <= 4);
+
+private:
+    class Filter : public Map::MigrationFilter {
+    public:
+        ConcurrentExpiringMap& m_owner;
+
+        Filter(ConcurrentExpiringMap& owner) : m_owner(owner) {
+        }
+        virtual bool shouldDrop(Hash, u64 stored) {
+            return m_owner.isExpired(stored);
+        }
+        virtual void onDropped(Hash hash, u64 stored) {
+            m_owner.notifyExpired(hash, stored);
+        }
+    };
+
+    Map m_map;
+    Filter m_filter;
+    ExpireFunc m_expireFunc;
+    void* m_expireParam;
+    turf::Atomic<u32> m_now;
+    turf::Atomic<ureg> m_sweepIdx;
+
+    static u64 encode(Value value, u32 deadline) {
+        TURF_ASSERT(value != Value(0));
+        TURF_ASSERT(deadline > 0);
+        return (u64(deadline) << 32) | u32(value);
+    }
+
+    static Value decodeValue(u64 stored) {
+        return Value(u32(stored));
+    }
+
+    static u32 decodeDeadline(u64 stored) {
+        return u32(stored >> 32);
+    }
+
+    bool isExpired(u64 stored) const {
+        return decodeDeadline(stored) <= m_now.load(turf::Relaxed);
+    }
+
+    void notifyExpired(Hash hash, u64 stored) {
+        if (m_expireFunc)
+            m_expireFunc(KeyTraits::dehash(hash), decodeValue(stored), m_expireParam);
+    }
+
+    // Used for a value that was just removed from the map by this thread.
+    // Returns the value if it was still live, or NullValue after reporting it if it had expired.
+    Value liveOrExpired(Key key, u64 stored) {
+        if (stored == 0)
+            return Value(0);
+        if (!isExpired(stored))
+            return decodeValue(stored);
+        notifyExpired(KeyTraits::hash(key), stored);
+        return Value(0);
+    }
+
+public:
+    ConcurrentExpiringMap(ureg capacity = Details::InitialSize, ExpireFunc expireFunc = NULL, void* expireParam = NULL)
+        : m_map(capacity), m_filter(*this), m_expireFunc(expireFunc), m_expireParam(expireParam), m_now(0),
+          m_sweepIdx(0) {
+        m_map.setMigrationFilter(&m_filter);
+    }
+
+    void setCurrentTime(u32 now) {
+        m_now.store(now, turf::Relaxed);
+    }
+
+    u32 getCurrentTime() const {
+        return m_now.load(turf::Relaxed);
+    }
+
+    // Returns 0 if the key is missing or expired.
+    Value get(Key key) {
+        u64 stored = m_map.get(key);
+        if (stored == 0)
+            return Value(0);
+        if (!isExpired(stored))
+            return decodeValue(stored);
+        // Erase it now, unless another thread has already replaced or erased it.
+        if (m_map.eraseIfEquals(key, stored))
+            notifyExpired(KeyTraits::hash(key), stored);
+        return Value(0);
+    }
+
+    // Returns the previous value, or 0 if there was none or it had expired.
+    Value assign(Key key, Value value, u32 deadline) {
+        typename Map::Mutator mutator = m_map.insertOrFind(key);
+        return liveOrExpired(key, mutator.exchangeValue(encode(value, deadline)));
+    }
+
+    Value erase(Key key) {
+        return liveOrExpired(key, m_map.erase(key));
+    }
+
+    // Erases expired entries from numUnits migration units' worth of cells, continuing from where the previous
+    // sweep left off. Returns the number of entries erased. Safe to call concurrently with everything else.
+    ureg sweep(ureg numUnits) {
+        ureg numErased = 0;
+        for (ureg unit = 0; unit < numUnits; unit++) {
+            typename Details::Table* table = m_map.m_root.load(turf::Consume);
+            ureg sizeMask = table->sizeMask;
+            ureg startIdx = m_sweepIdx.fetchAdd(Details::TableMigrationUnitSize, turf::Relaxed);
+            for (ureg idx = startIdx; idx < startIdx + Details::TableMigrationUnitSize; idx++) {
+                typename Details::CellGroup* group = table->getCellGroups() + ((idx & sizeMask) >> 2);
+                typename Details::Cell* cell = group->cells + (idx & 3);
+                Hash hash = cell->hash.load(turf::Relaxed);
+                if (hash == KeyTraits::NullHash)
+                    continue;
+                u64 stored = cell->value.load(turf::Relaxed);
+                if (stored == 0)
+                    continue;
+                if (stored == 1) {
+                    // Redirected. The migration will drop expired entries anyway.
+                    table->jobCoordinator.participate();
+                    break;
+                }
+                if (isExpired(stored) && cell->value.compareExchangeStrong(stored, u64(0), turf::Consume)) {
+                    notifyExpired(hash, stored);
+                    numErased++;
+                }
+            }
+        }
+        return numErased;
+    }
+
+    // The number of units it takes for sweep() to visit every cell in the current table.
+    ureg getNumSweepUnits() {
+        return m_map.m_root.load(turf::Consume)->getNumMigrationUnits();
+    }
+
+    Map& getMap() {
+        return m_map;
+    }
+};
+
+} // namespace junction
+
+#endif // JUNCTION_CONCURRENTEXPIRINGMAP_H
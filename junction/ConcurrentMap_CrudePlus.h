@@ -0,0 +1,281 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+
+#ifndef JUNCTION_CONCURRENTMAP_CRUDEPLUS_H
+#define JUNCTION_CONCURRENTMAP_CRUDEPLUS_H
+
+#include <junction/Core.h>
+#include <junction/MapTraits.h>
+#include <junction/QSBR.h>
+#include <junction/striped/ManualResetEvent.h>
+#include <turf/Atomic.h>
+#include <turf/Heap.h>
+#include <turf/Util.h>
+
+namespace junction {
+
+// ConcurrentMap_Crude's probe loop, plus what it takes to use it on a map whose size isn't known exactly up front.
+//
+// Keys are never removed from a table. erase() nulls the value and leaves the key in its cell, so re-inserting the same
+// key reuses the cell, and lookups never have to skip over tombstones. Each key that claims a new cell counts toward a
+// load-factor alarm. Once the alarm goes off, one thread rehashes the live entries into a new table, dropping erased
+// keys, and publishes it. The old table is freed through DefaultQSBR, so every thread that uses the map must have a
+// QSBR context, just like the other growable maps.
+//
+// The rehash is a one-shot job with no helpers. While it runs, threads that touch an entry it has already moved, or
+// that try to add a new key, block until the new table is published. All other operations proceed as usual.
+template <typename K, typename V, class KT = DefaultKeyTraits<K>, class VT = DefaultValueTraits<V> >
+class ConcurrentMap_CrudePlus {
+public:
+    typedef K Key;
+    typedef V Value;
+    typedef KT KeyTraits;
+    typedef VT ValueTraits;
+
+    static const ureg DefaultCapacity = 256;
+    static const ureg MinCapacity = 4;
+
+private:
+    struct Cell {
+        turf::Atomic<Key> key;
+        turf::Atomic<Value> value;
+    };
+
+    struct Table {
+        const ureg sizeMask;               // a power of two minus one
+        turf::Atomic<sreg> cellsRemaining; // New keys that can be added before the load-factor alarm goes off
+        turf::Atomic<u32> growthClaimed;   // Set by the one thread that rehashes this table
+        // Signaled once the next table is published
+        junction::striped::ManualResetEvent grown;
+
+        Table(ureg sizeMask, sreg cellsRemaining) : sizeMask(sizeMask), cellsRemaining(cellsRemaining), growthClaimed(0) {
+        }
+
+        static Table* create(ureg tableSize, sreg cellsRemaining) {
+            TURF_ASSERT(turf::util::isPowerOf2(tableSize));
+            Table* table = (Table*) TURF_HEAP.alloc(sizeof(Table) + sizeof(Cell) * tableSize);
+            new (table) Table(tableSize - 1, cellsRemaining);
+            for (ureg j = 0; j < tableSize; j++) {
+                table->getCells()[j].key.storeNonatomic(KeyTraits::NullKey);
+                table->getCells()[j].value.storeNonatomic(Value(ValueTraits::NullValue));
+            }
+            return table;
+        }
+
+        void destroy() {
+            this->Table::~Table();
+            TURF_HEAP.free(this);
+        }
+
+        Cell* getCells() const {
+            return (Cell*) (this + 1);
+        }
+    };
+
+    turf::Atomic<Table*> m_root;
+    const float m_maxLoadFactor;
+
+    sreg getAlarmThreshold(ureg tableSize) const {
+        return turf::util::max<sreg>(sreg(tableSize * m_maxLoadFactor), 1);
+    }
+
+    // Returns the cell holding key, claiming a free one if necessary, or NULL if the table must grow first.
+    static Cell* insertOrFind(Table* table, Key key) {
+        ureg sizeMask = table->sizeMask;
+        ureg idx = ureg(KeyTraits::hash(key));
+        for (ureg probes = 0; probes <= sizeMask; probes++, idx++) {
+            Cell* cell = table->getCells() + (idx & sizeMask);
+            Key probedKey = cell->key.load(turf::Relaxed);
+            if (probedKey == key)
+                return cell;
+            if (probedKey != KeyTraits::NullKey)
+                continue;
+            // The cell is free. Count it against the alarm before trying to take it.
+            if (table->cellsRemaining.fetchSub(1, turf::Relaxed) <= 0) {
+                table->cellsRemaining.fetchAdd(1, turf::Relaxed);
+                return NULL;
+            }
+            Key prevKey = cell->key.compareExchange(KeyTraits::NullKey, key, turf::Relaxed);
+            if (prevKey == KeyTraits::NullKey)
+                return cell;
+            // Another thread just took it, so we didn't use up a cell after all.
+            table->cellsRemaining.fetchAdd(1, turf::Relaxed);
+            if (prevKey == key)
+                return cell;
+        }
+        return NULL;
+    }
+
+    // Returns the cell holding key, or NULL if key isn't in the table. Sets redirected if the rehash has already moved
+    // the entry, or the free cell that ends its probe chain.
+    static Cell* find(Table* table, Key key, bool& redirected) {
+        ureg sizeMask = table->sizeMask;
+        ureg idx = ureg(KeyTraits::hash(key));
+        for (ureg probes = 0; probes <= sizeMask; probes++, idx++) {
+            Cell* cell = table->getCells() + (idx & sizeMask);
+            Key probedKey = cell->key.load(turf::Relaxed);
+            if (probedKey == key)
+                return cell;
+            if (probedKey == KeyTraits::NullKey) {
+                redirected = (cell->value.load(turf::Relaxed) == Value(ValueTraits::Redirect));
+                return NULL;
+            }
+        }
+        return NULL;
+    }
+
+    // Either rehashes table into a bigger one, or waits for the thread that does.
+    void grow(Table* table) {
+        u32 expected = 0;
+        if (!table->growthClaimed.compareExchangeStrong(expected, 1, turf::Relaxed)) {
+            table->grown.wait();
+            return;
+        }
+        ureg srcSize = table->sizeMask + 1;
+        // Size the next table from the live entries. Erased keys aren't moved, so their cells are reclaimed here.
+        // Never shrink: until every cell is redirected, existing keys can still be updated in the old table.
+        ureg numLive = 0;
+        for (ureg idx = 0; idx < srcSize; idx++) {
+            Value value = table->getCells()[idx].value.load(turf::Relaxed);
+            if (value != Value(ValueTraits::NullValue) && value != Value(ValueTraits::Redirect))
+                numLive++;
+        }
+        ureg dstSize = turf::util::roundUpPowerOf2(ureg(numLive * 2 / m_maxLoadFactor) + 1);
+        dstSize = turf::util::max(dstSize, srcSize);
+        Table* next = Table::create(dstSize, 0);
+        ureg dstSizeMask = dstSize - 1;
+        ureg numMoved = 0;
+        for (ureg idx = 0; idx < srcSize; idx++) {
+            Cell* srcCell = table->getCells() + idx;
+            // Acquire, so that the key is visible if another thread just stored the value.
+            Value value = srcCell->value.load(turf::Relaxed);
+            while (!srcCell->value.compareExchangeStrong(value, Value(ValueTraits::Redirect), turf::Acquire)) {
+            }
+            if (value == Value(ValueTraits::NullValue))
+                continue;
+            Key key = srcCell->key.load(turf::Relaxed);
+            TURF_ASSERT(key != KeyTraits::NullKey);
+            // No other thread can see the next table yet, and every key in the old table is distinct.
+            for (ureg dstIdx = ureg(KeyTraits::hash(key));; dstIdx++) {
+                Cell* dstCell = next->getCells() + (dstIdx & dstSizeMask);
+                if (dstCell->key.loadNonatomic() == KeyTraits::NullKey) {
+                    dstCell->key.storeNonatomic(key);
+                    dstCell->value.storeNonatomic(value);
+                    break;
+                }
+            }
+            numMoved++;
+        }
+        next->cellsRemaining.storeNonatomic(getAlarmThreshold(dstSize) - sreg(numMoved));
+        m_root.store(next, turf::Release);
+        table->grown.signal();
+        DefaultQSBR.enqueue(&Table::destroy, table);
+    }
+
+public:
+    // maxLoadFactor is the fraction of cells that can hold a key, live or erased, before the map grows.
+    ConcurrentMap_CrudePlus(ureg capacity = DefaultCapacity, float maxLoadFactor = 0.75f) : m_maxLoadFactor(maxLoadFactor) {
+        TURF_ASSERT(maxLoadFactor > 0.f && maxLoadFactor < 1.f);
+        capacity = turf::util::max(capacity, MinCapacity);
+        TURF_ASSERT(turf::util::isPowerOf2(capacity));
+        m_root.storeNonatomic(Table::create(capacity, getAlarmThreshold(capacity)));
+    }
+
+    ~ConcurrentMap_CrudePlus() {
+        m_root.loadNonatomic()->destroy();
+    }
+
+    float getMaxLoadFactor() const {
+        return m_maxLoadFactor;
+    }
+
+    ureg getCapacity() const {
+        return m_root.load(turf::Relaxed)->sizeMask + 1;
+    }
+
+    void assign(Key key, Value value) {
+        TURF_ASSERT(key != KeyTraits::NullKey);
+        TURF_ASSERT(value != Value(ValueTraits::NullValue));
+        TURF_ASSERT(value != Value(ValueTraits::Redirect));
+
+        for (;;) {
+            Table* table = m_root.load(turf::Consume);
+            Cell* cell = insertOrFind(table, key);
+            if (cell) {
+                // Release, so that the rehash sees the key once it sees the value.
+                Value prevValue = cell->value.load(turf::Relaxed);
+                while (prevValue != Value(ValueTraits::Redirect)) {
+                    if (cell->value.compareExchangeStrong(prevValue, value, turf::Release))
+                        return;
+                }
+            }
+            grow(table);
+        }
+    }
+
+    Value get(Key key) {
+        TURF_ASSERT(key != KeyTraits::NullKey);
+
+        for (;;) {
+            Table* table = m_root.load(turf::Consume);
+            bool redirected = false;
+            Cell* cell = find(table, key, redirected);
+            if (cell) {
+                Value value = cell->value.load(turf::Relaxed);
+                if (value != Value(ValueTraits::Redirect))
+                    return value;
+            } else if (!redirected) {
+                return Value(ValueTraits::NullValue);
+            }
+            table->grown.wait();
+        }
+    }
+
+    // Returns the erased value, or NullValue if the key wasn't there. The key keeps its cell until the next rehash.
+    Value erase(Key key) {
+        TURF_ASSERT(key != KeyTraits::NullKey);
+
+        for (;;) {
+            Table* table = m_root.load(turf::Consume);
+            bool redirected = false;
+            Cell* cell = find(table, key, redirected);
+            if (cell) {
+                Value prevValue = cell->value.load(turf::Relaxed);
+                while (prevValue != Value(ValueTraits::Redirect)) {
+                    if (prevValue == Value(ValueTraits::NullValue))
+                        return prevValue;
+                    if (cell->value.compareExchangeStrong(prevValue, Value(ValueTraits::NullValue), turf::Relaxed))
+                        return prevValue;
+                }
+            } else if (!redirected) {
+                return Value(ValueTraits::NullValue);
+            }
+            table->grown.wait();
+        }
+    }
+
+    void clear() {
+        // Must be called when there are no concurrent readers or writers
+        Table* table = m_root.loadNonatomic();
+        for (ureg idx = 0; idx <= table->sizeMask; idx++) {
+            Cell* cell = table->getCells() + idx;
+            cell->key.storeNonatomic(KeyTraits::NullKey);
+            cell->value.storeNonatomic(Value(ValueTraits::NullValue));
+        }
+        table->cellsRemaining.storeNonatomic(getAlarmThreshold(table->sizeMask + 1));
+    }
+};
+
+} // namespace junction
+
+#endif // JUNCTION_CONCURRENTMAP_CRUDEPLUS_H
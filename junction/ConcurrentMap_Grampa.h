@@ -15,96 +15,344 @@
 
 #include <junction/Core.h>
 #include <junction/details/Grampa.h>
+#include <junction/details/SnapshotScan.h>
 #include <junction/QSBR.h>
+#include <junction/OperationCounters.h>
 #include <turf/Heap.h>
 #include <turf/Trace.h>
+#if JUNCTION_TRACK_GRAMPA_STATS
+#include <vector>
+#endif
 
 namespace junction {
 
-TURF_TRACE_DECLARE(ConcurrentMap_Grampa, 27)
+TURF_TRACE_DECLARE(ConcurrentMap_Grampa, 28)
 
-template <typename K, typename V, class KT = DefaultKeyTraits<K>, class VT = DefaultValueTraits<V> >
+template <typename K, typename V, class KT = DefaultKeyTraits<K>, class VT = DefaultValueTraits<V>,
+          class TT = DefaultTuningTraits>
 class ConcurrentMap_Grampa {
 public:
     typedef K Key;
     typedef V Value;
     typedef KT KeyTraits;
     typedef VT ValueTraits;
+    typedef TT TuningTraits;
     typedef typename turf::util::BestFit<Key>::Unsigned Hash;
     typedef details::Grampa<ConcurrentMap_Grampa> Details;
 
 private:
+    striped::ConditionBank* m_conditionBank;
+    JobPool m_jobPool; // Leaf migrations in progress, so that threads waiting on one of them can help with the others
     turf::Atomic<uptr> m_root;
+    MigrationObserver* m_migrationObserver;
 
     bool locateTable(typename Details::Table*& table, ureg& sizeMask, Hash hash) {
-        ureg root = m_root.load(turf::Consume);
-        if (root & 1) {
-            typename Details::FlatTree* flatTree = (typename Details::FlatTree*) (root & ~ureg(1));
-            for (;;) {
-                ureg leafIdx = ureg(hash >> flatTree->safeShift);
-                table = flatTree->getTables()[leafIdx].load(turf::Relaxed);
-                if (ureg(table) != Details::RedirectFlatTree) {
-                    sizeMask = (Details::LeafSize - 1);
-                    return true;
-                }
-                TURF_TRACE(ConcurrentMap_Grampa, 0, "[locateTable] flattree lookup redirected", uptr(flatTree), uptr(leafIdx));
-                typename Details::FlatTreeMigration* migration = Details::getExistingFlatTreeMigration(flatTree);
-                migration->run();
-                migration->m_completed.wait();
-                flatTree = migration->m_destination;
-            }
+        uptr entry = m_root.load(turf::Consume);
+        if (!entry)
+            return false;
+        if (entry & 1) {
+            // Descend the flattree. Entries are only ever replaced by the thread that publishes the tables of their
+            // range, so there's nothing to wait for here; a table that's being migrated redirects us at the cell level.
+            do {
+                typename Details::FlatTree* flatTree = (typename Details::FlatTree*) (entry & ~uptr(1));
+                entry = flatTree->getEntries()[ureg(hash >> flatTree->shift) & flatTree->sizeMask].load(turf::Consume);
+            } while (entry & 1);
+            table = (typename Details::Table*) entry;
+            sizeMask = (Details::LeafSize - 1);
         } else {
-            if (!root)
-                return false;
-            table = (typename Details::Table*) root;
+            table = (typename Details::Table*) entry;
             sizeMask = table->sizeMask;
-            return true;
         }
+        return true;
     }
 
     void createInitialTable(ureg initialSize) {
         if (!m_root.load(turf::Relaxed)) {
             // This could perform DCLI, but let's avoid needing a mutex instead.
-            typename Details::Table* table = Details::Table::create(initialSize, 0, sizeof(Hash) * 8);
+            typename Details::Table* table = Details::Table::create(initialSize, 0, sizeof(Hash) * 8, *this);
             if (m_root.compareExchange(uptr(NULL), uptr(table), turf::Release)) {
-                TURF_TRACE(ConcurrentMap_Grampa, 1, "[createInitialTable] race to create initial table", uptr(this), 0);
+                TURF_TRACE(ConcurrentMap_Grampa, 0, "[createInitialTable] race to create initial table", uptr(this), 0);
                 table->destroy();
             }
         }
     }
 
+    // Destroys every table and flattree node reachable from root. No other thread may be using them.
+    static void destroyRoot(ureg root) {
+        if (root & 1) {
+            typename Details::FlatTree* flatTree = (typename Details::FlatTree*) (root & ~ureg(1));
+            // A table that fills several entries fills consecutive entries of a single node.
+            uptr lastEntryGCed = 0;
+            for (ureg i = 0; i < flatTree->getSize(); i++) {
+                uptr entry = flatTree->getEntries()[i].loadNonatomic();
+                if (entry != lastEntryGCed) {
+                    destroyRoot(entry);
+                    lastEntryGCed = entry;
+                }
+            }
+            flatTree->destroy();
+        } else if (root) {
+            typename Details::Table* t = (typename Details::Table*) root;
+            t->destroy();
+        }
+    }
+
+    // Returns the flattree entry for a range of (1 << rangeShift) hashes, given the tables that cover the range in
+    // order, one for every (1 << tablesShift) hashes. Some may be repeated. That's the first table itself if it covers
+    // the whole range. Otherwise, it's a new node, tagged with 1, whose entries are built the same way.
+    // Doesn't signal the tables' isPublished events.
+    static uptr buildFlatTreeEntry(typename Details::Table* const* tables, ureg tablesShift, ureg rangeShift) {
+        if (tables[0]->unsafeRangeShift >= rangeShift)
+            return uptr(tables[0]);
+        TURF_ASSERT(rangeShift > tablesShift);
+        ureg childShift = rangeShift > Details::FlatTreeNodeBits ? rangeShift - Details::FlatTreeNodeBits : 0;
+        typename Details::FlatTree* flatTree = Details::FlatTree::create(childShift, rangeShift - childShift);
+        for (ureg i = 0; i < flatTree->getSize(); i++) {
+            uptr entry;
+            if (childShift >= tablesShift)
+                entry = buildFlatTreeEntry(tables + (i << (childShift - tablesShift)), tablesShift, childShift);
+            else
+                entry = uptr(tables[i >> (tablesShift - childShift)]); // Covers more than one entry
+            flatTree->getEntries()[i].storeNonatomic(entry);
+        }
+        return uptr(flatTree) | 1;
+    }
+
+    // Adds the bytes held by the flattree nodes below entry to bytesUsed.
+    static void addFlatTreeBytes(uptr entry, ureg& bytesUsed) {
+        if (!(entry & 1))
+            return;
+        typename Details::FlatTree* flatTree = (typename Details::FlatTree*) (entry & ~uptr(1));
+        bytesUsed += sizeof(typename Details::FlatTree) + sizeof(turf::Atomic<uptr>) * flatTree->getSize();
+        for (ureg i = 0; i < flatTree->getSize(); i++)
+            addFlatTreeBytes(flatTree->getEntries()[i].load(turf::Consume), bytesUsed);
+    }
+
+    // Fills numLeaves new leaf tables with the bulk entries, and returns a flattree of them tagged as a root.
+    // Returns 0 if any leaf overflowed, in which case the caller should try again with more leaves.
+    ureg buildFlatTree(const std::vector<details::BulkEntry<Hash, Value>>& entries,
+                       std::vector<details::BulkEntry<Hash, Value>>& sorted, ureg numLeaves) {
+        ureg safeShift = sizeof(Hash) * 8;
+        for (ureg n = numLeaves; n > 1; n >>= 1)
+            safeShift--;
+        details::sortBulkEntries(entries, sorted, numLeaves << Details::LeafSizeBits,
+                                 typename Details::BulkLeafBucket(safeShift));
+        std::vector<typename Details::Table*> tables(numLeaves);
+        ureg begin = 0;
+        for (ureg i = 0; i < numLeaves; i++) {
+            ureg end = begin;
+            while (end < sorted.size() && ureg(sorted[end].hash >> safeShift) == i)
+                end++;
+            tables[i] = Details::Table::create(Details::LeafSize, Hash(Hash(i) << safeShift), safeShift, *this);
+            typename Details::BulkWriter writer(tables[i]);
+            if (!details::buildBulkTable(sorted.data() + begin, end - begin, Details::LeafSize - 1, Details::LinearSearchLimit,
+                                         writer)) {
+                for (ureg j = 0; j <= i; j++)
+                    tables[j]->destroy();
+                return 0;
+            }
+            begin = end;
+        }
+        for (ureg i = 0; i < numLeaves; i++)
+            tables[i]->isPublished.signal();
+        return buildFlatTreeEntry(tables.data(), safeShift, sizeof(Hash) * 8);
+    }
+
+    // Checks what SnapshotMapping::validate() can't: that the tables form a single table or a flattree of leaves,
+    // and that each table fills exactly the consecutive slots that cover its range of hashes, as lookups and
+    // destroyRoot() expect.
+    static bool isValidSnapshot(const details::SnapshotHeader* header, const details::SnapshotMapping* mapping) {
+        const details::SnapshotTable* records = mapping->getTables();
+        if (header->numSlots == 0) {
+            if (header->numTables == 0)
+                return true;
+            return header->numTables == 1 && records[0].size <= Details::LeafSize && records[0].baseHash == 0 &&
+                   records[0].rangeShift == sizeof(Hash) * 8;
+        }
+        if (header->rootShift >= sizeof(Hash) * 8 || header->numSlots != u64(Hash(-1) >> header->rootShift) + 1)
+            return false;
+        for (u64 i = 0; i < header->numTables; i++) {
+            if (records[i].size != Details::LeafSize || records[i].rangeShift < header->rootShift ||
+                records[i].rangeShift >= sizeof(Hash) * 8)
+                return false;
+        }
+        const u32* slots = mapping->getSlots();
+        if (slots[0] != 0 || slots[header->numSlots - 1] != header->numTables - 1)
+            return false;
+        u64 runStart = 0; // First slot of the current table
+        for (u64 i = 1; i <= header->numSlots; i++) {
+            if (i < header->numSlots) {
+                if (slots[i] == slots[i - 1])
+                    continue;
+                if (slots[i] != slots[i - 1] + 1)
+                    return false;
+            }
+            // Slots runStart to i - 1 hold the same table.
+            const details::SnapshotTable& record = records[slots[runStart]];
+            if (i - runStart != u64(1) << (record.rangeShift - header->rootShift) ||
+                record.baseHash != u64(Hash(Hash(runStart) << header->rootShift)))
+                return false;
+            runStart = i;
+        }
+        return true;
+    }
+
 public:
-    ConcurrentMap_Grampa(ureg initialSize = 0) : m_root(uptr(NULL)) {
+    // Pass a conditionBank to keep this map's waiting threads off DefaultConditionBank, which is shared with every
+    // other map in the process. The bank must outlive the map.
+    ConcurrentMap_Grampa(ureg initialSize = 0, striped::ConditionBank* conditionBank = NULL)
+        : m_conditionBank(conditionBank), m_root(uptr(NULL)), m_migrationObserver(NULL) {
         // FIXME: Support initialSize argument
         TURF_UNUSED(initialSize);
     }
 
     ~ConcurrentMap_Grampa() {
-        ureg root = m_root.loadNonatomic();
+        destroyRoot(m_root.loadNonatomic());
+    }
+
+    // Threads waiting on this map's migrations block on ConditionPairs from this bank.
+    striped::ConditionBank* getConditionBank() const {
+        return m_conditionBank;
+    }
+
+    JobPool& getJobPool() {
+        return m_jobPool;
+    }
+
+    // Must be called before the map is shared with other threads.
+    void setMigrationObserver(MigrationObserver* observer) {
+        m_migrationObserver = observer;
+    }
+
+    MigrationObserver* getMigrationObserver() const {
+        return m_migrationObserver;
+    }
+
+    // Replaces the contents of the map with the (key, value) pairs in [first, last), such as a range of std::pair.
+    // Much faster than assigning them one at a time: the tables are sized once, for the number of pairs, and each one
+    // is filled in a single sequential sweep. See details/BulkLoad.h. Pairs that don't fit in one leaf-sized table are
+    // spread across a flattree right away, instead of through a series of migrations. If a key appears more than
+    // once, the last value wins. Must be called before the map is shared with other threads.
+    template <class InputIt>
+    void buildFrom(InputIt first, InputIt last) {
+        std::vector<details::BulkEntry<Hash, Value>> entries;
+        std::vector<details::BulkEntry<Hash, Value>> sorted;
+        details::collectBulkEntries<KeyTraits>(entries, first, last);
+        ureg size = turf::util::max(ureg(Details::MinTableSize), turf::util::roundUpPowerOf2(ureg(entries.size() * 2)));
+        ureg root = 0;
+        for (; size <= Details::LeafSize; size *= 2) {
+            typename Details::Table* table = Details::Table::create(size, 0, sizeof(Hash) * 8, *this);
+            details::sortBulkEntries(entries, sorted, size, details::TableBucket<Hash>(size - 1));
+            typename Details::BulkWriter writer(table);
+            if (details::buildBulkTable(sorted.data(), sorted.size(), size - 1, Details::LinearSearchLimit, writer)) {
+                table->isPublished.signal();
+                root = uptr(table);
+                break;
+            }
+            table->destroy();
+        }
+        for (; !root; size *= 2)
+            root = buildFlatTree(entries, sorted, size >> Details::LeafSizeBits);
+        destroyRoot(m_root.loadNonatomic());
+        m_root.storeNonatomic(root);
+    }
+
+    // Writes the map's tables, cells and deltas included, along with the layout of the flattree, to a snapshot file
+    // that loadSnapshot() can restore in a later process without rehashing. See details/Snapshot.h. Values are
+    // written as they are, so this is only useful if they mean the same thing in the next process, such as integers
+    // or offsets rather than pointers. No other thread may modify the map during the call. Returns false if the file
+    // couldn't be written.
+    bool saveSnapshot(const char* path) {
+        ureg root = m_root.load(turf::Consume);
+        std::vector<typename Details::Table*> tables;
+        std::vector<u32> slots;
+        details::SnapshotHeader header;
+        Details::getSnapshotLayout().initHeader(header);
         if (root & 1) {
-            typename Details::FlatTree* flatTree = (typename Details::FlatTree*) (root & ~ureg(1));
-            ureg size = (Hash(-1) >> flatTree->safeShift) + 1;
-            typename Details::Table* lastTableGCed = NULL;
-            for (ureg i = 0; i < size; i++) {
-                typename Details::Table* t = flatTree->getTables()[i].loadNonatomic();
-                TURF_ASSERT(ureg(t) != Details::RedirectFlatTree);
-                if (t != lastTableGCed) {
-                    t->destroy();
-                    lastTableGCed = t;
-                }
+            // The file lays the flattree out flat, with a slot for every range of hashes as small as the smallest leaf.
+            Hash hash = 0;
+            ureg rootShift = sizeof(Hash) * 8;
+            for (;;) {
+                typename Details::Table* t;
+                ureg sizeMask;
+                locateTable(t, sizeMask, hash);
+                tables.push_back(t);
+                rootShift = turf::util::min(rootShift, t->unsafeRangeShift);
+                hash = t->baseHash + (Hash(1) << t->unsafeRangeShift);
+                if (hash == 0)
+                    break; // Wrapped around
             }
-            flatTree->destroy();
+            for (ureg i = 0; i < tables.size(); i++) {
+                for (ureg r = ureg(1) << (tables[i]->unsafeRangeShift - rootShift); r > 0; r--)
+                    slots.push_back(u32(i));
+            }
+            header.rootShift = rootShift;
         } else if (root) {
-            typename Details::Table* t = (typename Details::Table*) root;
-            t->destroy();
+            tables.push_back((typename Details::Table*) root);
         }
+        header.numTables = tables.size();
+        header.numSlots = slots.size();
+        std::vector<details::SnapshotTable> records(tables.size());
+        u64 offset = sizeof(header) + sizeof(details::SnapshotTable) * records.size() + sizeof(u32) * slots.size();
+        for (ureg i = 0; i < tables.size(); i++) {
+            records[i].offset = details::SnapshotWriter::alignUp(offset);
+            records[i].size = tables[i]->sizeMask + 1;
+            records[i].baseHash = tables[i]->baseHash;
+            records[i].rangeShift = tables[i]->unsafeRangeShift;
+            offset = records[i].offset + sizeof(typename Details::Table) +
+                     sizeof(typename Details::CellGroup) * ((tables[i]->sizeMask + 1) >> 2);
+        }
+        details::SnapshotWriter writer(path);
+        writer.write(&header, sizeof(header));
+        writer.write(records.data(), sizeof(details::SnapshotTable) * records.size());
+        writer.write(slots.data(), sizeof(u32) * slots.size());
+        for (ureg i = 0; i < tables.size(); i++)
+            Details::saveTable(writer, tables[i], records[i].offset);
+        return writer.close();
+    }
+
+    // Replaces the contents of the map with a snapshot written by saveSnapshot(). The file is mapped copy-on-write
+    // and its tables become the map's tables as they lie, so pages are only read as they're touched and only copied
+    // when they're modified. Only the flattree is rebuilt on the heap. The file must not be modified or truncated
+    // while any table from it is still in use. Returns false, leaving the map unchanged, if the file can't be read or
+    // was written by a build with a different layout. Must be called before the map is shared with other threads.
+    bool loadSnapshot(const char* path) {
+        details::SnapshotMapping* mapping = details::SnapshotMapping::open(path);
+        if (!mapping)
+            return false;
+        const details::SnapshotHeader* header = mapping->validate(Details::getSnapshotLayout());
+        if (!header || !isValidSnapshot(header, mapping)) {
+            mapping->release();
+            return false;
+        }
+        const details::SnapshotTable* records = mapping->getTables();
+        std::vector<typename Details::Table*> tables(ureg(header->numTables));
+        for (ureg i = 0; i < tables.size(); i++) {
+            tables[i] = Details::Table::restore(mapping->getData() + records[i].offset, ureg(records[i].size),
+                                                Hash(records[i].baseHash), ureg(records[i].rangeShift), *this, mapping);
+            tables[i]->isPublished.signal();
+        }
+        ureg root = 0;
+        if (header->numSlots > 0) {
+            const u32* slots = mapping->getSlots();
+            std::vector<typename Details::Table*> slotTables(ureg(header->numSlots));
+            for (ureg i = 0; i < slotTables.size(); i++)
+                slotTables[i] = tables[slots[i]];
+            root = buildFlatTreeEntry(slotTables.data(), ureg(header->rootShift), sizeof(Hash) * 8);
+        } else if (!tables.empty()) {
+            root = uptr(tables[0]);
+        }
+        mapping->release(); // Each table holds its own reference.
+        destroyRoot(m_root.loadNonatomic());
+        m_root.storeNonatomic(root);
+        return true;
     }
 
     // publishTableMigration() is called by exactly one thread from Details::TableMigration::run()
     // after all the threads participating in the migration have completed their work.
     // There are no racing writes to the same range of hashes.
     void publishTableMigration(typename Details::TableMigration* migration) {
-        TURF_TRACE(ConcurrentMap_Grampa, 2, "[publishTableMigration] called", uptr(migration), 0);
+        TURF_TRACE(ConcurrentMap_Grampa, 1, "[publishTableMigration] called", uptr(migration), 0);
         if (migration->m_safeShift == 0) {
             // This TableMigration replaces the entire map with a single table.
             TURF_ASSERT(migration->m_baseHash == 0);
@@ -115,13 +363,13 @@ public:
             m_root.store(uptr(newTable), turf::Release); // Make table contents visible
             newTable->isPublished.signal();
             if ((oldRoot & 1) == 0) {
-                TURF_TRACE(ConcurrentMap_Grampa, 3, "[publishTableMigration] replacing single root with single root",
+                TURF_TRACE(ConcurrentMap_Grampa, 2, "[publishTableMigration] replacing single root with single root",
                            uptr(migration), 0);
                 // If oldRoot is a table, it must be the original source of the migration.
                 TURF_ASSERT((typename Details::Table*) oldRoot == migration->getSources()[0].table);
                 // Don't GC it here. The caller will GC it since it's a source of the TableMigration.
             } else {
-                TURF_TRACE(ConcurrentMap_Grampa, 4, "[publishTableMigration] replacing flattree with single root",
+                TURF_TRACE(ConcurrentMap_Grampa, 3, "[publishTableMigration] replacing flattree with single root",
                            uptr(migration), 0);
                 // The entire previous flattree is being replaced.
                 Details::garbageCollectFlatTree((typename Details::FlatTree*) (oldRoot & ~ureg(1)));
@@ -141,114 +389,68 @@ public:
                 TURF_ASSERT((typename Details::Table*) oldRoot == migration->getSources()[0].table);
                 // Furthermore, it is guaranteed that there are no racing writes to m_root.
                 // Create a new flattree and store it to m_root.
-                TURF_TRACE(ConcurrentMap_Grampa, 5, "[publishTableMigration] replacing single root with flattree",
+                TURF_TRACE(ConcurrentMap_Grampa, 4, "[publishTableMigration] replacing single root with flattree",
                            uptr(migration), 0);
-                typename Details::FlatTree* flatTree = Details::FlatTree::create(migration->m_safeShift);
-                typename Details::Table* prevTable = NULL;
-                for (ureg i = 0; i < migration->m_numDestinations; i++) {
-                    typename Details::Table* newTable = migration->getDestinations()[i];
-                    flatTree->getTables()[i].storeNonatomic(newTable);
-                    if (newTable != prevTable) {
-                        newTable->isPublished.signal();
-                        prevTable = newTable;
-                    }
-                }
-                m_root.store(uptr(flatTree) | 1, turf::Release); // Ensure visibility of flatTree->tables
+                uptr root = buildFlatTreeEntry(migration->getDestinations(), migration->m_safeShift, sizeof(Hash) * 8);
+                signalPublished(migration);
+                m_root.store(root, turf::Release); // Ensure visibility of the flattree and its tables
                 // Caller will GC the TableMigration.
                 // Caller will also GC the old oldRoot since it's a source of the TableMigration.
             } else {
-                // There is an existing flattree, and we are publishing one or more tables to it.
-                // Attempt to publish the subtree in a loop.
-                // The loop is necessary because we might get redirected in the middle of publishing.
-                TURF_TRACE(ConcurrentMap_Grampa, 6, "[publishTableMigration] publishing subtree to existing flattree",
+                // There is an existing flattree, and we are replacing one of its tables with one or more tables.
+                // We're the only thread that writes the entries covering the replaced table's range, so we can store
+                // them directly. Nothing outside that range is touched.
+                TURF_TRACE(ConcurrentMap_Grampa, 5, "[publishTableMigration] publishing subtree to existing flattree",
                            uptr(migration), 0);
-                typename Details::FlatTree* flatTree = (typename Details::FlatTree*) (oldRoot & ~ureg(1));
-                ureg subTreeEntriesPublished = 0;
                 typename Details::Table* tableToReplace = migration->getSources()[0].table;
+                TURF_ASSERT(migration->m_baseHash == tableToReplace->baseHash);
                 // Wait here so that we only replace tables that are fully published.
                 // Otherwise, there will be a race between a subtree and its own children.
                 // (If all ManualResetEvent objects supported isPublished(), we could add a TURF_TRACE counter for this.
                 // In previous tests, such a counter does in fact get hit.)
                 tableToReplace->isPublished.wait();
-                typename Details::Table* prevTable = NULL;
+                // Find the node whose entries hold the table.
+                typename Details::FlatTree* flatTree = (typename Details::FlatTree*) (oldRoot & ~ureg(1));
+                ureg idx;
                 for (;;) {
-                publishLoop:
-                    if (migration->m_safeShift < flatTree->safeShift) {
-                        // We'll need to migrate to larger flattree before publishing our new subtree.
-                        // First, try to create a FlatTreeMigration with the necessary properties.
-                        // This will fail if an existing FlatTreeMigration has already been created using the same source.
-                        // In that case, we'll help complete the existing FlatTreeMigration, then we'll retry the loop.
-                        TURF_TRACE(ConcurrentMap_Grampa, 7, "[publishTableMigration] existing flattree too small",
-                                   uptr(migration), 0);
-                        typename Details::FlatTreeMigration* flatTreeMigration =
-                            Details::createFlatTreeMigration(*this, flatTree, migration->m_safeShift);
-                        tableToReplace->jobCoordinator.runOne(flatTreeMigration);
-                        flatTreeMigration->m_completed.wait(); // flatTreeMigration->m_destination becomes entirely visible
-                        flatTree = flatTreeMigration->m_destination;
-                        // The FlatTreeMigration has already been GC'ed by the last worker.
-                        // Retry the loop.
-                    } else {
-                        ureg repeat = ureg(1) << (migration->m_safeShift - flatTree->safeShift);
-                        ureg dstStartIndex = ureg(migration->m_baseHash >> flatTree->safeShift);
-                        // The subtree we're about to publish fits inside the flattree.
-                        TURF_ASSERT(dstStartIndex + migration->m_numDestinations * repeat - 1 <= Hash(-1) >> flatTree->safeShift);
-                        // If a previous attempt to publish got redirected, resume publishing into the new flattree,
-                        // starting with the first subtree entry that has not yet been fully published, as given by
-                        // subTreeEntriesPublished.
-                        // (Note: We could, in fact, restart the publish operation starting at entry 0. That would be valid too.
-                        // We are the only thread that can modify this particular range of the flattree at this time.)
-                        turf::Atomic<typename Details::Table*>* dstLeaf =
-                            flatTree->getTables() + dstStartIndex + (subTreeEntriesPublished * repeat);
-                        typename Details::Table** subFlatTree = migration->getDestinations();
-                        while (subTreeEntriesPublished < migration->m_numDestinations) {
-                            typename Details::Table* srcTable = subFlatTree[subTreeEntriesPublished];
-                            for (ureg r = repeat; r > 0; r--) {
-                                typename Details::Table* probeTable = tableToReplace;
-                                while (!dstLeaf->compareExchangeStrong(probeTable, srcTable, turf::Relaxed)) {
-                                    if (ureg(probeTable) == Details::RedirectFlatTree) {
-                                        // We've been redirected.
-                                        // Help with the FlatTreeMigration, then try again.
-                                        TURF_TRACE(ConcurrentMap_Grampa, 8, "[publishTableMigration] redirected", uptr(migration),
-                                                   uptr(dstLeaf));
-                                        typename Details::FlatTreeMigration* flatTreeMigration =
-                                            Details::getExistingFlatTreeMigration(flatTree);
-                                        tableToReplace->jobCoordinator.runOne(flatTreeMigration);
-                                        flatTreeMigration->m_completed.wait();
-                                        // flatTreeMigration->m_destination becomes entirely visible
-                                        flatTree = flatTreeMigration->m_destination;
-                                        goto publishLoop;
-                                    }
-                                    // The only other possibility is that we were previously redirected, and the subtree entry got
-                                    // partially published.
-                                    TURF_TRACE(ConcurrentMap_Grampa, 9, "[publishTableMigration] recovering from partial publish",
-                                               uptr(migration), 0);
-                                    TURF_ASSERT(probeTable == srcTable);
-                                }
-                                // The caller will GC the table) being replaced them since it's a source of the TableMigration.
-                                dstLeaf++;
-                            }
-                            if (prevTable != srcTable) {
-                                srcTable->isPublished.signal();
-                                prevTable = srcTable;
-                            }
-                            subTreeEntriesPublished++;
-                        }
-                        // We've successfully published the migrated sub-flattree.
-                        // Caller will GC the TableMigration.
+                    idx = ureg(migration->m_baseHash >> flatTree->shift) & flatTree->sizeMask;
+                    uptr entry = flatTree->getEntries()[idx].load(turf::Consume);
+                    if (!(entry & 1)) {
+                        TURF_ASSERT((typename Details::Table*) entry == tableToReplace);
                         break;
                     }
+                    flatTree = (typename Details::FlatTree*) (entry & ~uptr(1));
                 }
+                // The table fills (1 << (unsafeRangeShift - shift)) entries of the node, starting at idx.
+                // Each one gets the new tables of its range, in a child node if they're smaller than the entry.
+                TURF_ASSERT(tableToReplace->unsafeRangeShift >= flatTree->shift);
+                ureg numEntries = ureg(1) << (tableToReplace->unsafeRangeShift - flatTree->shift);
+                ureg safeShift = migration->m_safeShift;
+                for (ureg i = 0; i < numEntries; i++) {
+                    ureg dstIdx =
+                        flatTree->shift >= safeShift ? i << (flatTree->shift - safeShift) : i >> (safeShift - flatTree->shift);
+                    uptr entry = buildFlatTreeEntry(migration->getDestinations() + dstIdx, safeShift, flatTree->shift);
+                    if (entry & 1)
+                        TURF_TRACE(ConcurrentMap_Grampa, 6, "[publishTableMigration] adding a flattree node", uptr(migration),
+                                   uptr(flatTree));
+                    TURF_ASSERT((typename Details::Table*) flatTree->getEntries()[idx + i].loadNonatomic() == tableToReplace);
+                    flatTree->getEntries()[idx + i].store(entry, turf::Release); // Make the new tables visible
+                }
+                signalPublished(migration);
+                // Caller will GC the TableMigration, and tableToReplace since it's a source of the TableMigration.
             }
         }
     }
 
-    void publishFlatTreeMigration(typename Details::FlatTreeMigration* migration) {
-        // There are no racing writes.
-        // Old root must be the migration source (a flattree).
-        TURF_ASSERT(m_root.loadNonatomic() == (ureg(migration->m_source) | 1));
-        // Publish the new flattree, making entire table contents visible.
-        m_root.store(uptr(migration->m_destination) | 1, turf::Release);
-        // Don't GC the old flattree. The FlatTreeMigration will do that, since it's a source.
+    void signalPublished(typename Details::TableMigration* migration) {
+        typename Details::Table* prevTable = NULL;
+        for (ureg i = 0; i < migration->m_numDestinations; i++) {
+            typename Details::Table* newTable = migration->getDestinations()[i];
+            if (newTable != prevTable) {
+                newTable->isPublished.signal();
+                prevTable = newTable;
+            }
+        }
     }
 
     // A Mutator represents a known cell in the hash table.
@@ -270,13 +472,15 @@ public:
         Value m_value;
 
         // Constructor: Find existing cell
-        Mutator(ConcurrentMap_Grampa& map, Key key, bool) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
-            TURF_TRACE(ConcurrentMap_Grampa, 10, "[Mutator] find constructor called", uptr(map.m_root.load(turf::Relaxed)),
-                       uptr(key));
-            Hash hash = KeyTraits::hash(key);
+        Mutator(ConcurrentMap_Grampa& map, Hash hash, bool) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
+            TURF_TRACE(ConcurrentMap_Grampa, 7, "[Mutator] find constructor called", uptr(map.m_root.load(turf::Relaxed)),
+                       uptr(hash));
             for (;;) {
                 if (!m_map.locateTable(m_table, m_sizeMask, hash))
                     return;
+#if JUNCTION_TRACK_GRAMPA_STATS
+                m_table->sampleAccess();
+#endif
                 m_cell = Details::find(hash, m_table, m_sizeMask);
                 if (!m_cell)
                     return;
@@ -287,21 +491,24 @@ public:
                     return;
                 }
                 // We've encountered a Redirect value. Help finish the migration.
-                TURF_TRACE(ConcurrentMap_Grampa, 11, "[Mutator] find was redirected", uptr(m_table), 0);
+                TURF_TRACE(ConcurrentMap_Grampa, 8, "[Mutator] find was redirected", uptr(m_table), 0);
+                details::countRedirectFollowed();
                 m_table->jobCoordinator.participate();
                 // Try again using the latest root.
             }
         }
 
         // Constructor: Insert or find cell
-        Mutator(ConcurrentMap_Grampa& map, Key key) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
-            TURF_TRACE(ConcurrentMap_Grampa, 12, "[Mutator] insertOrFind constructor called", uptr(map.m_root.load(turf::Relaxed)),
-                       uptr(key));
-            Hash hash = KeyTraits::hash(key);
+        Mutator(ConcurrentMap_Grampa& map, Hash hash) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
+            TURF_TRACE(ConcurrentMap_Grampa, 9, "[Mutator] insertOrFind constructor called", uptr(map.m_root.load(turf::Relaxed)),
+                       uptr(hash));
             for (;;) {
                 if (!m_map.locateTable(m_table, m_sizeMask, hash)) {
                     m_map.createInitialTable(Details::MinTableSize);
                 } else {
+#if JUNCTION_TRACK_GRAMPA_STATS
+                    m_table->sampleAccess();
+#endif
                     ureg overflowIdx;
                     switch (Details::insertOrFind(hash, m_table, m_sizeMask, m_cell, overflowIdx)) { // Modifies m_cell
                     case Details::InsertResult_InsertedNew: {
@@ -313,7 +520,8 @@ public:
                         Value value = m_cell->value.load(turf::Consume);
                         if (value == Value(ValueTraits::Redirect)) {
                             // We've encountered a Redirect value.
-                            TURF_TRACE(ConcurrentMap_Grampa, 13, "[Mutator] insertOrFind was redirected", uptr(m_table), uptr(m_value));
+                            TURF_TRACE(ConcurrentMap_Grampa, 10, "[Mutator] insertOrFind was redirected", uptr(m_table), uptr(m_value));
+                            details::countRedirectFollowed();
                             break; // Help finish the migration.
                         }
                         // Found an existing value
@@ -332,6 +540,44 @@ public:
             }
         }
 
+        // Called after a CAS on m_cell encountered a Redirect value.
+        // Helps finish the migration, then locates the same hash in the latest table, inserting it if necessary.
+        // On return, m_cell is valid and m_value holds its latest value, which is never Redirect.
+        void followRedirect() {
+            TURF_TRACE(ConcurrentMap_Grampa, 11, "[Mutator::followRedirect] called", uptr(m_table), uptr(m_cell));
+            details::countRedirectFollowed();
+            Hash hash = m_cell->hash.load(turf::Relaxed);
+            for (;;) {
+                // Help complete the migration.
+                m_table->jobCoordinator.participate();
+                // Try again in the new table.
+                bool exists = m_map.locateTable(m_table, m_sizeMask, hash);
+                TURF_ASSERT(exists);
+                TURF_UNUSED(exists);
+                m_value = Value(ValueTraits::NullValue);
+                ureg overflowIdx;
+                switch (Details::insertOrFind(hash, m_table, m_sizeMask, m_cell, overflowIdx)) { // Modifies m_cell
+                case Details::InsertResult_AlreadyFound:
+                    m_value = m_cell->value.load(turf::Consume);
+                    if (m_value == Value(ValueTraits::Redirect)) {
+                        TURF_TRACE(ConcurrentMap_Grampa, 12, "[Mutator::followRedirect] was re-redirected", uptr(m_table),
+                                   uptr(m_value));
+                        details::countRedirectFollowed();
+                        break;
+                    }
+                    return;
+                case Details::InsertResult_InsertedNew:
+                    return;
+                case Details::InsertResult_Overflow:
+                    TURF_TRACE(ConcurrentMap_Grampa, 13, "[Mutator::followRedirect] overflow after redirect", uptr(m_table),
+                               overflowIdx);
+                    Details::beginTableMigration(m_map, m_table, overflowIdx);
+                    break;
+                }
+                // We were redirected... again
+            }
+        }
+
     public:
         Value getValue() const {
             // Return previously loaded value. Don't load it again.
@@ -365,41 +611,9 @@ public:
                     // Pretend we exchanged with ourselves, and just let the racing write win.
                     return desired;
                 }
-                // We've encountered a Redirect value. Help finish the migration.
+                // We've encountered a Redirect value. Help finish the migration, then try again in the new table.
                 TURF_TRACE(ConcurrentMap_Grampa, 18, "[Mutator::exchangeValue] was redirected", uptr(m_table), uptr(m_value));
-                Hash hash = m_cell->hash.load(turf::Relaxed);
-                for (;;) {
-                    // Help complete the migration.
-                    m_table->jobCoordinator.participate();
-                    // Try again in the latest table.
-                    // FIXME: locateTable() could return false if the map is concurrently cleared (m_root set to 0).
-                    // This is not concern yet since clear() is not implemented.
-                    bool exists = m_map.locateTable(m_table, m_sizeMask, hash);
-                    TURF_ASSERT(exists);
-                    TURF_UNUSED(exists);
-                    m_value = Value(ValueTraits::NullValue);
-                    ureg overflowIdx;
-                    switch (Details::insertOrFind(hash, m_table, m_sizeMask, m_cell, overflowIdx)) { // Modifies m_cell
-                    case Details::InsertResult_AlreadyFound:
-                        m_value = m_cell->value.load(turf::Consume);
-                        if (m_value == Value(ValueTraits::Redirect)) {
-                            TURF_TRACE(ConcurrentMap_Grampa, 19, "[Mutator::exchangeValue] was re-redirected", uptr(m_table),
-                                       uptr(m_value));
-                            break;
-                        }
-                        goto breakOuter;
-                    case Details::InsertResult_InsertedNew:
-                        goto breakOuter;
-                    case Details::InsertResult_Overflow:
-                        TURF_TRACE(ConcurrentMap_Grampa, 20, "[Mutator::exchangeValue] overflow after redirect", uptr(m_table),
-                                   overflowIdx);
-                        Details::beginTableMigration(m_map, m_table, overflowIdx);
-                        break;
-                    }
-                    // We were redirected... again
-                }
-            breakOuter:;
-                // Try again in the new table.
+                followRedirect();
             }
         }
 
@@ -407,13 +621,39 @@ public:
             exchangeValue(desired);
         }
 
+        // Stores desired only if the current value equals expected, and returns the value that was observed.
+        // The exchange took place if and only if the return value equals expected.
+        // Unlike exchangeValue(), a racing write is never ignored; it's reported to the caller instead.
+        Value compareExchangeValue(Value expected, Value desired) {
+            TURF_ASSERT(expected != Value(ValueTraits::Redirect));
+            TURF_ASSERT(desired != Value(ValueTraits::Redirect));
+            TURF_ASSERT(m_cell); // Cell must have been found or inserted
+            TURF_TRACE(ConcurrentMap_Grampa, 19, "[Mutator::compareExchangeValue] called", uptr(m_table), uptr(expected));
+            for (;;) {
+                m_value = expected;
+                if (m_cell->value.compareExchangeStrong(m_value, desired, turf::ConsumeRelease)) {
+                    m_value = desired; // Leave the mutator in a valid state
+                    return expected;
+                }
+                // The CAS failed and m_value has been updated with the latest value.
+                if (m_value != Value(ValueTraits::Redirect))
+                    return m_value;
+                // We've encountered a Redirect value. Retry the CAS in the new table.
+                followRedirect();
+                if (m_value != expected)
+                    return m_value;
+            }
+        }
+
         Value eraseValue() {
             TURF_ASSERT(m_cell); // Cell must have been found or inserted
-            TURF_TRACE(ConcurrentMap_Grampa, 21, "[Mutator::eraseValue] called", uptr(m_table), uptr(m_value));
+            TURF_TRACE(ConcurrentMap_Grampa, 20, "[Mutator::eraseValue] called", uptr(m_table), uptr(m_value));
             for (;;) {
                 if (m_value == Value(ValueTraits::NullValue))
                     return m_value;
                 TURF_ASSERT(m_cell); // m_value is non-NullValue, therefore cell must have been found or inserted.
+                // The cell keeps its hash, so a later insert of the same key takes it over. It's never handed to a
+                // different key, since another thread's Mutator may still refer to it; the next migration purges it.
                 if (m_cell->value.compareExchangeStrong(m_value, Value(ValueTraits::NullValue), turf::Consume)) {
                     // Exchange was successful and a non-NullValue value was erased and returned by reference in m_value.
                     TURF_ASSERT(m_value != Value(ValueTraits::NullValue)); // Implied by the test at the start of the loop.
@@ -422,7 +662,7 @@ public:
                     return result;
                 }
                 // The CAS failed and m_value has been updated with the latest value.
-                TURF_TRACE(ConcurrentMap_Grampa, 22, "[Mutator::eraseValue] detected race to write value", uptr(m_table),
+                TURF_TRACE(ConcurrentMap_Grampa, 21, "[Mutator::eraseValue] detected race to write value", uptr(m_table),
                            uptr(m_value));
                 if (m_value != Value(ValueTraits::Redirect)) {
                     // There was a racing write (or erase) to this cell.
@@ -430,10 +670,11 @@ public:
                     return Value(ValueTraits::NullValue);
                 }
                 // We've been redirected to a new table.
-                TURF_TRACE(ConcurrentMap_Grampa, 23, "[Mutator::eraseValue] was redirected", uptr(m_table), uptr(m_cell));
+                TURF_TRACE(ConcurrentMap_Grampa, 22, "[Mutator::eraseValue] was redirected", uptr(m_table), uptr(m_cell));
                 Hash hash = m_cell->hash.load(turf::Relaxed); // Re-fetch hash
                 for (;;) {
                     // Help complete the migration.
+                    details::countRedirectFollowed();
                     m_table->jobCoordinator.participate();
                     // Try again in the latest table.
                     if (!m_map.locateTable(m_table, m_sizeMask, hash))
@@ -447,29 +688,93 @@ public:
                     m_value = m_cell->value.load(turf::Relaxed);
                     if (m_value != Value(ValueTraits::Redirect))
                         break;
-                    TURF_TRACE(ConcurrentMap_Grampa, 24, "[Mutator::eraseValue] was re-redirected", uptr(m_table), uptr(m_cell));
+                    TURF_TRACE(ConcurrentMap_Grampa, 23, "[Mutator::eraseValue] was re-redirected", uptr(m_table), uptr(m_cell));
+                }
+            }
+        }
+
+        // Erases the value only if it currently equals expected. Returns true if this call erased it.
+        // If the cell is redirected by a migration, the comparison is retried in the new table.
+        bool eraseIfEquals(Value expected) {
+            TURF_ASSERT(expected != Value(ValueTraits::NullValue));
+            TURF_ASSERT(expected != Value(ValueTraits::Redirect));
+            TURF_TRACE(ConcurrentMap_Grampa, 24, "[Mutator::eraseIfEquals] called", uptr(m_table), uptr(expected));
+            if (!m_cell)
+                return false; // The key was not found.
+            for (;;) {
+                m_value = expected;
+                if (m_cell->value.compareExchangeStrong(m_value, Value(ValueTraits::NullValue), turf::Consume)) {
+                    m_value = Value(ValueTraits::NullValue); // Leave the mutator in a valid state
+                    return true;
+                }
+                // The CAS failed and m_value has been updated with the latest value.
+                if (m_value != Value(ValueTraits::Redirect))
+                    return false;
+                // We've been redirected to a new table. Retry the comparison there.
+                TURF_TRACE(ConcurrentMap_Grampa, 25, "[Mutator::eraseIfEquals] was redirected", uptr(m_table), uptr(m_cell));
+                // Unlike followRedirect(), only look the key up, since an erase must never insert it.
+                Hash hash = m_cell->hash.load(turf::Relaxed);
+                for (;;) {
+                    // Help complete the migration.
+                    details::countRedirectFollowed();
+                    m_table->jobCoordinator.participate();
+                    // Try again in the latest table.
+                    if (!m_map.locateTable(m_table, m_sizeMask, hash))
+                        m_cell = NULL;
+                    else
+                        m_cell = Details::find(hash, m_table, m_sizeMask);
+                    if (!m_cell) {
+                        m_value = Value(ValueTraits::NullValue);
+                        return false;
+                    }
+                    m_value = m_cell->value.load(turf::Relaxed);
+                    if (m_value != Value(ValueTraits::Redirect))
+                        break;
                 }
+                if (m_value != expected)
+                    return false;
             }
         }
     };
 
     Mutator insertOrFind(Key key) {
-        return Mutator(*this, key);
+        details::OperationScope scope(OperationCounters::Insert);
+        return Mutator(*this, KeyTraits::hash(key));
     }
 
     Mutator find(Key key) {
-        return Mutator(*this, key, false);
+        details::OperationScope scope(OperationCounters::Get);
+        return Mutator(*this, KeyTraits::hash(key), false);
+    }
+
+    // The ByHash variants take a precomputed hash, so that a caller probing several maps hashes the key once.
+    // Since the hash function is invertible, the hash identifies the key completely.
+    Mutator insertOrFindByHash(Hash hash) {
+        details::OperationScope scope(OperationCounters::Insert);
+        return Mutator(*this, hash);
+    }
+
+    Mutator findByHash(Hash hash) {
+        details::OperationScope scope(OperationCounters::Get);
+        return Mutator(*this, hash, false);
     }
 
     // Lookup without creating a temporary Mutator.
     Value get(Key key) {
-        Hash hash = KeyTraits::hash(key);
-        TURF_TRACE(ConcurrentMap_Grampa, 25, "[get] called", uptr(this), uptr(hash));
+        return getByHash(KeyTraits::hash(key));
+    }
+
+    Value getByHash(Hash hash) {
+        details::OperationScope scope(OperationCounters::Get);
+        TURF_TRACE(ConcurrentMap_Grampa, 26, "[get] called", uptr(this), uptr(hash));
         for (;;) {
             typename Details::Table* table;
             ureg sizeMask;
             if (!locateTable(table, sizeMask, hash))
                 return Value(ValueTraits::NullValue);
+#if JUNCTION_TRACK_GRAMPA_STATS
+            table->sampleAccess();
+#endif
             typename Details::Cell* cell = Details::find(hash, table, sizeMask);
             if (!cell)
                 return Value(ValueTraits::NullValue);
@@ -477,60 +782,193 @@ public:
             if (value != Value(ValueTraits::Redirect))
                 return value; // Found an existing value
             // We've been redirected to a new table. Help with the migration.
-            TURF_TRACE(ConcurrentMap_Grampa, 26, "[get] was redirected", uptr(table), 0);
+            TURF_TRACE(ConcurrentMap_Grampa, 27, "[get] was redirected", uptr(table), 0);
+            details::countRedirectFollowed();
             table->jobCoordinator.participate();
             // Try again in the new table.
         }
     }
 
     Value assign(Key key, Value desired) {
-        Mutator iter(*this, key);
+        details::OperationScope scope(OperationCounters::Insert);
+        Mutator iter(*this, KeyTraits::hash(key));
         return iter.exchangeValue(desired);
     }
 
     Value exchange(Key key, Value desired) {
-        Mutator iter(*this, key);
+        details::OperationScope scope(OperationCounters::Insert);
+        Mutator iter(*this, KeyTraits::hash(key));
         return iter.exchangeValue(desired);
     }
 
     Value erase(Key key) {
-        Mutator iter(*this, key, false);
+        details::OperationScope scope(OperationCounters::Erase);
+        Mutator iter(*this, KeyTraits::hash(key), false);
         return iter.eraseValue();
     }
 
+    // Stores desired only if the value associated with key equals expected. Returns the value that was observed.
+    // Pass NullValue as expected to insert only if the key is absent.
+    Value compareExchange(Key key, Value expected, Value desired) {
+        details::OperationScope scope(OperationCounters::Insert);
+        if (expected == Value(ValueTraits::NullValue)) {
+            Mutator iter(*this, KeyTraits::hash(key));
+            return iter.compareExchangeValue(expected, desired);
+        }
+        Mutator iter(*this, KeyTraits::hash(key), false);
+        if (!iter.m_cell)
+            return Value(ValueTraits::NullValue);
+        return iter.compareExchangeValue(expected, desired);
+    }
+
+    bool eraseIfEquals(Key key, Value expected) {
+        details::OperationScope scope(OperationCounters::Erase);
+        Mutator iter(*this, KeyTraits::hash(key), false);
+        return iter.eraseIfEquals(expected);
+    }
+
+    // Returns statistics for every leaf table, scanning each one entirely or sampleSize consecutive buckets of it.
+    // See MapStats.
+    MapStats collectStats(ureg sampleSize = 0) {
+        MapStats stats;
+        addFlatTreeBytes(m_root.load(turf::Consume), stats.bytesUsed);
+        Hash hash = 0;
+        for (;;) {
+            typename Details::Table* table;
+            ureg sizeMask;
+            if (!locateTable(table, sizeMask, hash))
+                break;
+            Details::collectTableStats(table, sampleSize, stats);
+            if (table->unsafeRangeShift >= sizeof(Hash) * 8)
+                break;
+            hash = table->baseHash + (Hash(1) << table->unsafeRangeShift);
+            if (hash == 0)
+                break; // Wrapped around
+        }
+        return stats;
+    }
+
+    // Passes every entry to sink(key, value) while other threads go on reading and modifying the map.
+    //
+    // Leaf tables are visited in hash order, and the buckets of each leaf a unit of TableMigrationUnitSize at a time.
+    // Each unit's entries are copied to a buffer, then passed to the sink before the next unit is visited, so the
+    // extra memory is one unit's worth. No cell is locked or modified, so writers never wait on a snapshot. If a unit
+    // runs into a TableMigration, the snapshot helps finish it like any other thread would, then carries on in the
+    // leaves that replaced it, skipping the entries it already passed. See details/SnapshotScan.h.
+    //
+    // It's not a point-in-time copy. Every key that stays in the map for the whole call is passed exactly once, with
+    // a value it held at some point during the call. A key that's inserted or erased during the call may or may not
+    // be passed. Since no table is used across a call to the sink, the sink may call QSBR::update(). The sink may be a
+    // temporary, such as a lambda.
+    template <class Sink>
+    void snapshot(Sink&& sink) {
+        details::SnapshotScan<Hash> scan;
+        std::vector<details::BulkEntry<Hash, Value>> unit;
+        typename Details::Table* table = NULL;
+        ureg sizeMask = 0;
+        Hash baseHash = 0;
+        ureg rangeShift = 0;
+        ureg bucketIdx = 0;
+        Hash hash = 0; // Every hash below this one is done
+        for (;;) {
+            typename Details::Table* t;
+            ureg tSizeMask;
+            if (!locateTable(t, tSizeMask, hash))
+                break; // The map has no table yet
+            if (t != table || tSizeMask != sizeMask || t->baseHash != baseHash || t->unsafeRangeShift != rangeShift) {
+                // The leaf was replaced. Remember how far we got in the old one, and start over in the new one.
+                if (table)
+                    scan.addVisited(baseHash, rangeShift, sizeMask, bucketIdx);
+                table = t;
+                sizeMask = tSizeMask;
+                baseHash = t->baseHash;
+                rangeShift = t->unsafeRangeShift;
+                bucketIdx = 0;
+            }
+            if (bucketIdx > sizeMask) {
+                // Done with this leaf. Continue with the next range.
+                if (rangeShift >= sizeof(Hash) * 8)
+                    break;
+                hash = baseHash + (Hash(1) << rangeShift);
+                if (hash == 0)
+                    break; // Wrapped around
+                scan.setDoneBelow(hash);
+                table = NULL;
+                continue;
+            }
+            ureg endIdx = turf::util::min(bucketIdx + Details::TableMigrationUnitSize, sizeMask + 1);
+            unit.clear();
+            for (; bucketIdx < endIdx; bucketIdx++) {
+                ureg prevSize = unit.size();
+                if (!Details::collectBucket(table, bucketIdx, unit)) {
+                    // Drop the partial bucket, help complete the migration, and continue in the new leaves.
+                    unit.resize(prevSize);
+                    details::countRedirectFollowed();
+                    table->jobCoordinator.participate();
+                    break;
+                }
+            }
+            for (ureg i = 0; i < unit.size(); i++) {
+                if (!scan.wasVisited(unit[i].hash))
+                    sink(KeyTraits::dehash(unit[i].hash), unit[i].value);
+            }
+        }
+    }
+
+#if JUNCTION_TRACK_GRAMPA_STATS
+    // Appends a snapshot of every leaf table to leaves, in hash order.
+    // Scans every cell to count occupancy, so it's as expensive as iterating over the map. It's safe to call
+    // concurrently with other operations; tables that are being migrated are reported as they were.
+    void getLeafStats(std::vector<details::GrampaLeafStats>& leaves) {
+        Hash hash = 0;
+        for (;;) {
+            typename Details::Table* table;
+            ureg sizeMask;
+            if (!locateTable(table, sizeMask, hash))
+                return;
+            details::GrampaLeafStats leaf;
+            leaf.baseHash = table->baseHash;
+            leaf.rangeShift = table->unsafeRangeShift;
+            leaf.size = sizeMask + 1;
+            leaf.numCellsInUse = 0;
+            for (ureg idx = 0; idx <= sizeMask; idx++) {
+                typename Details::Cell* cell = table->getCellGroups()[idx >> 2].cells + (idx & 3);
+                Value value = cell->value.load(turf::Relaxed);
+                if (value != Value(ValueTraits::NullValue) && value != Value(ValueTraits::Redirect))
+                    leaf.numCellsInUse++;
+            }
+            leaf.maxProbeLength = table->maxProbeLength.load(turf::Relaxed);
+            leaf.numMigrations = table->numMigrations;
+            leaf.numSampledAccesses = table->numSampledAccesses.load(turf::Relaxed);
+            leaves.push_back(leaf);
+            if (table->unsafeRangeShift >= sizeof(Hash) * 8)
+                return;
+            // Continue with the next range. If the leaf was split in the meantime, we'll land on its upper half.
+            hash = table->baseHash + (Hash(1) << table->unsafeRangeShift);
+            if (hash == 0)
+                return; // Wrapped around
+        }
+    }
+#endif
+
     // The easiest way to implement an Iterator is to prevent all Redirects.
     // The currrent Iterator does that by forbidding concurrent inserts.
     // To make it work with concurrent inserts, we'd need a way to block TableMigrations as the Iterator visits each table.
-    // FlatTreeMigrations, too.
     class Iterator {
     private:
-        typename Details::FlatTree* m_flatTree;
-        ureg m_flatTreeIdx;
+        ConcurrentMap_Grampa& m_map;
         typename Details::Table* m_table;
         ureg m_idx;
         Key m_hash;
         Value m_value;
 
     public:
-        Iterator(ConcurrentMap_Grampa& map) {
-            // Since we've forbidden concurrent inserts (for now), nonatomic would suffice here, but let's plan ahead:
-            ureg root = map.m_root.load(turf::Consume);
-            if (root & 1) {
-                m_flatTree = (typename Details::FlatTree*) (root & ~ureg(1));
-                TURF_ASSERT(m_flatTree->getSize() > 0);
-                m_flatTreeIdx = 0;
-                m_table = m_flatTree->getTables()[0].load(turf::Consume);
-                TURF_ASSERT(m_table);
-                m_idx = -1;
-            } else {
-                m_flatTree = NULL;
-                m_flatTreeIdx = 0;
-                m_table = (typename Details::Table*) root;
-                m_idx = -1;
-            }
-            if (m_table) {
+        Iterator(ConcurrentMap_Grampa& map) : m_map(map), m_idx(-1) {
+            ureg sizeMask;
+            if (m_map.locateTable(m_table, sizeMask, 0)) {
                 next();
             } else {
+                m_table = NULL;
                 m_hash = KeyTraits::NullHash;
                 m_value = Value(ValueTraits::NullValue);
             }
@@ -540,7 +978,6 @@ public:
             TURF_ASSERT(m_table);
             TURF_ASSERT(isValid() || m_idx == -1); // Either the Iterator is already valid, or we've just started iterating.
             for (;;) {
-            searchInTable:
                 m_idx++;
                 if (m_idx <= m_table->sizeMask) {
                     // Index still inside range of table.
@@ -555,17 +992,14 @@ public:
                             return; // Yield this cell.
                     }
                 } else {
-                    // We've advanced past the end of this table.
-                    if (m_flatTree) {
-                        // Scan for the next unique table in the flattree.
-                        while (++m_flatTreeIdx < m_flatTree->getSize()) {
-                            typename Details::Table* nextTable = m_flatTree->getTables()[m_flatTreeIdx].load(turf::Consume);
-                            if (nextTable != m_table) {
-                                // Found the next table.
-                                m_table = nextTable;
-                                m_idx = -1;
-                                goto searchInTable; // Continue iterating in this table.
-                            }
+                    // We've advanced past the end of this table. Continue with the table that holds the next range of
+                    // hashes, if any.
+                    if (m_table->unsafeRangeShift < sizeof(Hash) * 8) {
+                        Hash hash = m_table->baseHash + (Hash(1) << m_table->unsafeRangeShift);
+                        ureg sizeMask;
+                        if (hash != 0 && m_map.locateTable(m_table, sizeMask, hash)) {
+                            m_idx = -1;
+                            continue;
                         }
                     }
                     // That's the end of the entire map.
@@ -15,29 +15,68 @@
 
 #include <junction/Core.h>
 #include <junction/details/Leapfrog.h>
+#include <junction/details/SnapshotScan.h>
 #include <junction/QSBR.h>
+#include <junction/OperationCounters.h>
 #include <turf/Heap.h>
 #include <turf/Trace.h>
 
 namespace junction {
 
-TURF_TRACE_DECLARE(ConcurrentMap_Leapfrog, 17)
+TURF_TRACE_DECLARE(ConcurrentMap_Leapfrog, 22)
 
-template <typename K, typename V, class KT = DefaultKeyTraits<K>, class VT = DefaultValueTraits<V> >
+template <typename K, typename V, class KT>
+class ConcurrentCache;
+template <typename K, typename V, class KT>
+class ConcurrentExpiringMap;
+
+template <typename K, typename V, class KT = DefaultKeyTraits<K>, class VT = DefaultValueTraits<V>,
+          class TT = DefaultTuningTraits>
 class ConcurrentMap_Leapfrog {
 public:
     typedef K Key;
     typedef V Value;
     typedef KT KeyTraits;
     typedef VT ValueTraits;
+    typedef TT TuningTraits;
     typedef typename turf::util::BestFit<Key>::Unsigned Hash;
     typedef details::Leapfrog<ConcurrentMap_Leapfrog> Details;
 
+    // Mutator::fetchAdd() is only available when NullValue is zero and Redirect is the sign bit, as in
+    // CounterValueTraits. With DefaultValueTraits, Redirect is 1, which is an ordinary sum.
+    static const bool SupportsFetchAdd =
+        ValueTraits::NullValue == 0 &&
+        ValueTraits::Redirect == typename ValueTraits::IntType(1) << (sizeof(typename ValueTraits::IntType) * 8 - 1);
+
+    // Optional filter consulted by Details::TableMigration for every live cell it's about to migrate.
+    // Cells for which shouldDrop() returns true are redirected without being copied to the destination table,
+    // exactly as if they had been erased. onDropped() is then called once for each such cell, from whichever
+    // thread migrated it, and is responsible for the value from that point on.
+    class MigrationFilter {
+    public:
+        virtual ~MigrationFilter() {
+        }
+        virtual bool shouldDrop(Hash hash, Value value) = 0;
+        virtual void onDropped(Hash hash, Value value) = 0;
+    };
+
 private:
+    template <typename, typename, class>
+    friend class ConcurrentCache; // Sweeps the cells of m_root directly
+    template <typename, typename, class>
+    friend class ConcurrentExpiringMap; // Likewise
+
+    striped::ConditionBank* m_conditionBank;
     turf::Atomic<typename Details::Table*> m_root;
+    MigrationFilter* m_migrationFilter;
+    MigrationObserver* m_migrationObserver;
 
 public:
-    ConcurrentMap_Leapfrog(ureg capacity = Details::InitialSize) : m_root(Details::Table::create(capacity)) {
+    // Pass a conditionBank to keep this map's waiting threads off DefaultConditionBank, which is shared with every
+    // other map in the process. The bank must outlive the map.
+    ConcurrentMap_Leapfrog(ureg capacity = Details::InitialSize, striped::ConditionBank* conditionBank = NULL)
+        : m_conditionBank(conditionBank), m_root(Details::Table::create(capacity, conditionBank)), m_migrationFilter(NULL),
+          m_migrationObserver(NULL) {
     }
 
     ~ConcurrentMap_Leapfrog() {
@@ -45,6 +84,98 @@ public:
         table->destroy();
     }
 
+    // Must be called before the map is shared with other threads.
+    void setMigrationFilter(MigrationFilter* filter) {
+        m_migrationFilter = filter;
+    }
+
+    MigrationFilter* getMigrationFilter() const {
+        return m_migrationFilter;
+    }
+
+    // Threads waiting on this map's migrations block on ConditionPairs from this bank.
+    striped::ConditionBank* getConditionBank() const {
+        return m_conditionBank;
+    }
+
+    // Must be called before the map is shared with other threads.
+    void setMigrationObserver(MigrationObserver* observer) {
+        m_migrationObserver = observer;
+    }
+
+    MigrationObserver* getMigrationObserver() const {
+        return m_migrationObserver;
+    }
+
+    // Replaces the contents of the map with the (key, value) pairs in [first, last), such as a range of std::pair.
+    // Much faster than assigning them one at a time: the table is sized once, for the number of pairs, and filled in
+    // one sequential sweep. See details/BulkLoad.h. If a key appears more than once, the last value wins.
+    // Must be called before the map is shared with other threads.
+    template <class InputIt>
+    void buildFrom(InputIt first, InputIt last) {
+        std::vector<details::BulkEntry<Hash, Value>> entries;
+        std::vector<details::BulkEntry<Hash, Value>> sorted;
+        details::collectBulkEntries<KeyTraits>(entries, first, last);
+        ureg size = turf::util::max(ureg(Details::InitialSize), turf::util::roundUpPowerOf2(ureg(entries.size() * 2)));
+        typename Details::Table* table;
+        for (;;) {
+            table = Details::Table::create(size, m_conditionBank);
+            details::sortBulkEntries(entries, sorted, size, details::TableBucket<Hash>(size - 1));
+            typename Details::BulkWriter writer(table);
+            if (details::buildBulkTable(sorted.data(), sorted.size(), size - 1, Details::LinearSearchLimit, writer))
+                break; // Success
+            // Failed; try a larger table
+            table->destroy();
+            size *= 2;
+        }
+        m_root.loadNonatomic()->destroy();
+        m_root.storeNonatomic(table);
+    }
+
+    // Writes the map's table, cells and deltas included, to a snapshot file that loadSnapshot() can restore in a
+    // later process without rehashing. See details/Snapshot.h. Values are written as they are, so this is only useful
+    // if they mean the same thing in the next process, such as integers or offsets rather than pointers.
+    // No other thread may modify the map during the call. Returns false if the file couldn't be written.
+    bool saveSnapshot(const char* path) {
+        typename Details::Table* table = m_root.load(turf::Consume);
+        details::SnapshotHeader header;
+        Details::getSnapshotLayout().initHeader(header);
+        header.numTables = 1;
+        details::SnapshotTable record;
+        record.offset = details::SnapshotWriter::alignUp(sizeof(header) + sizeof(record));
+        record.size = table->sizeMask + 1;
+        record.baseHash = 0;
+        record.rangeShift = sizeof(Hash) * 8;
+        details::SnapshotWriter writer(path);
+        writer.write(&header, sizeof(header));
+        writer.write(&record, sizeof(record));
+        Details::saveTable(writer, table, record.offset);
+        return writer.close();
+    }
+
+    // Replaces the contents of the map with a snapshot written by saveSnapshot(). The file is mapped copy-on-write
+    // and its table becomes the map's table as it lies, so pages are only read as they're touched and only copied
+    // when they're modified. The file must not be modified or truncated while the map, or any table migrated out of
+    // it, still uses it. Returns false, leaving the map unchanged, if the file can't be read or was written by a build
+    // with a different layout. Must be called before the map is shared with other threads.
+    bool loadSnapshot(const char* path) {
+        details::SnapshotMapping* mapping = details::SnapshotMapping::open(path);
+        if (!mapping)
+            return false;
+        const details::SnapshotHeader* header = mapping->validate(Details::getSnapshotLayout());
+        if (!header || header->numTables != 1 || header->numSlots != 0) {
+            mapping->release();
+            return false;
+        }
+        const details::SnapshotTable& record = mapping->getTables()[0];
+        typename Details::Table* table =
+            Details::Table::restore(mapping->getData() + record.offset, ureg(record.size), m_conditionBank, mapping);
+        mapping->release(); // The table holds its own reference.
+        m_root.loadNonatomic()->destroy();
+        m_root.storeNonatomic(table);
+        return true;
+    }
+
     // publishTableMigration() is called by exactly one thread from Details::TableMigration::run()
     // after all the threads participating in the migration have completed their work.
     void publishTableMigration(typename Details::TableMigration* migration) {
@@ -55,6 +186,63 @@ public:
         // Caller will GC the TableMigration and the source table.
     }
 
+    // Returns statistics for the whole table, or for sampleSize consecutive buckets. See MapStats.
+    MapStats collectStats(ureg sampleSize = 0) {
+        MapStats stats;
+        Details::collectTableStats(m_root.load(turf::Consume), sampleSize, stats);
+        return stats;
+    }
+
+    // Passes every entry to sink(key, value) while other threads go on reading and modifying the map.
+    //
+    // The buckets are visited a unit of TableMigrationUnitSize at a time. Each unit's entries are copied to a buffer,
+    // then passed to the sink before the next unit is visited, so the extra memory is one unit's worth. No cell is
+    // locked or modified, so writers never wait on a snapshot. If a unit runs into a TableMigration, the snapshot
+    // helps finish it like any other thread would, then carries on in the new table, skipping the entries it already
+    // passed. See details/SnapshotScan.h.
+    //
+    // It's not a point-in-time copy. Every key that stays in the map for the whole call is passed exactly once, with
+    // a value it held at some point during the call. A key that's inserted or erased during the call may or may not
+    // be passed. Since no table is used across a call to the sink, the sink may call QSBR::update(). The sink may be a
+    // temporary, such as a lambda.
+    template <class Sink>
+    void snapshot(Sink&& sink) {
+        details::SnapshotScan<Hash> scan;
+        std::vector<details::BulkEntry<Hash, Value>> unit;
+        typename Details::Table* table = NULL;
+        ureg sizeMask = 0;
+        ureg bucketIdx = 0;
+        for (;;) {
+            typename Details::Table* root = m_root.load(turf::Consume);
+            if (root != table || root->sizeMask != sizeMask) {
+                // The table was replaced. Remember how far we got in the old one, and start over in the new one.
+                if (table)
+                    scan.addVisited(0, sizeof(Hash) * 8, sizeMask, bucketIdx);
+                table = root;
+                sizeMask = root->sizeMask;
+                bucketIdx = 0;
+            }
+            if (bucketIdx > sizeMask)
+                break;
+            ureg endIdx = turf::util::min(bucketIdx + Details::TableMigrationUnitSize, sizeMask + 1);
+            unit.clear();
+            for (; bucketIdx < endIdx; bucketIdx++) {
+                ureg prevSize = unit.size();
+                if (!Details::collectBucket(table, bucketIdx, unit)) {
+                    // Drop the partial bucket, help complete the migration, and continue in the new table.
+                    unit.resize(prevSize);
+                    details::countRedirectFollowed();
+                    table->jobCoordinator.participate();
+                    break;
+                }
+            }
+            for (ureg i = 0; i < unit.size(); i++) {
+                if (!scan.wasVisited(unit[i].hash))
+                    sink(KeyTraits::dehash(unit[i].hash), unit[i].value);
+            }
+        }
+    }
+
     // A Mutator represents a known cell in the hash table.
     // It's meant for manipulations within a temporary function scope.
     // Obviously you must not call QSBR::Update while holding a Mutator.
@@ -73,9 +261,8 @@ public:
         Value m_value;
 
         // Constructor: Find existing cell
-        Mutator(ConcurrentMap_Leapfrog& map, Key key, bool) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
-            TURF_TRACE(ConcurrentMap_Leapfrog, 0, "[Mutator] find constructor called", uptr(0), uptr(key));
-            Hash hash = KeyTraits::hash(key);
+        Mutator(ConcurrentMap_Leapfrog& map, Hash hash, bool) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
+            TURF_TRACE(ConcurrentMap_Leapfrog, 0, "[Mutator] find constructor called", uptr(0), uptr(hash));
             for (;;) {
                 m_table = m_map.m_root.load(turf::Consume);
                 m_cell = Details::find(hash, m_table);
@@ -89,15 +276,15 @@ public:
                 }
                 // We've encountered a Redirect value. Help finish the migration.
                 TURF_TRACE(ConcurrentMap_Leapfrog, 1, "[Mutator] find was redirected", uptr(m_table), 0);
+                details::countRedirectFollowed();
                 m_table->jobCoordinator.participate();
                 // Try again using the latest root.
             }
         }
 
         // Constructor: Insert or find cell
-        Mutator(ConcurrentMap_Leapfrog& map, Key key) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
-            TURF_TRACE(ConcurrentMap_Leapfrog, 2, "[Mutator] insertOrFind constructor called", uptr(0), uptr(key));
-            Hash hash = KeyTraits::hash(key);
+        Mutator(ConcurrentMap_Leapfrog& map, Hash hash) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
+            TURF_TRACE(ConcurrentMap_Leapfrog, 2, "[Mutator] insertOrFind constructor called", uptr(0), uptr(hash));
             for (;;) {
                 m_table = m_map.m_root.load(turf::Consume);
                 ureg overflowIdx;
@@ -112,6 +299,7 @@ public:
                     if (value == Value(ValueTraits::Redirect)) {
                         // We've encountered a Redirect value.
                         TURF_TRACE(ConcurrentMap_Leapfrog, 3, "[Mutator] insertOrFind was redirected", uptr(m_table), uptr(m_value));
+                        details::countRedirectFollowed();
                         break; // Help finish the migration.
                     }
                     // Found an existing value
@@ -135,6 +323,42 @@ public:
             }
         }
 
+        // Called after a CAS on m_cell encountered a Redirect value.
+        // Helps finish the migration, then locates the same hash in the latest table, inserting it if necessary.
+        // On return, m_cell is valid and m_value holds its latest value, which is never Redirect.
+        void followRedirect() {
+            TURF_TRACE(ConcurrentMap_Leapfrog, 4, "[Mutator::followRedirect] called", uptr(m_table), uptr(m_cell));
+            details::countRedirectFollowed();
+            Hash hash = m_cell->hash.load(turf::Relaxed);
+            for (;;) {
+                // Help complete the migration.
+                m_table->jobCoordinator.participate();
+                // Try again in the new table.
+                m_table = m_map.m_root.load(turf::Consume);
+                m_value = Value(ValueTraits::NullValue);
+                ureg overflowIdx;
+                switch (Details::insertOrFind(hash, m_table, m_cell, overflowIdx)) { // Modifies m_cell
+                case Details::InsertResult_AlreadyFound:
+                    m_value = m_cell->value.load(turf::Consume);
+                    if (m_value == Value(ValueTraits::Redirect)) {
+                        TURF_TRACE(ConcurrentMap_Leapfrog, 5, "[Mutator::followRedirect] was re-redirected", uptr(m_table),
+                                   uptr(m_value));
+                        details::countRedirectFollowed();
+                        break;
+                    }
+                    return;
+                case Details::InsertResult_InsertedNew:
+                    return;
+                case Details::InsertResult_Overflow:
+                    TURF_TRACE(ConcurrentMap_Leapfrog, 6, "[Mutator::followRedirect] overflow after redirect", uptr(m_table),
+                               overflowIdx);
+                    Details::beginTableMigration(m_map, m_table, overflowIdx);
+                    break;
+                }
+                // We were redirected... again
+            }
+        }
+
     public:
         Value getValue() const {
             // Return previously loaded value. Don't load it again.
@@ -145,12 +369,12 @@ public:
             TURF_ASSERT(desired != Value(ValueTraits::NullValue));
             TURF_ASSERT(desired != Value(ValueTraits::Redirect));
             TURF_ASSERT(m_cell); // Cell must have been found or inserted
-            TURF_TRACE(ConcurrentMap_Leapfrog, 4, "[Mutator::exchangeValue] called", uptr(m_table), uptr(m_value));
+            TURF_TRACE(ConcurrentMap_Leapfrog, 7, "[Mutator::exchangeValue] called", uptr(m_table), uptr(m_value));
             for (;;) {
                 Value oldValue = m_value;
                 if (m_cell->value.compareExchangeStrong(m_value, desired, turf::ConsumeRelease)) {
                     // Exchange was successful. Return previous value.
-                    TURF_TRACE(ConcurrentMap_Leapfrog, 5, "[Mutator::exchangeValue] exchanged Value", uptr(m_value),
+                    TURF_TRACE(ConcurrentMap_Leapfrog, 8, "[Mutator::exchangeValue] exchanged Value", uptr(m_value),
                                uptr(desired));
                     Value result = m_value;
                     m_value = desired; // Leave the mutator in a valid state
@@ -158,47 +382,19 @@ public:
                 }
                 // The CAS failed and m_value has been updated with the latest value.
                 if (m_value != Value(ValueTraits::Redirect)) {
-                    TURF_TRACE(ConcurrentMap_Leapfrog, 6, "[Mutator::exchangeValue] detected race to write value", uptr(m_table),
+                    TURF_TRACE(ConcurrentMap_Leapfrog, 9, "[Mutator::exchangeValue] detected race to write value", uptr(m_table),
                                uptr(m_value));
                     if (oldValue == Value(ValueTraits::NullValue) && m_value != Value(ValueTraits::NullValue)) {
-                        TURF_TRACE(ConcurrentMap_Leapfrog, 7, "[Mutator::exchangeValue] racing write inserted new value",
+                        TURF_TRACE(ConcurrentMap_Leapfrog, 10, "[Mutator::exchangeValue] racing write inserted new value",
                                    uptr(m_table), uptr(m_value));
                     }
                     // There was a racing write (or erase) to this cell.
                     // Pretend we exchanged with ourselves, and just let the racing write win.
                     return desired;
                 }
-                // We've encountered a Redirect value. Help finish the migration.
-                TURF_TRACE(ConcurrentMap_Leapfrog, 8, "[Mutator::exchangeValue] was redirected", uptr(m_table), uptr(m_value));
-                Hash hash = m_cell->hash.load(turf::Relaxed);
-                for (;;) {
-                    // Help complete the migration.
-                    m_table->jobCoordinator.participate();
-                    // Try again in the new table.
-                    m_table = m_map.m_root.load(turf::Consume);
-                    m_value = Value(ValueTraits::NullValue);
-                    ureg overflowIdx;
-                    switch (Details::insertOrFind(hash, m_table, m_cell, overflowIdx)) { // Modifies m_cell
-                    case Details::InsertResult_AlreadyFound:
-                        m_value = m_cell->value.load(turf::Consume);
-                        if (m_value == Value(ValueTraits::Redirect)) {
-                            TURF_TRACE(ConcurrentMap_Leapfrog, 9, "[Mutator::exchangeValue] was re-redirected", uptr(m_table),
-                                       uptr(m_value));
-                            break;
-                        }
-                        goto breakOuter;
-                    case Details::InsertResult_InsertedNew:
-                        goto breakOuter;
-                    case Details::InsertResult_Overflow:
-                        TURF_TRACE(ConcurrentMap_Leapfrog, 10, "[Mutator::exchangeValue] overflow after redirect", uptr(m_table),
-                                   overflowIdx);
-                        Details::beginTableMigration(m_map, m_table, overflowIdx);
-                        break;
-                    }
-                    // We were redirected... again
-                }
-            breakOuter:;
-                // Try again in the new table.
+                // We've encountered a Redirect value. Help finish the migration, then try again in the new table.
+                TURF_TRACE(ConcurrentMap_Leapfrog, 11, "[Mutator::exchangeValue] was redirected", uptr(m_table), uptr(m_value));
+                followRedirect();
             }
         }
 
@@ -206,13 +402,66 @@ public:
             exchangeValue(desired);
         }
 
+        // Stores desired only if the current value equals expected, and returns the value that was observed.
+        // The exchange took place if and only if the return value equals expected.
+        // Unlike exchangeValue(), a racing write is never ignored; it's reported to the caller instead.
+        Value compareExchangeValue(Value expected, Value desired) {
+            TURF_ASSERT(expected != Value(ValueTraits::Redirect));
+            TURF_ASSERT(desired != Value(ValueTraits::Redirect));
+            TURF_ASSERT(m_cell); // Cell must have been found or inserted
+            TURF_TRACE(ConcurrentMap_Leapfrog, 12, "[Mutator::compareExchangeValue] called", uptr(m_table), uptr(expected));
+            for (;;) {
+                m_value = expected;
+                if (m_cell->value.compareExchangeStrong(m_value, desired, turf::ConsumeRelease)) {
+                    m_value = desired; // Leave the mutator in a valid state
+                    return expected;
+                }
+                // The CAS failed and m_value has been updated with the latest value.
+                if (m_value != Value(ValueTraits::Redirect))
+                    return m_value;
+                // We've encountered a Redirect value. Retry the CAS in the new table.
+                followRedirect();
+                if (m_value != expected)
+                    return m_value;
+            }
+        }
+
+        // Atomically adds delta to the current value, treating NullValue as zero, and returns the previous value.
+        // Only meaningful for integer values, and only compiles if SupportsFetchAdd. The CAS is retried on the same
+        // cell, so the key is not hashed or probed again unless a migration redirects it. A sum of zero leaves the
+        // cell erased. A sum can only land on Redirect by overflowing, and then it steps one further in the direction
+        // of delta, since storing Redirect would mark the cell as migrated.
+        Value fetchAdd(Value delta) {
+            TURF_STATIC_ASSERT(SupportsFetchAdd);
+            typedef typename ValueTraits::IntType IntType;
+            TURF_ASSERT(m_cell); // Cell must have been found or inserted
+            TURF_TRACE(ConcurrentMap_Leapfrog, 13, "[Mutator::fetchAdd] called", uptr(m_table), uptr(m_value));
+            for (;;) {
+                Value oldValue = m_value;
+                IntType sum = IntType(IntType(oldValue) + IntType(delta));
+                if (sum == IntType(ValueTraits::Redirect))
+                    sum = IntType(sum + ((IntType(delta) & IntType(ValueTraits::Redirect)) ? IntType(-1) : IntType(1)));
+                Value desired = Value(sum);
+                if (m_cell->value.compareExchangeStrong(m_value, desired, turf::ConsumeRelease)) {
+                    m_value = desired; // Leave the mutator in a valid state
+                    return oldValue;
+                }
+                // The CAS failed and m_value has been updated with the latest value.
+                if (m_value == Value(ValueTraits::Redirect))
+                    followRedirect();
+                // Try again using the latest value.
+            }
+        }
+
         Value eraseValue() {
             TURF_ASSERT(m_cell); // Cell must have been found or inserted
-            TURF_TRACE(ConcurrentMap_Leapfrog, 11, "[Mutator::eraseValue] called", uptr(m_table), uptr(m_cell));
+            TURF_TRACE(ConcurrentMap_Leapfrog, 14, "[Mutator::eraseValue] called", uptr(m_table), uptr(m_cell));
             for (;;) {
                 if (m_value == Value(ValueTraits::NullValue))
                     return Value(m_value);
                 TURF_ASSERT(m_cell); // m_value is non-NullValue, therefore cell must have been found or inserted.
+                // The cell keeps its hash, so a later insert of the same key takes it over. It's never handed to a
+                // different key, since another thread's Mutator may still refer to it; the next migration purges it.
                 if (m_cell->value.compareExchangeStrong(m_value, Value(ValueTraits::NullValue), turf::Consume)) {
                     // Exchange was successful and a non-NULL value was erased and returned by reference in m_value.
                     TURF_ASSERT(m_value != Value(ValueTraits::NullValue)); // Implied by the test at the start of the loop.
@@ -221,7 +470,7 @@ public:
                     return result;
                 }
                 // The CAS failed and m_value has been updated with the latest value.
-                TURF_TRACE(ConcurrentMap_Leapfrog, 12, "[Mutator::eraseValue] detected race to write value", uptr(m_table),
+                TURF_TRACE(ConcurrentMap_Leapfrog, 15, "[Mutator::eraseValue] detected race to write value", uptr(m_table),
                            uptr(m_cell));
                 if (m_value != Value(ValueTraits::Redirect)) {
                     // There was a racing write (or erase) to this cell.
@@ -229,10 +478,11 @@ public:
                     return Value(ValueTraits::NullValue);
                 }
                 // We've been redirected to a new table.
-                TURF_TRACE(ConcurrentMap_Leapfrog, 13, "[Mutator::eraseValue] was redirected", uptr(m_table), uptr(m_cell));
+                TURF_TRACE(ConcurrentMap_Leapfrog, 16, "[Mutator::eraseValue] was redirected", uptr(m_table), uptr(m_cell));
                 Hash hash = m_cell->hash.load(turf::Relaxed); // Re-fetch hash
                 for (;;) {
                     // Help complete the migration.
+                    details::countRedirectFollowed();
                     m_table->jobCoordinator.participate();
                     // Try again in the new table.
                     m_table = m_map.m_root.load(turf::Consume);
@@ -244,25 +494,84 @@ public:
                     m_value = m_cell->value.load(turf::Relaxed);
                     if (m_value != Value(ValueTraits::Redirect))
                         break;
-                    TURF_TRACE(ConcurrentMap_Leapfrog, 14, "[Mutator::eraseValue] was re-redirected", uptr(m_table),
+                    TURF_TRACE(ConcurrentMap_Leapfrog, 17, "[Mutator::eraseValue] was re-redirected", uptr(m_table),
                                uptr(m_cell));
                 }
             }
         }
+
+        // Erases the value only if it currently equals expected. Returns true if this call erased it.
+        // If the cell is redirected by a migration, the comparison is retried in the new table.
+        bool eraseIfEquals(Value expected) {
+            TURF_ASSERT(expected != Value(ValueTraits::NullValue));
+            TURF_ASSERT(expected != Value(ValueTraits::Redirect));
+            TURF_TRACE(ConcurrentMap_Leapfrog, 18, "[Mutator::eraseIfEquals] called", uptr(m_table), uptr(expected));
+            if (!m_cell)
+                return false; // The key was not found.
+            for (;;) {
+                m_value = expected;
+                if (m_cell->value.compareExchangeStrong(m_value, Value(ValueTraits::NullValue), turf::Consume)) {
+                    m_value = Value(ValueTraits::NullValue); // Leave the mutator in a valid state
+                    return true;
+                }
+                // The CAS failed and m_value has been updated with the latest value.
+                if (m_value != Value(ValueTraits::Redirect))
+                    return false;
+                // We've been redirected to a new table. Retry the comparison there.
+                TURF_TRACE(ConcurrentMap_Leapfrog, 19, "[Mutator::eraseIfEquals] was redirected", uptr(m_table), uptr(m_cell));
+                // Unlike followRedirect(), only look the key up, since an erase must never insert it.
+                Hash hash = m_cell->hash.load(turf::Relaxed);
+                for (;;) {
+                    // Help complete the migration.
+                    details::countRedirectFollowed();
+                    m_table->jobCoordinator.participate();
+                    // Try again in the new table.
+                    m_table = m_map.m_root.load(turf::Consume);
+                    m_cell = Details::find(hash, m_table);
+                    if (!m_cell) {
+                        m_value = Value(ValueTraits::NullValue);
+                        return false;
+                    }
+                    m_value = m_cell->value.load(turf::Relaxed);
+                    if (m_value != Value(ValueTraits::Redirect))
+                        break;
+                }
+                if (m_value != expected)
+                    return false;
+            }
+        }
     };
 
     Mutator insertOrFind(Key key) {
-        return Mutator(*this, key);
+        details::OperationScope scope(OperationCounters::Insert);
+        return Mutator(*this, KeyTraits::hash(key));
     }
 
     Mutator find(Key key) {
-        return Mutator(*this, key, false);
+        details::OperationScope scope(OperationCounters::Get);
+        return Mutator(*this, KeyTraits::hash(key), false);
+    }
+
+    // The ByHash variants take a precomputed hash, so that a caller probing several maps hashes the key once.
+    // Since the hash function is invertible, the hash identifies the key completely.
+    Mutator insertOrFindByHash(Hash hash) {
+        details::OperationScope scope(OperationCounters::Insert);
+        return Mutator(*this, hash);
+    }
+
+    Mutator findByHash(Hash hash) {
+        details::OperationScope scope(OperationCounters::Get);
+        return Mutator(*this, hash, false);
     }
 
     // Lookup without creating a temporary Mutator.
     Value get(Key key) {
-        Hash hash = KeyTraits::hash(key);
-        TURF_TRACE(ConcurrentMap_Leapfrog, 15, "[get] called", uptr(this), uptr(hash));
+        return getByHash(KeyTraits::hash(key));
+    }
+
+    Value getByHash(Hash hash) {
+        details::OperationScope scope(OperationCounters::Get);
+        TURF_TRACE(ConcurrentMap_Leapfrog, 20, "[get] called", uptr(this), uptr(hash));
         for (;;) {
             typename Details::Table* table = m_root.load(turf::Consume);
             typename Details::Cell* cell = Details::find(hash, table);
@@ -272,27 +581,51 @@ public:
             if (value != Value(ValueTraits::Redirect))
                 return value; // Found an existing value
             // We've been redirected to a new table. Help with the migration.
-            TURF_TRACE(ConcurrentMap_Leapfrog, 16, "[get] was redirected", uptr(table), uptr(hash));
+            TURF_TRACE(ConcurrentMap_Leapfrog, 21, "[get] was redirected", uptr(table), uptr(hash));
+            details::countRedirectFollowed();
             table->jobCoordinator.participate();
             // Try again in the new table.
         }
     }
 
     Value assign(Key key, Value desired) {
-        Mutator iter(*this, key);
+        details::OperationScope scope(OperationCounters::Insert);
+        Mutator iter(*this, KeyTraits::hash(key));
         return iter.exchangeValue(desired);
     }
 
     Value exchange(Key key, Value desired) {
-        Mutator iter(*this, key);
+        details::OperationScope scope(OperationCounters::Insert);
+        Mutator iter(*this, KeyTraits::hash(key));
         return iter.exchangeValue(desired);
     }
 
     Value erase(Key key) {
-        Mutator iter(*this, key, false);
+        details::OperationScope scope(OperationCounters::Erase);
+        Mutator iter(*this, KeyTraits::hash(key), false);
         return iter.eraseValue();
     }
 
+    // Stores desired only if the value associated with key equals expected. Returns the value that was observed.
+    // Pass NullValue as expected to insert only if the key is absent.
+    Value compareExchange(Key key, Value expected, Value desired) {
+        details::OperationScope scope(OperationCounters::Insert);
+        if (expected == Value(ValueTraits::NullValue)) {
+            Mutator iter(*this, KeyTraits::hash(key));
+            return iter.compareExchangeValue(expected, desired);
+        }
+        Mutator iter(*this, KeyTraits::hash(key), false);
+        if (!iter.m_cell)
+            return Value(ValueTraits::NullValue);
+        return iter.compareExchangeValue(expected, desired);
+    }
+
+    bool eraseIfEquals(Key key, Value expected) {
+        details::OperationScope scope(OperationCounters::Erase);
+        Mutator iter(*this, KeyTraits::hash(key), false);
+        return iter.eraseIfEquals(expected);
+    }
+
     // The easiest way to implement an Iterator is to prevent all Redirects.
     // The currrent Iterator does that by forbidding concurrent inserts.
     // To make it work with concurrent inserts, we'd need a way to block TableMigrations.
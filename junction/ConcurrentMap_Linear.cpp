@@ -14,24 +14,28 @@
 
 namespace junction {
 
-TURF_TRACE_DEFINE_BEGIN(ConcurrentMap_Linear, 17) // autogenerated by TidySource.py
+TURF_TRACE_DEFINE_BEGIN(ConcurrentMap_Linear, 21) // autogenerated by TidySource.py
 TURF_TRACE_DEFINE("[Mutator] find constructor called")
 TURF_TRACE_DEFINE("[Mutator] find was redirected")
 TURF_TRACE_DEFINE("[Mutator] insertOrFind constructor called")
 TURF_TRACE_DEFINE("[Mutator] insertOrFind was redirected")
+TURF_TRACE_DEFINE("[Mutator::followRedirect] called")
+TURF_TRACE_DEFINE("[Mutator::followRedirect] was re-redirected")
+TURF_TRACE_DEFINE("[Mutator::followRedirect] overflow after redirect")
 TURF_TRACE_DEFINE("[Mutator::exchangeValue] called")
 TURF_TRACE_DEFINE("[Mutator::exchangeValue] exchanged Value")
 TURF_TRACE_DEFINE("[Mutator::exchangeValue] detected race to write value")
 TURF_TRACE_DEFINE("[Mutator::exchangeValue] racing write inserted new value")
 TURF_TRACE_DEFINE("[Mutator::exchangeValue] was redirected")
-TURF_TRACE_DEFINE("[Mutator::exchangeValue] was re-redirected")
-TURF_TRACE_DEFINE("[Mutator::exchangeValue] overflow after redirect")
+TURF_TRACE_DEFINE("[Mutator::compareExchangeValue] called")
 TURF_TRACE_DEFINE("[Mutator::eraseValue] called")
 TURF_TRACE_DEFINE("[Mutator::eraseValue] detected race to write value")
 TURF_TRACE_DEFINE("[Mutator::eraseValue] was redirected")
 TURF_TRACE_DEFINE("[Mutator::eraseValue] was re-redirected")
+TURF_TRACE_DEFINE("[Mutator::eraseIfEquals] called")
+TURF_TRACE_DEFINE("[Mutator::eraseIfEquals] was redirected")
 TURF_TRACE_DEFINE("[get] called")
 TURF_TRACE_DEFINE("[get] was redirected")
-TURF_TRACE_DEFINE_END(ConcurrentMap_Linear, 17)
+TURF_TRACE_DEFINE_END(ConcurrentMap_Linear, 21)
 
 } // namespace junction
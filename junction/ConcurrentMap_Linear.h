@@ -16,12 +16,13 @@
 #include <junction/Core.h>
 #include <junction/details/Linear.h>
 #include <junction/QSBR.h>
+#include <junction/OperationCounters.h>
 #include <turf/Heap.h>
 #include <turf/Trace.h>
 
 namespace junction {
 
-TURF_TRACE_DECLARE(ConcurrentMap_Linear, 17)
+TURF_TRACE_DECLARE(ConcurrentMap_Linear, 21)
 
 template <typename K, typename V, class KT = DefaultKeyTraits<K>, class VT = DefaultValueTraits<V> >
 class ConcurrentMap_Linear {
@@ -34,10 +35,15 @@ public:
     typedef details::Linear<ConcurrentMap_Linear> Details;
 
 private:
+    striped::ConditionBank* m_conditionBank;
     turf::Atomic<typename Details::Table*> m_root;
+    MigrationObserver* m_migrationObserver;
 
 public:
-    ConcurrentMap_Linear(ureg capacity = Details::InitialSize) : m_root(Details::Table::create(capacity)) {
+    // Pass a conditionBank to keep this map's waiting threads off DefaultConditionBank, which is shared with every
+    // other map in the process. The bank must outlive the map.
+    ConcurrentMap_Linear(ureg capacity = Details::InitialSize, striped::ConditionBank* conditionBank = NULL)
+        : m_conditionBank(conditionBank), m_root(Details::Table::create(capacity, conditionBank)), m_migrationObserver(NULL) {
     }
 
     ~ConcurrentMap_Linear() {
@@ -45,6 +51,20 @@ public:
         table->destroy();
     }
 
+    // Threads waiting on this map's migrations block on ConditionPairs from this bank.
+    striped::ConditionBank* getConditionBank() const {
+        return m_conditionBank;
+    }
+
+    // Must be called before the map is shared with other threads.
+    void setMigrationObserver(MigrationObserver* observer) {
+        m_migrationObserver = observer;
+    }
+
+    MigrationObserver* getMigrationObserver() const {
+        return m_migrationObserver;
+    }
+
     // publishTableMigration() is called by exactly one thread from Details::TableMigration::run()
     // after all the threads participating in the migration have completed their work.
     void publishTableMigration(typename Details::TableMigration* migration) {
@@ -55,6 +75,13 @@ public:
         // Caller will GC the TableMigration and the source table.
     }
 
+    // Returns statistics for the whole table, or for sampleSize consecutive buckets. See MapStats.
+    MapStats collectStats(ureg sampleSize = 0) {
+        MapStats stats;
+        Details::collectTableStats(m_root.load(turf::Consume), sampleSize, stats);
+        return stats;
+    }
+
     // A Mutator represents a known cell in the hash table.
     // It's meant for manipulations within a temporary function scope.
     // Obviously you must not call QSBR::Update while holding a Mutator.
@@ -73,9 +100,8 @@ public:
         Value m_value;
 
         // Constructor: Find existing cell
-        Mutator(ConcurrentMap_Linear& map, Key key, bool) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
-            TURF_TRACE(ConcurrentMap_Linear, 0, "[Mutator] find constructor called", uptr(0), uptr(key));
-            Hash hash = KeyTraits::hash(key);
+        Mutator(ConcurrentMap_Linear& map, Hash hash, bool) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
+            TURF_TRACE(ConcurrentMap_Linear, 0, "[Mutator] find constructor called", uptr(0), uptr(hash));
             for (;;) {
                 m_table = m_map.m_root.load(turf::Consume);
                 m_cell = Details::find(hash, m_table);
@@ -89,15 +115,15 @@ public:
                 }
                 // We've encountered a Redirect value. Help finish the migration.
                 TURF_TRACE(ConcurrentMap_Linear, 1, "[Mutator] find was redirected", uptr(m_table), 0);
+                details::countRedirectFollowed();
                 m_table->jobCoordinator.participate();
                 // Try again using the latest root.
             }
         }
 
         // Constructor: Insert cell
-        Mutator(ConcurrentMap_Linear& map, Key key) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
-            TURF_TRACE(ConcurrentMap_Linear, 2, "[Mutator] insertOrFind constructor called", uptr(0), uptr(key));
-            Hash hash = KeyTraits::hash(key);
+        Mutator(ConcurrentMap_Linear& map, Hash hash) : m_map(map), m_value(Value(ValueTraits::NullValue)) {
+            TURF_TRACE(ConcurrentMap_Linear, 2, "[Mutator] insertOrFind constructor called", uptr(0), uptr(hash));
             bool mustDouble = false;
             for (;;) {
                 m_table = m_map.m_root.load(turf::Consume);
@@ -112,6 +138,7 @@ public:
                     if (value == Value(ValueTraits::Redirect)) {
                         // We've encountered a Redirect value.
                         TURF_TRACE(ConcurrentMap_Linear, 3, "[Mutator] insertOrFind was redirected", uptr(m_table), uptr(m_value));
+                        details::countRedirectFollowed();
                         break; // Help finish the migration.
                     }
                     // Found an existing value
@@ -131,6 +158,43 @@ public:
             }
         }
 
+        // Called after a CAS on m_cell encountered a Redirect value.
+        // Helps finish the migration, then locates the same hash in the latest table, inserting it if necessary.
+        // On return, m_cell is valid and m_value holds its latest value, which is never Redirect.
+        void followRedirect() {
+            TURF_TRACE(ConcurrentMap_Linear, 4, "[Mutator::followRedirect] called", uptr(m_table), uptr(m_cell));
+            details::countRedirectFollowed();
+            Hash hash = m_cell->hash.load(turf::Relaxed);
+            bool mustDouble = false;
+            for (;;) {
+                // Help complete the migration.
+                m_table->jobCoordinator.participate();
+                // Try again in the new table.
+                m_table = m_map.m_root.load(turf::Consume);
+                m_value = Value(ValueTraits::NullValue);
+                switch (Details::insertOrFind(hash, m_table, m_cell)) { // Modifies m_cell
+                case Details::InsertResult_AlreadyFound:
+                    m_value = m_cell->value.load(turf::Consume);
+                    if (m_value == Value(ValueTraits::Redirect)) {
+                        TURF_TRACE(ConcurrentMap_Linear, 5, "[Mutator::followRedirect] was re-redirected", uptr(m_table),
+                                   uptr(m_value));
+                        details::countRedirectFollowed();
+                        break;
+                    }
+                    return;
+                case Details::InsertResult_InsertedNew:
+                    return;
+                case Details::InsertResult_Overflow:
+                    TURF_TRACE(ConcurrentMap_Linear, 6, "[Mutator::followRedirect] overflow after redirect", uptr(m_table), 0);
+                    Details::beginTableMigration(m_map, m_table, mustDouble);
+                    break;
+                }
+                // If we still overflow after this, avoid an infinite loop by forcing the next table to double.
+                mustDouble = true;
+                // We were redirected... again
+            }
+        }
+
     public:
         Value getValue() const {
             // Return previously loaded value. Don't load it again.
@@ -141,60 +205,31 @@ public:
             TURF_ASSERT(desired != Value(ValueTraits::NullValue));
             TURF_ASSERT(desired != Value(ValueTraits::Redirect));
             TURF_ASSERT(m_cell); // Cell must have been found or inserted
-            TURF_TRACE(ConcurrentMap_Linear, 4, "[Mutator::exchangeValue] called", uptr(m_table), uptr(m_value));
-            bool mustDouble = false;
+            TURF_TRACE(ConcurrentMap_Linear, 7, "[Mutator::exchangeValue] called", uptr(m_table), uptr(m_value));
             for (;;) {
                 Value oldValue = m_value;
                 if (m_cell->value.compareExchangeStrong(m_value, desired, turf::ConsumeRelease)) {
                     // Exchange was successful. Return previous value.
-                    TURF_TRACE(ConcurrentMap_Linear, 5, "[Mutator::exchangeValue] exchanged Value", uptr(m_value), uptr(desired));
+                    TURF_TRACE(ConcurrentMap_Linear, 8, "[Mutator::exchangeValue] exchanged Value", uptr(m_value), uptr(desired));
                     Value result = m_value;
                     m_value = desired; // Leave the mutator in a valid state
                     return result;
                 }
                 // The CAS failed and m_value has been updated with the latest value.
                 if (m_value != Value(ValueTraits::Redirect)) {
-                    TURF_TRACE(ConcurrentMap_Linear, 6, "[Mutator::exchangeValue] detected race to write value", uptr(m_table),
+                    TURF_TRACE(ConcurrentMap_Linear, 9, "[Mutator::exchangeValue] detected race to write value", uptr(m_table),
                                uptr(m_value));
                     if (oldValue == Value(ValueTraits::NullValue) && m_value != Value(ValueTraits::NullValue)) {
-                        TURF_TRACE(ConcurrentMap_Linear, 7, "[Mutator::exchangeValue] racing write inserted new value",
+                        TURF_TRACE(ConcurrentMap_Linear, 10, "[Mutator::exchangeValue] racing write inserted new value",
                                    uptr(m_table), uptr(m_value));
                     }
                     // There was a racing write (or erase) to this cell.
                     // Pretend we exchanged with ourselves, and just let the racing write win.
                     return desired;
                 }
-                // We've encountered a Redirect value. Help finish the migration.
-                TURF_TRACE(ConcurrentMap_Linear, 8, "[Mutator::exchangeValue] was redirected", uptr(m_table), uptr(m_value));
-                Hash hash = m_cell->hash.load(turf::Relaxed);
-                for (;;) {
-                    // Help complete the migration.
-                    m_table->jobCoordinator.participate();
-                    // Try again in the new table.
-                    m_table = m_map.m_root.load(turf::Consume);
-                    m_value = Value(ValueTraits::NullValue);
-                    switch (Details::insertOrFind(hash, m_table, m_cell)) { // Modifies m_cell
-                    case Details::InsertResult_AlreadyFound:
-                        m_value = m_cell->value.load(turf::Consume);
-                        if (m_value == Value(ValueTraits::Redirect)) {
-                            TURF_TRACE(ConcurrentMap_Linear, 9, "[Mutator::exchangeValue] was re-redirected", uptr(m_table),
-                                       uptr(m_value));
-                            break;
-                        }
-                        goto breakOuter;
-                    case Details::InsertResult_InsertedNew:
-                        goto breakOuter;
-                    case Details::InsertResult_Overflow:
-                        TURF_TRACE(ConcurrentMap_Linear, 10, "[Mutator::exchangeValue] overflow after redirect", uptr(m_table), 0);
-                        Details::beginTableMigration(m_map, m_table, mustDouble);
-                        break;
-                    }
-                    // If we still overflow after this, avoid an infinite loop by forcing the next table to double.
-                    mustDouble = true;
-                    // We were redirected... again
-                }
-            breakOuter:;
-                // Try again in the new table.
+                // We've encountered a Redirect value. Help finish the migration, then try again in the new table.
+                TURF_TRACE(ConcurrentMap_Linear, 11, "[Mutator::exchangeValue] was redirected", uptr(m_table), uptr(m_value));
+                followRedirect();
             }
         }
 
@@ -202,9 +237,33 @@ public:
             exchangeValue(desired);
         }
 
+        // Stores desired only if the current value equals expected, and returns the value that was observed.
+        // The exchange took place if and only if the return value equals expected.
+        // Unlike exchangeValue(), a racing write is never ignored; it's reported to the caller instead.
+        Value compareExchangeValue(Value expected, Value desired) {
+            TURF_ASSERT(expected != Value(ValueTraits::Redirect));
+            TURF_ASSERT(desired != Value(ValueTraits::Redirect));
+            TURF_ASSERT(m_cell); // Cell must have been found or inserted
+            TURF_TRACE(ConcurrentMap_Linear, 12, "[Mutator::compareExchangeValue] called", uptr(m_table), uptr(expected));
+            for (;;) {
+                m_value = expected;
+                if (m_cell->value.compareExchangeStrong(m_value, desired, turf::ConsumeRelease)) {
+                    m_value = desired; // Leave the mutator in a valid state
+                    return expected;
+                }
+                // The CAS failed and m_value has been updated with the latest value.
+                if (m_value != Value(ValueTraits::Redirect))
+                    return m_value;
+                // We've encountered a Redirect value. Retry the CAS in the new table.
+                followRedirect();
+                if (m_value != expected)
+                    return m_value;
+            }
+        }
+
         Value eraseValue() {
             TURF_ASSERT(m_cell); // Cell must have been found or inserted
-            TURF_TRACE(ConcurrentMap_Linear, 11, "[Mutator::eraseValue] called", uptr(m_table), m_cell - m_table->getCells());
+            TURF_TRACE(ConcurrentMap_Linear, 13, "[Mutator::eraseValue] called", uptr(m_table), m_cell - m_table->getCells());
             for (;;) {
                 if (m_value == Value(ValueTraits::NullValue))
                     return Value(m_value);
@@ -217,7 +276,7 @@ public:
                     return result;
                 }
                 // The CAS failed and m_value has been updated with the latest value.
-                TURF_TRACE(ConcurrentMap_Linear, 12, "[Mutator::eraseValue] detected race to write value", uptr(m_table),
+                TURF_TRACE(ConcurrentMap_Linear, 14, "[Mutator::eraseValue] detected race to write value", uptr(m_table),
                            m_cell - m_table->getCells());
                 if (m_value != Value(ValueTraits::Redirect)) {
                     // There was a racing write (or erase) to this cell.
@@ -225,11 +284,12 @@ public:
                     return Value(ValueTraits::NullValue);
                 }
                 // We've been redirected to a new table.
-                TURF_TRACE(ConcurrentMap_Linear, 13, "[Mutator::eraseValue] was redirected", uptr(m_table),
+                TURF_TRACE(ConcurrentMap_Linear, 15, "[Mutator::eraseValue] was redirected", uptr(m_table),
                            m_cell - m_table->getCells());
                 Hash hash = m_cell->hash.load(turf::Relaxed); // Re-fetch hash
                 for (;;) {
                     // Help complete the migration.
+                    details::countRedirectFollowed();
                     m_table->jobCoordinator.participate();
                     // Try again in the new table.
                     m_table = m_map.m_root.load(turf::Consume);
@@ -241,25 +301,84 @@ public:
                     m_value = m_cell->value.load(turf::Relaxed);
                     if (m_value != Value(ValueTraits::Redirect))
                         break;
-                    TURF_TRACE(ConcurrentMap_Linear, 14, "[Mutator::eraseValue] was re-redirected", uptr(m_table),
+                    TURF_TRACE(ConcurrentMap_Linear, 16, "[Mutator::eraseValue] was re-redirected", uptr(m_table),
                                m_cell - m_table->getCells());
                 }
             }
         }
+
+        // Erases the value only if it currently equals expected. Returns true if this call erased it.
+        // If the cell is redirected by a migration, the comparison is retried in the new table.
+        bool eraseIfEquals(Value expected) {
+            TURF_ASSERT(expected != Value(ValueTraits::NullValue));
+            TURF_ASSERT(expected != Value(ValueTraits::Redirect));
+            TURF_TRACE(ConcurrentMap_Linear, 17, "[Mutator::eraseIfEquals] called", uptr(m_table), uptr(expected));
+            if (!m_cell)
+                return false; // The key was not found.
+            for (;;) {
+                m_value = expected;
+                if (m_cell->value.compareExchangeStrong(m_value, Value(ValueTraits::NullValue), turf::Consume)) {
+                    m_value = Value(ValueTraits::NullValue); // Leave the mutator in a valid state
+                    return true;
+                }
+                // The CAS failed and m_value has been updated with the latest value.
+                if (m_value != Value(ValueTraits::Redirect))
+                    return false;
+                // We've been redirected to a new table. Retry the comparison there.
+                TURF_TRACE(ConcurrentMap_Linear, 18, "[Mutator::eraseIfEquals] was redirected", uptr(m_table), uptr(m_cell));
+                // Unlike followRedirect(), only look the key up, since an erase must never insert it.
+                Hash hash = m_cell->hash.load(turf::Relaxed);
+                for (;;) {
+                    // Help complete the migration.
+                    details::countRedirectFollowed();
+                    m_table->jobCoordinator.participate();
+                    // Try again in the new table.
+                    m_table = m_map.m_root.load(turf::Consume);
+                    m_cell = Details::find(hash, m_table);
+                    if (!m_cell) {
+                        m_value = Value(ValueTraits::NullValue);
+                        return false;
+                    }
+                    m_value = m_cell->value.load(turf::Relaxed);
+                    if (m_value != Value(ValueTraits::Redirect))
+                        break;
+                }
+                if (m_value != expected)
+                    return false;
+            }
+        }
     };
 
     Mutator insertOrFind(Key key) {
-        return Mutator(*this, key);
+        details::OperationScope scope(OperationCounters::Insert);
+        return Mutator(*this, KeyTraits::hash(key));
     }
 
     Mutator find(Key key) {
-        return Mutator(*this, key, false);
+        details::OperationScope scope(OperationCounters::Get);
+        return Mutator(*this, KeyTraits::hash(key), false);
+    }
+
+    // The ByHash variants take a precomputed hash, so that a caller probing several maps hashes the key once.
+    // Since the hash function is invertible, the hash identifies the key completely.
+    Mutator insertOrFindByHash(Hash hash) {
+        details::OperationScope scope(OperationCounters::Insert);
+        return Mutator(*this, hash);
+    }
+
+    Mutator findByHash(Hash hash) {
+        details::OperationScope scope(OperationCounters::Get);
+        return Mutator(*this, hash, false);
     }
 
     // Lookup without creating a temporary Mutator.
     Value get(Key key) {
-        Hash hash = KeyTraits::hash(key);
-        TURF_TRACE(ConcurrentMap_Linear, 15, "[get] called", uptr(this), uptr(hash));
+        return getByHash(KeyTraits::hash(key));
+    }
+
+    Value getByHash(Hash hash) {
+        details::OperationScope scope(OperationCounters::Get);
+        TURF_TRACE(ConcurrentMap_Linear, 19, "[get] called", uptr(this), uptr(hash));
         for (;;) {
             typename Details::Table* table = m_root.load(turf::Consume);
             typename Details::Cell* cell = Details::find(hash, table);
@@ -269,27 +388,51 @@ public:
             if (value != Value(ValueTraits::Redirect))
                 return value; // Found an existing value
             // We've been redirected to a new table. Help with the migration.
-            TURF_TRACE(ConcurrentMap_Linear, 16, "[get] was redirected", uptr(table), uptr(cell));
+            TURF_TRACE(ConcurrentMap_Linear, 20, "[get] was redirected", uptr(table), uptr(cell));
+            details::countRedirectFollowed();
             table->jobCoordinator.participate();
             // Try again in the new table.
         }
     }
 
     Value assign(Key key, Value desired) {
-        Mutator iter(*this, key);
+        details::OperationScope scope(OperationCounters::Insert);
+        Mutator iter(*this, KeyTraits::hash(key));
         return iter.exchangeValue(desired);
     }
 
     Value exchange(Key key, Value desired) {
-        Mutator iter(*this, key);
+        details::OperationScope scope(OperationCounters::Insert);
+        Mutator iter(*this, KeyTraits::hash(key));
         return iter.exchangeValue(desired);
     }
 
     Value erase(Key key) {
-        Mutator iter(*this, key, false);
+        details::OperationScope scope(OperationCounters::Erase);
+        Mutator iter(*this, KeyTraits::hash(key), false);
         return iter.eraseValue();
     }
 
+    // Stores desired only if the value associated with key equals expected. Returns the value that was observed.
+    // Pass NullValue as expected to insert only if the key is absent.
+    Value compareExchange(Key key, Value expected, Value desired) {
+        details::OperationScope scope(OperationCounters::Insert);
+        if (expected == Value(ValueTraits::NullValue)) {
+            Mutator iter(*this, KeyTraits::hash(key));
+            return iter.compareExchangeValue(expected, desired);
+        }
+        Mutator iter(*this, KeyTraits::hash(key), false);
+        if (!iter.m_cell)
+            return Value(ValueTraits::NullValue);
+        return iter.compareExchangeValue(expected, desired);
+    }
+
+    bool eraseIfEquals(Key key, Value expected) {
+        details::OperationScope scope(OperationCounters::Erase);
+        Mutator iter(*this, KeyTraits::hash(key), false);
+        return iter.eraseIfEquals(expected);
+    }
+
     // The easiest way to implement an Iterator is to prevent all Redirects.
     // The currrent Iterator does that by forbidding concurrent inserts.
     // To make it work with concurrent inserts, we'd need a way to block TableMigrations.
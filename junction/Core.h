@@ -20,6 +20,33 @@
 #ifndef JUNCTION_USE_STRIPING
 #define JUNCTION_USE_STRIPING 1
 #endif
+#ifndef JUNCTION_CONDITIONBANK_SIZE
+#define JUNCTION_CONDITIONBANK_SIZE 1024
+#endif
+#ifndef JUNCTION_USE_FUTEX
+#if defined(__linux__)
+#define JUNCTION_USE_FUTEX 1
+#else
+#define JUNCTION_USE_FUTEX 0
+#endif
+#endif
+#ifndef JUNCTION_USE_MMAP
+#if defined(__unix__) || defined(__APPLE__)
+#define JUNCTION_USE_MMAP 1
+#else
+#define JUNCTION_USE_MMAP 0
+#endif
+#endif
+#ifndef JUNCTION_USE_THREAD_CPU_TIME
+#if defined(__unix__) || defined(__APPLE__)
+#define JUNCTION_USE_THREAD_CPU_TIME 1
+#else
+#define JUNCTION_USE_THREAD_CPU_TIME 0
+#endif
+#endif
+#ifndef JUNCTION_TRACK_OPERATION_COUNTERS
+#define JUNCTION_TRACK_OPERATION_COUNTERS 0
+#endif
 //-----------------------------------------------
 
 #include <turf/Core.h>
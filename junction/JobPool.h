@@ -0,0 +1,111 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+
+#ifndef JUNCTION_JOBPOOL_H
+#define JUNCTION_JOBPOOL_H
+
+#include <junction/Core.h>
+
+namespace junction {
+
+// A lock-free set of jobs that are running at the same time, such as the leaf migrations of a ConcurrentMap_Grampa.
+// Each job is still posted to its own SimpleJobCoordinator; the pool just lets threads that would otherwise wait for
+// one job to finish steal work from the others.
+//
+// Jobs follow the same rules as in SimpleJobCoordinator: any number of threads can call run() at any time until the
+// job is garbage collected through QSBR, and run() returns once there's no more work left to claim. A job must be
+// retired from the pool before it's enqueued for garbage collection.
+class JobPool {
+public:
+    struct Job {
+        virtual ~Job() {
+        }
+        virtual void run() = 0;
+    };
+
+    // If the pool is full, post() fails and the job only gets help from threads that hit it directly.
+    static const ureg NumSlots = 64;
+
+    // Marks the calling thread as running a job for the lifetime of this object. help() does nothing while the
+    // calling thread is inside a job. A job can wait on something that only its own thread will complete later,
+    // such as the isPublished event of a Grampa table in the middle of being published. Stealing another job that
+    // waits on the same thing would deadlock.
+    class RunScope {
+    public:
+        RunScope() {
+            runDepth()++;
+        }
+        ~RunScope() {
+            runDepth()--;
+        }
+    };
+
+private:
+    turf::Atomic<Job*> m_slots[NumSlots];
+
+    static ureg& runDepth() {
+        // Constant-initialized, so access needs no guard.
+        static thread_local ureg depth = 0;
+        return depth;
+    }
+
+public:
+    JobPool() {
+        for (ureg i = 0; i < NumSlots; i++)
+            m_slots[i].storeNonatomic(NULL);
+    }
+
+    ~JobPool() {
+        for (ureg i = 0; i < NumSlots; i++)
+            TURF_ASSERT(m_slots[i].loadNonatomic() == NULL);
+    }
+
+    bool post(Job* job) {
+        for (ureg i = 0; i < NumSlots; i++) {
+            Job* expected = NULL;
+            if (m_slots[i].compareExchangeStrong(expected, job, turf::Release))
+                return true;
+        }
+        return false;
+    }
+
+    // Must not race with the post() of the same job. Does nothing if the job was never posted.
+    void retire(Job* job) {
+        for (ureg i = 0; i < NumSlots; i++) {
+            Job* expected = job;
+            if (m_slots[i].compareExchangeStrong(expected, NULL, turf::Relaxed))
+                return;
+        }
+    }
+
+    // Runs every job in the pool once. Returns false, without running anything, if the calling thread is already
+    // inside a job or the pool is empty.
+    bool help() {
+        if (runDepth() > 0)
+            return false;
+        bool ranAny = false;
+        for (ureg i = 0; i < NumSlots; i++) {
+            Job* job = m_slots[i].load(turf::Consume);
+            if (job) {
+                RunScope scope;
+                job->run();
+                ranAny = true;
+            }
+        }
+        return ranAny;
+    }
+};
+
+} // namespace junction
+
+#endif // JUNCTION_JOBPOOL_H
@@ -0,0 +1,81 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_MAPSTATS_H
+#define JUNCTION_MAPSTATS_H
+
+#include <junction/Core.h>
+#include <turf/CPUTimer.h>
+#include <turf/Util.h>
+
+namespace junction {
+
+// Returned by collectStats() on every map type.
+//
+// collectStats() scans the whole table, or when given a sample size, that many consecutive buckets starting at a
+// random bucket. Counts and the probe histogram cover the scanned cells only; the capacity and memory figures always
+// describe the whole map. The concurrent maps can be scanned while other threads modify them. The results are then
+// approximate, and the calling thread must not pass through a quiescent state during the call, as with any other
+// map operation.
+struct MapStats {
+    static const ureg NumProbeBuckets = 16;
+
+    ureg numTables;      // More than one only in ConcurrentMap_Grampa
+    ureg capacity;       // Total cells, across all tables
+    ureg bytesUsed;      // Memory held by the tables (and Grampa's flattree)
+    ureg numCellsScanned;
+    ureg numCellsInUse;  // Hash set and value live
+    ureg numTombstones;  // Hash set and value null: erased entries that stay until the next migration
+    // probeHistogram[n] counts live cells reached after n probes from their hashed cell.
+    // The last bucket also counts everything longer.
+    ureg probeHistogram[NumProbeBuckets];
+
+    MapStats() {
+        clear();
+    }
+
+    void clear() {
+        numTables = 0;
+        capacity = 0;
+        bytesUsed = 0;
+        numCellsScanned = 0;
+        numCellsInUse = 0;
+        numTombstones = 0;
+        for (ureg i = 0; i < NumProbeBuckets; i++)
+            probeHistogram[i] = 0;
+    }
+
+    void addProbe(ureg probeLength) {
+        probeHistogram[probeLength < NumProbeBuckets ? probeLength : NumProbeBuckets - 1]++;
+    }
+
+    float getLoadFactor() const {
+        return numCellsScanned ? float(numCellsInUse) / numCellsScanned : 0.f;
+    }
+
+    float getTombstoneRatio() const {
+        return numCellsScanned ? float(numTombstones) / numCellsScanned : 0.f;
+    }
+
+    // Returns the bucket at which to start scanning a table, and clamps sampleSize to the table size.
+    static ureg chooseSampleStart(ureg& sampleSize, ureg sizeMask) {
+        if (sampleSize == 0 || sampleSize > sizeMask) {
+            sampleSize = sizeMask + 1;
+            return 0;
+        }
+        return turf::util::avalanche(u32(turf::CPUTimer::get())) & sizeMask;
+    }
+};
+
+} // namespace junction
+
+#endif // JUNCTION_MAPSTATS_H
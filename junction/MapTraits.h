@@ -40,6 +40,21 @@ struct DefaultValueTraits {
     static const IntType Redirect = 1;
 };
 
+// Tuning constants for ConcurrentMap_Leapfrog and ConcurrentMap_Grampa.
+// To change some of them, derive a struct from this one, redeclare those constants, and pass it as the map's
+// last template argument. CellsInUseSample must not exceed LinearSearchLimit.
+struct DefaultTuningTraits {
+    static const ureg InitialSize = 8;
+    static const ureg TableMigrationUnitSize = 32;
+    static const ureg MaxMigrationUnitsPerClaim = 16; // Upper bound when workers claim several units at once
+    static const ureg LinearSearchLimit = 128; // Must be less than 256
+    static const ureg CellsInUseSample = 128;
+    static const ureg ChurnSizeFactor = 4; // New table size over live cells, when erased cells caused the migration
+    // Grampa only:
+    static const ureg FlatTreeNodeBits = 8; // Each flattree node splits its range into (1 << FlatTreeNodeBits) entries
+    static const ureg LeafSizeBits = 10;
+};
+
 } // namespace junction
 
 #endif // JUNCTION_MAPTRAITS_H
@@ -0,0 +1,132 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_MIGRATIONOBSERVER_H
+#define JUNCTION_MIGRATIONOBSERVER_H
+
+#include <junction/Core.h>
+#include <turf/Atomic.h>
+#include <turf/CPUTimer.h>
+
+#if JUNCTION_USE_THREAD_CPU_TIME
+#include <time.h>
+#endif
+
+namespace junction {
+
+// Receives an event whenever a concurrent map starts, retries or publishes a migration.
+// Install one with setMigrationObserver() on ConcurrentMap_Linear, ConcurrentMap_Leapfrog or ConcurrentMap_Grampa.
+// Maps without an observer skip all of the timing and counting below, so there's no cost when it's unused.
+//
+// onMigrationEvent() is called from whichever thread triggered the event, sometimes while that thread holds a
+// lock on the source table. Keep it short; record the event and return.
+class MigrationObserver {
+public:
+    enum EventType {
+        TableMigrationBegin,  // A TableMigration was created. Only the sizes are filled in.
+        TableMigrationRetry,  // A destination table overflowed. A larger TableMigration replaces this one.
+        TableMigrationPublish // A TableMigration completed and its destination tables were published.
+    };
+
+    struct Event {
+        EventType type;
+        ureg sourceSize;      // Total cells in the source tables
+        ureg destinationSize; // Total cells in the destination tables
+        ureg numParticipants; // The most threads that were running the migration at once
+        ureg unitsMigrated;   // Migration units completed
+        double wallSeconds;   // From the creation of the migration until this event
+        double workerSeconds; // Wall-clock time each thread spent inside the migration, summed over the threads. It
+                              // includes time a thread was descheduled.
+        double cpuSeconds;    // CPU time each thread spent inside the migration, summed over the threads, or -1 if
+                              // JUNCTION_USE_THREAD_CPU_TIME is off.
+    };
+
+    virtual ~MigrationObserver() {
+    }
+    virtual void onMigrationEvent(const Event& event) = 0;
+};
+
+namespace details {
+
+// Timing and participation for one TableMigration.
+// Only updated when the map has a MigrationObserver.
+struct MigrationProgress {
+    // Where one thread's share of the work began.
+    struct WorkStart {
+        turf::CPUTimer::Point time;
+        u64 cpuNanos;
+
+        WorkStart() : time(0), cpuNanos(0) {
+        }
+    };
+
+    turf::CPUTimer::Point startTime;
+    turf::Atomic<u64> workerTicks;
+    turf::Atomic<u64> workerCPUNanos;
+    turf::Atomic<ureg> maxWorkers;
+
+    // Returns the CPU time used by the calling thread so far, or 0 if JUNCTION_USE_THREAD_CPU_TIME is off.
+    static u64 getThreadCPUNanos() {
+#if JUNCTION_USE_THREAD_CPU_TIME
+        struct timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+            return u64(ts.tv_sec) * 1000000000u + u64(ts.tv_nsec);
+#endif
+        return 0;
+    }
+
+    void init(MigrationObserver* observer) {
+        startTime = observer ? turf::CPUTimer::get() : 0;
+        workerTicks.storeNonatomic(0);
+        workerCPUNanos.storeNonatomic(0);
+        maxWorkers.storeNonatomic(0);
+    }
+
+    // Called by each participating thread after it has incremented the worker count.
+    WorkStart beginWork(ureg numWorkers) {
+        ureg prevMax = maxWorkers.load(turf::Relaxed);
+        while (numWorkers > prevMax) {
+            if (maxWorkers.compareExchangeWeak(prevMax, numWorkers, turf::Relaxed, turf::Relaxed))
+                break;
+        }
+        WorkStart begin;
+        begin.time = turf::CPUTimer::get();
+        begin.cpuNanos = getThreadCPUNanos();
+        return begin;
+    }
+
+    // Must be called before the worker count is decremented, so that the last worker sees the total.
+    void endWork(const WorkStart& begin) {
+        workerTicks.fetchAdd(u64(turf::CPUTimer::get() - begin.time), turf::Relaxed);
+        workerCPUNanos.fetchAdd(getThreadCPUNanos() - begin.cpuNanos, turf::Relaxed);
+    }
+
+    void notify(MigrationObserver* observer, MigrationObserver::EventType type, ureg sourceSize, ureg destinationSize,
+                ureg unitsMigrated) const {
+        turf::CPUTimer::Converter converter;
+        MigrationObserver::Event event;
+        event.type = type;
+        event.sourceSize = sourceSize;
+        event.destinationSize = destinationSize;
+        event.numParticipants = maxWorkers.load(turf::Relaxed);
+        event.unitsMigrated = unitsMigrated;
+        event.wallSeconds = converter.toSeconds(turf::CPUTimer::Duration(turf::CPUTimer::get() - startTime));
+        event.workerSeconds = converter.toSeconds(turf::CPUTimer::Duration(workerTicks.load(turf::Relaxed)));
+        event.cpuSeconds = JUNCTION_USE_THREAD_CPU_TIME ? double(workerCPUNanos.load(turf::Relaxed)) * 1e-9 : -1.0;
+        observer->onMigrationEvent(event);
+    }
+};
+
+} // namespace details
+} // namespace junction
+
+#endif // JUNCTION_MIGRATIONOBSERVER_H
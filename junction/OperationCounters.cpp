@@ -0,0 +1,111 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+
+#include <junction/OperationCounters.h>
+#include <turf/Heap.h>
+#include <new>
+
+namespace junction {
+
+turf::Atomic<ureg> OperationCounters::s_samplePeriod(OperationCounters::DefaultSamplePeriod);
+
+#if JUNCTION_TRACK_OPERATION_COUNTERS
+turf::Atomic<OperationCounters::Slot*> OperationCounters::s_slotList(NULL);
+
+namespace {
+
+const ureg CacheLineSize = 64;
+
+// Set once the thread has given its Slot back. Constant-initialized and trivially destructible, so it stays valid
+// while the thread's other thread_local objects are destroyed.
+thread_local bool threadSlotReleased = false;
+
+} // namespace
+
+// Hands the thread's Slot back when the thread exits, so that a later thread can reuse it.
+struct OperationCounters::SlotReleaser {
+    Slot* slot;
+    SlotReleaser() : slot(NULL) {
+    }
+    ~SlotReleaser() {
+        if (slot) {
+            // Forget the Slot before another thread can claim it, and don't acquire a new one.
+            threadSlot() = NULL;
+            threadSlotReleased = true;
+            slot->inUse.store(0, turf::Release);
+        }
+    }
+};
+
+OperationCounters::Slot* OperationCounters::acquireSlot() {
+    if (threadSlotReleased)
+        return NULL;
+    Slot* slot = NULL;
+    // Reuse a Slot left behind by a thread that has exited.
+    for (Slot* s = s_slotList.load(turf::Acquire); s; s = s->next) {
+        if (s->inUse.load(turf::Relaxed) == 0 && s->inUse.compareExchange(0, 1, turf::Acquire) == 0) {
+            slot = s;
+            break;
+        }
+    }
+    if (!slot) {
+        // Give each Slot its own cache lines. Slots are never freed.
+        uptr raw = uptr(TURF_HEAP.alloc(sizeof(Slot) + 2 * CacheLineSize));
+        slot = new ((void*) ((raw + CacheLineSize) & ~uptr(CacheLineSize - 1))) Slot;
+        for (ureg op = 0; op < NumOperations; op++) {
+            slot->numOperations[op].storeNonatomic(0);
+            for (ureg b = 0; b < NumLatencyBuckets; b++)
+                slot->latencyHistogram[op][b].storeNonatomic(0);
+        }
+        slot->numRedirectsFollowed.storeNonatomic(0);
+        slot->numMigrationJobsRun.storeNonatomic(0);
+        slot->blockedTicks.storeNonatomic(0);
+        slot->inUse.storeNonatomic(1);
+        Slot* head = s_slotList.load(turf::Relaxed);
+        do {
+            slot->next = head;
+        } while (!s_slotList.compareExchangeWeak(head, slot, turf::Release, turf::Relaxed));
+    }
+    ureg period = getSamplePeriod();
+    slot->sampleCountdown = period ? period : DefaultSamplePeriod;
+    static thread_local SlotReleaser releaser;
+    releaser.slot = slot;
+    return slot;
+}
+
+#endif
+
+void OperationCounters::collect(Totals& totals) {
+    for (ureg op = 0; op < NumOperations; op++) {
+        totals.numOperations[op] = 0;
+        for (ureg b = 0; b < NumLatencyBuckets; b++)
+            totals.latencyHistogram[op][b] = 0;
+    }
+    totals.numRedirectsFollowed = 0;
+    totals.numMigrationJobsRun = 0;
+    totals.blockedTicks = 0;
+#if JUNCTION_TRACK_OPERATION_COUNTERS
+    for (Slot* s = s_slotList.load(turf::Acquire); s; s = s->next) {
+        for (ureg op = 0; op < NumOperations; op++) {
+            totals.numOperations[op] += s->numOperations[op].load(turf::Relaxed);
+            for (ureg b = 0; b < NumLatencyBuckets; b++)
+                totals.latencyHistogram[op][b] += s->latencyHistogram[op][b].load(turf::Relaxed);
+        }
+        totals.numRedirectsFollowed += s->numRedirectsFollowed.load(turf::Relaxed);
+        totals.numMigrationJobsRun += s->numMigrationJobsRun.load(turf::Relaxed);
+        totals.blockedTicks += s->blockedTicks.load(turf::Relaxed);
+    }
+#endif
+}
+
+} // namespace junction
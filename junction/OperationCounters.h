@@ -0,0 +1,195 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+
+#ifndef JUNCTION_OPERATIONCOUNTERS_H
+#define JUNCTION_OPERATIONCOUNTERS_H
+
+#include <junction/Core.h>
+#include <turf/Atomic.h>
+#include <turf/CPUTimer.h>
+
+namespace junction {
+
+// Process-wide counts of operations on ConcurrentMap_Linear, ConcurrentMap_Leapfrog and ConcurrentMap_Grampa.
+// Off by default; enable with JUNCTION_TRACK_OPERATION_COUNTERS=1. When enabled, every map operation looks up a
+// thread_local and stores to it. When disabled, collect() returns zeros and nothing is added to map operations.
+//
+// Each thread increments its own Slot, which sits on its own cache line, so counting never involves a
+// read-modify-write or any sharing between threads. Additionally, one operation in every getSamplePeriod()
+// is timed with turf::CPUTimer and added to a per-thread latency histogram. collect() sums every thread's
+// Slot on demand. Slots of threads that have exited are kept (and later reused), so totals never go backwards.
+class OperationCounters {
+public:
+    enum Operation {
+        Get,    // get(), find()
+        Insert, // assign(), exchange(), compareExchange(), insertOrFind()
+        Erase,  // erase(), eraseIfEquals()
+        NumOperations
+    };
+
+    static const ureg NumLatencyBuckets = 32;
+    static const ureg DefaultSamplePeriod = 1024;
+
+    struct Totals {
+        u64 numOperations[NumOperations];
+        u64 numRedirectsFollowed; // Redirected cells that sent an operation to help with a migration
+        u64 numMigrationJobsRun;  // TableMigrations that a thread helped to run
+        u64 blockedTicks;         // CPUTimer ticks spent blocked on the condition variable in participate(), after
+                                  // the brief spin
+        // latencyHistogram[op][n] counts sampled operations that took fewer than 2^n CPUTimer ticks
+        // (and at least 2^(n-1), for n > 0). The last bucket also counts everything longer.
+        u64 latencyHistogram[NumOperations][NumLatencyBuckets];
+    };
+
+    // Sums the counters of every thread that has ever used a map. Safe to call at any time; counts from
+    // operations that are in progress may or may not be included.
+    static void collect(Totals& totals);
+
+    // Time one operation in every period. Pass 0 to stop sampling latency; operations are still counted.
+    static void setSamplePeriod(ureg period) {
+        s_samplePeriod.store(period, turf::Relaxed);
+    }
+    static ureg getSamplePeriod() {
+        return s_samplePeriod.load(turf::Relaxed);
+    }
+
+#if JUNCTION_TRACK_OPERATION_COUNTERS
+    struct Slot {
+        // Only the owning thread writes these. Relaxed loads and stores keep collect() well-defined.
+        turf::Atomic<ureg> numOperations[NumOperations];
+        turf::Atomic<ureg> numRedirectsFollowed;
+        turf::Atomic<ureg> numMigrationJobsRun;
+        turf::Atomic<u64> blockedTicks;
+        turf::Atomic<ureg> latencyHistogram[NumOperations][NumLatencyBuckets];
+        ureg sampleCountdown;
+        turf::Atomic<ureg> inUse; // Nonzero while a live thread owns this Slot
+        Slot* next;               // Singly-linked list of all Slots, never shrinks
+
+        static void increment(turf::Atomic<ureg>& counter) {
+            counter.store(counter.loadNonatomic() + 1, turf::Relaxed);
+        }
+    };
+
+    // Returns the calling thread's Slot, acquiring one on first use. Returns NULL once the thread has started to exit
+    // and has given its Slot back; operations run by later thread_local destructors, such as QSBR teardown, go
+    // uncounted.
+    static Slot* getSlot() {
+        Slot*& slot = threadSlot();
+        if (!slot)
+            slot = acquireSlot();
+        return slot;
+    }
+#endif
+
+private:
+    static turf::Atomic<ureg> s_samplePeriod;
+
+#if JUNCTION_TRACK_OPERATION_COUNTERS
+    static turf::Atomic<Slot*> s_slotList;
+
+    static Slot*& threadSlot() {
+        // Constant-initialized, so access needs no guard.
+        static thread_local Slot* slot = NULL;
+        return slot;
+    }
+    static Slot* acquireSlot();
+    struct SlotReleaser;
+#endif
+};
+
+namespace details {
+
+#if JUNCTION_TRACK_OPERATION_COUNTERS
+// Counts one map operation for the lifetime of this object, timing it if it's selected for sampling.
+class OperationScope {
+private:
+    OperationCounters::Slot* m_slot;
+    OperationCounters::Operation m_op;
+    turf::CPUTimer::Point m_start;
+
+    void beginSample() {
+        ureg period = OperationCounters::getSamplePeriod();
+        if (period == 0) {
+            // Sampling is off. Check again later in case it's turned back on.
+            m_slot->sampleCountdown = OperationCounters::DefaultSamplePeriod;
+            m_slot = NULL;
+            return;
+        }
+        m_slot->sampleCountdown = period;
+        m_start = turf::CPUTimer::get();
+    }
+
+    void endSample() {
+        u64 ticks = u64(turf::CPUTimer::get() - m_start);
+        ureg bucket = 0;
+        while (bucket < OperationCounters::NumLatencyBuckets - 1 && (ticks >> bucket) != 0)
+            bucket++;
+        OperationCounters::Slot::increment(m_slot->latencyHistogram[m_op][bucket]);
+    }
+
+public:
+    OperationScope(OperationCounters::Operation op) : m_slot(OperationCounters::getSlot()), m_op(op) {
+        if (!m_slot)
+            return;
+        OperationCounters::Slot::increment(m_slot->numOperations[op]);
+        if (--m_slot->sampleCountdown == 0)
+            beginSample();
+        else
+            m_slot = NULL; // Not sampled
+    }
+
+    ~OperationScope() {
+        if (m_slot)
+            endSample();
+    }
+};
+
+inline void countRedirectFollowed() {
+    OperationCounters::Slot* slot = OperationCounters::getSlot();
+    if (slot)
+        OperationCounters::Slot::increment(slot->numRedirectsFollowed);
+}
+
+inline void countMigrationJobRun() {
+    OperationCounters::Slot* slot = OperationCounters::getSlot();
+    if (slot)
+        OperationCounters::Slot::increment(slot->numMigrationJobsRun);
+}
+
+inline void addBlockedTicks(turf::CPUTimer::Duration ticks) {
+    OperationCounters::Slot* slot = OperationCounters::getSlot();
+    if (slot)
+        slot->blockedTicks.store(slot->blockedTicks.loadNonatomic() + u64(ticks), turf::Relaxed);
+}
+#else
+class OperationScope {
+public:
+    OperationScope(OperationCounters::Operation) {
+    }
+};
+
+inline void countRedirectFollowed() {
+}
+
+inline void countMigrationJobRun() {
+}
+
+inline void addBlockedTicks(turf::CPUTimer::Duration) {
+}
+#endif
+
+} // namespace details
+
+} // namespace junction
+
+#endif // JUNCTION_OPERATIONCOUNTERS_H
@@ -0,0 +1,96 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_SEEDEDKEYTRAITS_H
+#define JUNCTION_SEEDEDKEYTRAITS_H
+
+#include <junction/Core.h>
+#include <turf/Util.h>
+#include <random>
+
+namespace junction {
+
+// Key traits with a secret, keyed hash function, for maps that hold keys chosen by an untrusted party.
+//
+// With DefaultKeyTraits, anyone can compute the hash of a key, so it's easy to craft a set of keys that
+// collide in the low bits. In Leapfrog and Grampa, such keys overflow LinearSearchLimit and trigger one
+// migration after another. Here, each key is multiplied by a secret odd constant, xor-shifted, multiplied
+// by a second secret odd constant, then passed through turf::util::avalanche. Every step is invertible, so
+// dehash() still works, and zero still maps to zero, so NullKey and NullHash keep their usual meaning.
+//
+// The secret is shared by every map that uses the same traits type. Pass a distinct Tag type to give a map
+// its own secret. Call randomizeSeed() or setSeed() once at startup, before any map using these traits
+// holds entries; changing the seed makes existing entries unreachable.
+template <class T, class Tag = void>
+struct SeededKeyTraits {
+    typedef T Key;
+    typedef typename turf::util::BestFit<T>::Unsigned Hash;
+    static const Key NullKey = Key(0);
+    static const Hash NullHash = Hash(0);
+
+    struct Params {
+        u64 mul1;
+        u64 inv1; // Inverse of mul1 modulo 2^64
+        u64 mul2;
+        u64 inv2; // Inverse of mul2 modulo 2^64
+    };
+    static Params s_params;
+
+    static const ureg XorShift = sizeof(Hash) * 4; // Half the width, so that the xor-shift is its own inverse
+
+    static Hash hash(T key) {
+        Hash h = Hash(key) * Hash(s_params.mul1);
+        h ^= h >> XorShift;
+        h *= Hash(s_params.mul2);
+        return turf::util::avalanche(h);
+    }
+
+    static Key dehash(Hash hash) {
+        Hash h = turf::util::deavalanche(hash);
+        h *= Hash(s_params.inv2);
+        h ^= h >> XorShift;
+        h *= Hash(s_params.inv1);
+        return (T) h;
+    }
+
+    static u64 inverse(u64 odd) {
+        // Newton's method. Each iteration doubles the number of correct low bits, starting from 3.
+        u64 inv = odd;
+        for (ureg i = 0; i < 5; i++)
+            inv *= 2 - odd * inv;
+        return inv;
+    }
+
+    static void setSeed(u64 seed) {
+        // Derive two odd multipliers. The inverses computed modulo 2^64 also hold for narrower hashes.
+        s_params.mul1 = turf::util::avalanche(u64(seed ^ 0x9e3779b97f4a7c15ull)) | 1;
+        s_params.mul2 = turf::util::avalanche(u64(seed + 0xbf58476d1ce4e5b9ull)) | 1;
+        s_params.inv1 = inverse(s_params.mul1);
+        s_params.inv2 = inverse(s_params.mul2);
+        TURF_ASSERT(s_params.mul1 * s_params.inv1 == 1);
+        TURF_ASSERT(s_params.mul2 * s_params.inv2 == 1);
+    }
+
+    static void randomizeSeed() {
+        std::random_device device;
+        setSeed((u64(device()) << 32) ^ u64(device()));
+    }
+};
+
+// Constant-initialized, so the traits are usable (though not yet secret) before any seed is set.
+template <class T, class Tag>
+typename SeededKeyTraits<T, Tag>::Params SeededKeyTraits<T, Tag>::s_params = {
+    0x9e3779b97f4a7c15ull, 0xf1de83e19937733dull, 0xbf58476d1ce4e5b9ull, 0x96de1b173f119089ull};
+
+} // namespace junction
+
+#endif // JUNCTION_SEEDEDKEYTRAITS_H
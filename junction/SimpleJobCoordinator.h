@@ -15,34 +15,95 @@
 
 #include <junction/Core.h>
 #include <junction/striped/ConditionBank.h>
+#include <junction/striped/AdaptiveBackoff.h>
+#include <junction/JobPool.h>
+#include <junction/OperationCounters.h>
 
 namespace junction {
 
 // It's safe to call everything here from within a Job itself.
 // In particular, you're allowed to particpate() recursively.
-// We actually do this in ConcurrentMap_Grampa::publish() when migrating a new flattree.
 class SimpleJobCoordinator {
 public:
-    struct Job {
-        virtual ~Job() {
-        }
-        virtual void run() = 0;
-    };
+    typedef JobPool::Job Job;
 
 private:
-    JUNCTION_STRIPED_CONDITIONBANK_DEFINE_MEMBER()
+#if JUNCTION_USE_STRIPING
+    junction::striped::ConditionBank* m_conditionBank;
+#else
+    junction::striped::ConditionPair m_conditionPair;
+#endif
     turf::Atomic<uptr> m_job;
+    ureg m_spinLimit; // Pauses to spin in participate() before blocking
+    JobPool* m_jobPool; // Other jobs to help with while waiting, or NULL
+
+    // While a coordinator is reserved, participants wait for the job to be stored.
+    static bool mustWait(uptr job, uptr prevJob) {
+        return job == prevJob || job == Reserved;
+    }
+
+    junction::striped::ConditionPair& getConditionPair() {
+#if JUNCTION_USE_STRIPING
+        return m_conditionBank->get(this);
+#else
+        return m_conditionPair;
+#endif
+    }
 
 public:
-    SimpleJobCoordinator() : m_job(uptr(NULL)) {
+    // Job pointer value stored by tryReserve(). 1 marks the end of all jobs.
+    static const uptr Reserved = 2;
+
+    // Waiting threads always spin briefly, in case the next job is about to be posted.
+    static const ureg MinSpinPauses = 32;
+    // Jobs larger than this are expected to outlast any reasonable spin, so waiting threads only spin for MinSpinPauses
+    // before blocking.
+    static const ureg MaxSpinJobSize = 16384;
+
+    SimpleJobCoordinator() : m_job(uptr(NULL)), m_spinLimit(MinSpinPauses), m_jobPool(NULL) {
+#if JUNCTION_USE_STRIPING
+        m_conditionBank = &junction::striped::DefaultConditionBank;
+#endif
+    }
+
+    // Waits on a ConditionPair from the given bank instead of DefaultConditionBank. Pass NULL for the default.
+    // Must be called before any thread uses the coordinator.
+    void setConditionBank(junction::striped::ConditionBank* bank) {
+#if JUNCTION_USE_STRIPING
+        m_conditionBank = bank ? bank : &junction::striped::DefaultConditionBank;
+#else
+        TURF_UNUSED(bank);
+#endif
+    }
+
+    // Sets how long participate() spins before blocking. jobSize is roughly the number of cells a job visits; for a
+    // table migration, that's the size of the source table. Most small migrations finish in a few microseconds, so
+    // spinning lets participants pick up the next job without a round trip through the kernel. Must be called
+    // before any thread uses the coordinator.
+    void setExpectedJobSize(ureg jobSize) {
+        m_spinLimit = (jobSize <= MaxSpinJobSize) ? turf::util::max(jobSize >> 2, ureg(MinSpinPauses)) : MinSpinPauses;
+    }
+
+    // While waiting for the next job, participate() first runs the jobs in the given pool. Must be called before any
+    // thread uses the coordinator.
+    void setJobPool(JobPool* jobPool) {
+        m_jobPool = jobPool;
     }
 
     Job* loadConsume() const {
         return (Job*) m_job.load(turf::Consume);
     }
 
+    // Claims an idle coordinator with a single CAS, so that only one of several racing threads goes on to create a job.
+    // That thread must then call storeRelease(). Until it does, participate() waits, and loadConsume() returns a
+    // non-NULL pointer that must not be run.
+    bool tryReserve() {
+        uptr expected = uptr(NULL);
+        return m_job.compareExchangeStrong(expected, Reserved, turf::Relaxed);
+    }
+
     void storeRelease(Job* job) {
-        junction::striped::ConditionPair& pair = JUNCTION_STRIPED_CONDITIONBANK_GET(this);
+        junction::striped::ConditionPair& pair = getConditionPair();
         {
             turf::LockGuard<turf::Mutex> guard(pair.mutex);
             m_job.store(uptr(job), turf::Release);
@@ -51,22 +112,44 @@ public:
     }
 
     void participate() {
-        junction::striped::ConditionPair& pair = JUNCTION_STRIPED_CONDITIONBANK_GET(this);
+        junction::striped::ConditionPair& pair = getConditionPair();
         uptr prevJob = uptr(NULL);
         for (;;) {
             uptr job = m_job.load(turf::Consume);
-            if (job == prevJob) {
-                turf::LockGuard<turf::Mutex> guard(pair.mutex);
-                for (;;) {
-                    job = m_job.loadNonatomic(); // No concurrent writes inside lock
-                    if (job != prevJob)
+            if (mustWait(job, prevJob) && m_jobPool && m_jobPool->help()) {
+                // Our job has no more work to claim, but it isn't finished. We helped with other jobs in the meantime.
+                job = m_job.load(turf::Consume);
+            }
+            if (mustWait(job, prevJob)) {
+                junction::striped::AdaptiveBackoff backoff(m_spinLimit);
+                while (backoff.spin()) {
+                    job = m_job.load(turf::Consume);
+                    if (!mustWait(job, prevJob))
                         break;
-                    pair.condVar.wait(guard);
+                }
+                if (mustWait(job, prevJob)) {
+                    turf::CPUTimer::Point blockStart = turf::CPUTimer::get();
+                    {
+                        turf::LockGuard<turf::Mutex> guard(pair.mutex);
+                        for (;;) {
+                            // Jobs are only stored inside the lock. tryReserve() can race with this load, but it only
+                            // stores Reserved.
+                            job = m_job.load(turf::Relaxed);
+                            if (!mustWait(job, prevJob))
+                                break;
+                            pair.condVar.wait(guard);
+                        }
+                    }
+                    details::addBlockedTicks(turf::CPUTimer::get() - blockStart);
                 }
             }
             if (job == 1)
                 return;
-            reinterpret_cast<Job*>(job)->run();
+            details::countMigrationJobRun();
+            {
+                JobPool::RunScope scope;
+                reinterpret_cast<Job*>(job)->run();
+            }
             prevJob = job;
         }
     }
@@ -74,11 +157,12 @@ public:
     void runOne(Job* job) {
         TURF_ASSERT(job != (Job*) m_job.load(turf::Relaxed));
         storeRelease(job);
+        JobPool::RunScope scope;
         job->run();
     }
 
     void end() {
-        junction::striped::ConditionPair& pair = JUNCTION_STRIPED_CONDITIONBANK_GET(this);
+        junction::striped::ConditionPair& pair = getConditionPair();
         {
             turf::LockGuard<turf::Mutex> guard(pair.mutex);
             m_job.store(1, turf::Release);
@@ -15,12 +15,17 @@
 
 #include <junction/Core.h>
 #include <junction/MapTraits.h>
+#include <junction/MapStats.h>
+#include <junction/TableArena.h>
+#include <junction/details/BulkLoad.h>
 #include <turf/Util.h>
 #include <turf/Heap.h>
+#include <utility>
 
 namespace junction {
 
-template <typename Key, typename Value, class KeyTraits = DefaultKeyTraits<Key>, class ValueTraits = DefaultValueTraits<Value>>
+template <typename Key, typename Value, class KeyTraits = DefaultKeyTraits<Key>, class ValueTraits = DefaultValueTraits<Value>,
+          class Allocator = DefaultTableAllocator>
 class SingleMap_Leapfrog {
 private:
     typedef typename KeyTraits::Hash Hash;
@@ -43,12 +48,11 @@ private:
         Cell cells[4];
     };
 
+    Allocator m_allocator;
     CellGroup* m_cellGroups;
     ureg m_sizeMask;
 
-    static CellGroup* createTable(ureg size = InitialSize) {
-        TURF_ASSERT(size >= 4 && turf::util::isPowerOf2(size));
-        CellGroup* cellGroups = (CellGroup*) TURF_HEAP.alloc(sizeof(CellGroup) * (size >> 2));
+    static void initCellGroups(CellGroup* cellGroups, ureg size) {
         for (ureg i = 0; i < (size >> 2); i++) {
             CellGroup* group = cellGroups + i;
             ureg j;
@@ -57,17 +61,23 @@ private:
             for (j = 0; j < 4; j++)
                 new (group->cells + j) Cell(KeyTraits::NullHash, Value(ValueTraits::NullValue));
         }
+    }
+
+    CellGroup* createTable(ureg size = InitialSize) {
+        TURF_ASSERT(size >= 4 && turf::util::isPowerOf2(size));
+        CellGroup* cellGroups = (CellGroup*) m_allocator.alloc(sizeof(CellGroup) * (size >> 2));
+        initCellGroups(cellGroups, size);
         return cellGroups;
     }
 
-    static void destroyTable(CellGroup* cellGroups, ureg size) {
+    void destroyTable(CellGroup* cellGroups, ureg size) {
         TURF_ASSERT(size >= 4 && turf::util::isPowerOf2(size));
         for (ureg i = 0; i < (size >> 2); i++) {
             CellGroup* group = cellGroups + i;
             for (ureg j = 0; j < 4; j++)
-                group->cells[i].~Cell();
+                group->cells[j].~Cell();
         }
-        TURF_HEAP.free(cellGroups);
+        m_allocator.free(cellGroups, sizeof(CellGroup) * (size >> 2));
     }
 
     enum InsertResult { InsertResult_AlreadyFound, InsertResult_InsertedNew, InsertResult_Overflow };
@@ -79,11 +89,13 @@ private:
         cell = group->cells + (idx & 3);
         if (cell->hash == hash)
             return InsertResult_AlreadyFound; // Key found in table.
-        else if (cell->hash == KeyTraits::NullHash) {
-            // Reserve the first cell.
-            cell->hash = hash;
-            return InsertResult_InsertedNew;
-        }
+        // Remember the first free or deleted cell in our bucket, in case the key isn't found.
+        // The hashed cell may have been freed by removeCell while the rest of the probe chain remains, so even if
+        // it's free, we must check the chain before reserving it.
+        Cell* reusableCell = NULL;
+        if (cell->hash == KeyTraits::NullHash ||
+            (cell->value == Value(ValueTraits::NullValue) && ((cell->hash ^ hash) & m_sizeMask) == 0))
+            reusableCell = cell;
         // Follow probe chain for our bucket.
         ureg maxIdx = idx + m_sizeMask;
         u8* prevLink = group->deltas + (idx & 3);
@@ -94,10 +106,18 @@ private:
             cell = group->cells + (idx & 3);
             if (cell->hash == hash)
                 return InsertResult_AlreadyFound; // Key found in table
+            if (!reusableCell && cell->value == Value(ValueTraits::NullValue))
+                reusableCell = cell;
             prevLink = group->deltas + (idx & 3) + 4;
             delta = *prevLink;
         }
         // Reached the end of the link chain for this bucket. Key does not exist in table.
+        if (reusableCell) {
+            // Reserve the hashed cell, or take over a deleted cell that's already linked into our bucket.
+            cell = reusableCell;
+            cell->hash = hash;
+            return InsertResult_InsertedNew;
+        }
         // Switch to linear probing to find a free cell.
         ureg prevLinkIdx = idx;
         TURF_ASSERT(sreg(maxIdx - idx) >= 0); // Nobody would have linked an idx that's out of range.
@@ -122,6 +142,41 @@ private:
         return InsertResult_Overflow;
     }
 
+    // Since this map is single-threaded, an erased cell can simply be unlinked from its bucket's probe chain and
+    // freed, so erase leaves nothing behind for the next migration to purge. If the combined link would not fit in
+    // a delta, the cell is left as a deleted entry instead, for insertOrFind to take over.
+    void removeCell(Cell* cell) {
+        ureg groupIdx = ureg((u8*) cell - (u8*) m_cellGroups) / sizeof(CellGroup);
+        ureg cellIdx = (groupIdx << 2) + ureg(cell - m_cellGroups[groupIdx].cells);
+        ureg idx = ureg(cell->hash) & m_sizeMask;
+        cell->value = Value(ValueTraits::NullValue);
+        if (idx == cellIdx) {
+            // It's in its hashed cell, which isn't linked from anywhere.
+            cell->hash = KeyTraits::NullHash;
+            return;
+        }
+        // Find the link that points to this cell.
+        u8* prevLink = m_cellGroups[idx >> 2].deltas + (idx & 3);
+        for (;;) {
+            TURF_ASSERT(*prevLink); // The cell must be in its bucket's probe chain.
+            idx = (idx + *prevLink) & m_sizeMask;
+            if (idx == cellIdx)
+                break;
+            prevLink = m_cellGroups[idx >> 2].deltas + (idx & 3) + 4;
+        }
+        u8* nextLink = m_cellGroups[cellIdx >> 2].deltas + (cellIdx & 3) + 4;
+        if (*nextLink == 0) {
+            *prevLink = 0;
+        } else {
+            ureg combined = ureg(*prevLink) + *nextLink;
+            if (combined > 255)
+                return; // Leave a deleted entry.
+            *prevLink = u8(combined);
+            *nextLink = 0;
+        }
+        cell->hash = KeyTraits::NullHash;
+    }
+
     bool tryMigrateToNewTableWithSize(ureg desiredSize) {
         CellGroup* srcCellGroups = m_cellGroups;
         ureg srcSize = m_sizeMask + 1;
@@ -170,7 +225,10 @@ private:
             estimatedInUse /= 4;
         }
 #endif
-        ureg nextTableSize = turf::util::max(InitialSize, turf::util::roundUpPowerOf2(ureg(estimatedInUse * 2)));
+        migrateToSize(turf::util::max(InitialSize, turf::util::roundUpPowerOf2(ureg(estimatedInUse * 2))));
+    }
+
+    void migrateToSize(ureg nextTableSize) {
         for (;;) {
             if (tryMigrateToNewTableWithSize(nextTableSize))
                 break; // Success
@@ -179,23 +237,131 @@ private:
         }
     }
 
+    // Lets details::buildBulkTable() write directly to the table.
+    struct BulkWriter {
+        SingleMap_Leapfrog& map;
+
+        BulkWriter(SingleMap_Leapfrog& map) : map(map) {
+        }
+
+        void setCell(ureg idx, Hash hash, Value value) {
+            Cell* cell = map.m_cellGroups[idx >> 2].cells + (idx & 3);
+            cell->hash = hash;
+            cell->value = value;
+        }
+
+        void setFirstDelta(ureg idx, u8 delta) {
+            map.m_cellGroups[idx >> 2].deltas[idx & 3] = delta;
+        }
+
+        void setNextDelta(ureg idx, u8 delta) {
+            map.m_cellGroups[idx >> 2].deltas[(idx & 3) + 4] = delta;
+        }
+
+        bool insert(Hash hash, Value value) {
+            Cell* cell;
+            ureg overflowIdx;
+            if (map.insertOrFind(hash, cell, overflowIdx) == InsertResult_Overflow)
+                return false;
+            cell->value = value;
+            return true;
+        }
+    };
+
 public:
-    SingleMap_Leapfrog(ureg initialSize = 8) : m_cellGroups(createTable(initialSize)), m_sizeMask(initialSize - 1) {
+    SingleMap_Leapfrog(ureg initialSize = 8, const Allocator& allocator = Allocator())
+        : m_allocator(allocator), m_cellGroups(createTable(initialSize)), m_sizeMask(initialSize - 1) {
+    }
+
+    // Takes other's table, and leaves other empty with a new table of InitialSize from its allocator.
+    SingleMap_Leapfrog(SingleMap_Leapfrog&& other)
+        : m_allocator(other.m_allocator), m_cellGroups(other.m_cellGroups), m_sizeMask(other.m_sizeMask) {
+        other.m_cellGroups = other.createTable(InitialSize);
+        other.m_sizeMask = InitialSize - 1;
+    }
+
+    // Swaps tables and allocators with other, which destroys our old table along with its own.
+    SingleMap_Leapfrog& operator=(SingleMap_Leapfrog&& other) {
+        if (this != &other) {
+            std::swap(m_allocator, other.m_allocator);
+            std::swap(m_cellGroups, other.m_cellGroups);
+            std::swap(m_sizeMask, other.m_sizeMask);
+        }
+        return *this;
     }
 
     ~SingleMap_Leapfrog() {
         destroyTable(m_cellGroups, m_sizeMask + 1);
     }
 
+    ureg getCapacity() const {
+        return m_sizeMask + 1;
+    }
+
+    // Grows the table, if needed, to the size a migration would pick for numEntries entries. Inserting that many
+    // distinct keys then won't resize unless they collide badly.
+    void reserve(ureg numEntries) {
+        ureg size = turf::util::max(InitialSize, turf::util::roundUpPowerOf2(numEntries * 2));
+        if (size > m_sizeMask + 1)
+            migrateToSize(size);
+    }
+
+    // Removes every entry but keeps the table, so that refilling the map doesn't allocate.
+    void clear() {
+        for (ureg i = 0; i < ((m_sizeMask + 1) >> 2); i++) {
+            for (ureg j = 0; j < 4; j++)
+                m_cellGroups[i].cells[j].~Cell();
+        }
+        initCellGroups(m_cellGroups, m_sizeMask + 1);
+    }
+
+    // Replaces the contents of the map with the (key, value) pairs in [first, last), such as a range of std::pair.
+    // The table is sized once, for the number of pairs, and filled in one sequential sweep; see details/BulkLoad.h.
+    // If a key appears more than once, the last value wins.
+    template <class InputIt>
+    void buildFrom(InputIt first, InputIt last) {
+        std::vector<details::BulkEntry<Hash, Value>> entries;
+        std::vector<details::BulkEntry<Hash, Value>> sorted;
+        details::collectBulkEntries<KeyTraits>(entries, first, last);
+        destroyTable(m_cellGroups, m_sizeMask + 1);
+        ureg size = turf::util::max(InitialSize, turf::util::roundUpPowerOf2(ureg(entries.size() * 2)));
+        for (;;) {
+            m_cellGroups = createTable(size);
+            m_sizeMask = size - 1;
+            details::sortBulkEntries(entries, sorted, size, details::TableBucket<Hash>(m_sizeMask));
+            BulkWriter writer(*this);
+            if (details::buildBulkTable(sorted.data(), sorted.size(), m_sizeMask, LinearSearchLimit, writer))
+                break; // Success
+            // Failed; try a larger table
+            destroyTable(m_cellGroups, size);
+            size *= 2;
+        }
+    }
+
     class Mutator {
     private:
         friend class SingleMap_Leapfrog;
         SingleMap_Leapfrog& m_map;
         Cell* m_cell;
+        Hash m_hash; // Kept so that exchangeValue() can insert the key again after erase() freed its cell
+
+        // Finds or inserts the cell for m_hash.
+        void insert() {
+            for (;;) {
+                ureg overflowIdx;
+                if (m_map.insertOrFind(m_hash, m_cell, overflowIdx) != InsertResult_Overflow)
+                    return;
+                // Insert overflow. Migrate and try again.
+                // On the first iteration of this loop, deleted cells will be purged.
+                // The second iteration (if any) will always double in size.
+                // On the third iteration (if any), the insert will succeed.
+                m_map.migrateToNewTable(overflowIdx);
+            }
+        }
 
         // Constructor: Find without insert
-        Mutator(SingleMap_Leapfrog& map, Key key, bool) : m_map(map) {
-            Hash hash = KeyTraits::hash(key);
+        Mutator(SingleMap_Leapfrog& map, Key key, bool) : m_map(map), m_hash(KeyTraits::hash(key)) {
+            Hash hash = m_hash;
             TURF_ASSERT(hash != KeyTraits::NullHash);
             // Optimistically check hashed cell even though it might belong to another bucket
             ureg idx = ureg(hash);
@@ -219,18 +385,8 @@ public:
         }
 
         // Constructor: Find with insert
-        Mutator(SingleMap_Leapfrog& map, Key key) : m_map(map) {
-            Hash hash = KeyTraits::hash(key);
-            for (;;) {
-                ureg overflowIdx;
-                if (map.insertOrFind(hash, m_cell, overflowIdx) != InsertResult_Overflow)
-                    return;
-                // Insert overflow. Migrate and try again.
-                // On the first iteration of this loop, deleted cells will be purged.
-                // The second iteration (if any) will always double in size.
-                // On the third iteration (if any), the insert will succeed.
-                map.migrateToNewTable(overflowIdx);
-            }
+        Mutator(SingleMap_Leapfrog& map, Key key) : m_map(map), m_hash(KeyTraits::hash(key)) {
+            insert();
         }
 
     public:
@@ -246,22 +402,62 @@ public:
         Value exchangeValue(Value desired) {
             TURF_ASSERT(m_cell);
             TURF_ASSERT(desired != NULL); // Use eraseValue()
+            if (m_cell->hash != m_hash) {
+                // erase() freed the cell. Insert the key again.
+                insert();
+            }
             Value oldValue = m_cell->value;
             m_cell->value = desired;
             return oldValue;
         }
 
+        // The Mutator stays valid: getValue() then returns NULL, and exchangeValue() inserts the key again.
         Value erase() {
             TURF_ASSERT(m_cell);
-            // Since this map is single-threaded, we could conceivably shuffle existing cells around to safely fill
-            // gaps, much like SingleMap_Linear currently does.
-            // Instead, we'll just leave them as deleted entries and let them get purged on the next migration.
             Value oldValue = m_cell->value;
-            m_cell->value = Value(ValueTraits::NullValue);
+            if (oldValue == Value(ValueTraits::NullValue))
+                return oldValue; // Already erased, and the cell may already be freed
+            m_map.removeCell(m_cell);
             return oldValue;
         }
     };
 
+    // Returns statistics for the whole table, or for sampleSize consecutive buckets. See MapStats.
+    MapStats collectStats(ureg sampleSize = 0) const {
+        MapStats stats;
+        ureg startIdx = MapStats::chooseSampleStart(sampleSize, m_sizeMask);
+        stats.numTables = 1;
+        stats.capacity = m_sizeMask + 1;
+        stats.bytesUsed = sizeof(*this) + sizeof(CellGroup) * ((m_sizeMask + 1) >> 2);
+        for (ureg i = 0; i < sampleSize; i++) {
+            ureg bucketIdx = (startIdx + i) & m_sizeMask;
+            CellGroup* group = m_cellGroups + (bucketIdx >> 2);
+            Cell* cell = group->cells + (bucketIdx & 3);
+            stats.numCellsScanned++;
+            if (cell->hash != KeyTraits::NullHash) {
+                if (cell->value == Value(ValueTraits::NullValue)) {
+                    stats.numTombstones++;
+                } else {
+                    stats.numCellsInUse++;
+                    if ((cell->hash & m_sizeMask) == bucketIdx)
+                        stats.addProbe(0);
+                }
+            }
+            // Follow the probe chain for this bucket.
+            ureg idx = bucketIdx;
+            u8 delta = group->deltas[idx & 3];
+            for (ureg probes = 1; delta; probes++) {
+                idx = (idx + delta) & m_sizeMask;
+                group = m_cellGroups + (idx >> 2);
+                cell = group->cells + (idx & 3);
+                if (cell->value != Value(ValueTraits::NullValue))
+                    stats.addProbe(probes);
+                delta = group->deltas[(idx & 3) + 4];
+            }
+        }
+        return stats;
+    }
+
     Mutator insertOrFindKey(const Key& key) {
         return Mutator(*this, key);
     }
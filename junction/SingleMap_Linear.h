@@ -15,16 +15,22 @@
 
 #include <junction/Core.h>
 #include <junction/MapTraits.h>
+#include <junction/MapStats.h>
+#include <junction/TableArena.h>
 #include <turf/Util.h>
 #include <turf/Heap.h>
+#include <utility>
 
 namespace junction {
 
-template <typename Key, typename Value, class KeyTraits = DefaultKeyTraits<Key>, class ValueTraits = DefaultValueTraits<Value>>
+template <typename Key, typename Value, class KeyTraits = DefaultKeyTraits<Key>, class ValueTraits = DefaultValueTraits<Value>,
+          class Allocator = DefaultTableAllocator>
 class SingleMap_Linear {
 private:
     typedef typename KeyTraits::Hash Hash;
 
+    static const ureg InitialSize = 8;
+
     struct Cell {
         Hash hash;
         Value value;
@@ -32,23 +38,24 @@ private:
         }
     };
 
+    Allocator m_allocator;
     Cell* m_cells;
     ureg m_sizeMask;
     ureg m_population;
 
-    static Cell* createTable(ureg size) {
+    Cell* createTable(ureg size) {
         TURF_ASSERT(turf::util::isPowerOf2(size));
-        Cell* cells = (Cell*) TURF_HEAP.alloc(sizeof(Cell) * size);
+        Cell* cells = (Cell*) m_allocator.alloc(sizeof(Cell) * size);
         for (ureg i = 0; i < size; i++)
             new (cells + i) Cell(KeyTraits::NullHash, Value(ValueTraits::NullValue));
         return cells;
     }
 
-    static void destroyTable(Cell* cells, ureg size) {
+    void destroyTable(Cell* cells, ureg size) {
         TURF_ASSERT(turf::util::isPowerOf2(size));
         for (ureg i = 0; i < size; i++)
             cells[i].~Cell();
-        TURF_HEAP.free(cells);
+        m_allocator.free(cells, sizeof(Cell) * size);
     }
 
     static bool isOverpopulated(ureg population, ureg sizeMask) {
@@ -76,13 +83,59 @@ private:
     }
 
 public:
-    SingleMap_Linear(ureg initialSize = 8) : m_cells(createTable(initialSize)), m_sizeMask(initialSize - 1), m_population(0) {
+    SingleMap_Linear(ureg initialSize = 8, const Allocator& allocator = Allocator())
+        : m_allocator(allocator), m_cells(createTable(initialSize)), m_sizeMask(initialSize - 1), m_population(0) {
+    }
+
+    // Takes other's table, and leaves other empty with a new table of InitialSize from its allocator.
+    SingleMap_Linear(SingleMap_Linear&& other)
+        : m_allocator(other.m_allocator), m_cells(other.m_cells), m_sizeMask(other.m_sizeMask), m_population(other.m_population) {
+        other.m_cells = other.createTable(InitialSize);
+        other.m_sizeMask = InitialSize - 1;
+        other.m_population = 0;
+    }
+
+    // Swaps tables and allocators with other, which destroys our old table along with its own.
+    SingleMap_Linear& operator=(SingleMap_Linear&& other) {
+        if (this != &other) {
+            std::swap(m_allocator, other.m_allocator);
+            std::swap(m_cells, other.m_cells);
+            std::swap(m_sizeMask, other.m_sizeMask);
+            std::swap(m_population, other.m_population);
+        }
+        return *this;
     }
 
     ~SingleMap_Linear() {
         destroyTable(m_cells, m_sizeMask + 1);
     }
 
+    ureg getCapacity() const {
+        return m_sizeMask + 1;
+    }
+
+    ureg getPopulation() const {
+        return m_population;
+    }
+
+    // Grows the table, if needed, so that numEntries entries fit without another resize.
+    void reserve(ureg numEntries) {
+        ureg size = m_sizeMask + 1;
+        while (isOverpopulated(numEntries, size - 1))
+            size *= 2;
+        if (size > m_sizeMask + 1)
+            migrateToNewTable(size);
+    }
+
+    // Removes every entry but keeps the table, so that refilling the map doesn't allocate.
+    void clear() {
+        for (ureg idx = 0; idx <= m_sizeMask; idx++) {
+            m_cells[idx].hash = KeyTraits::NullHash;
+            m_cells[idx].value = Value(ValueTraits::NullValue);
+        }
+        m_population = 0;
+    }
+
     class Mutator {
     private:
         friend class SingleMap_Linear;
@@ -180,6 +233,26 @@ public:
         }
     };
 
+    // Returns statistics for the whole table, or for sampleSize consecutive cells. See MapStats.
+    // Erase never leaves tombstones in this map, so numTombstones is always zero.
+    MapStats collectStats(ureg sampleSize = 0) const {
+        MapStats stats;
+        ureg startIdx = MapStats::chooseSampleStart(sampleSize, m_sizeMask);
+        stats.numTables = 1;
+        stats.capacity = m_sizeMask + 1;
+        stats.bytesUsed = sizeof(*this) + sizeof(Cell) * (m_sizeMask + 1);
+        for (ureg i = 0; i < sampleSize; i++) {
+            ureg idx = (startIdx + i) & m_sizeMask;
+            Cell* cell = m_cells + idx;
+            stats.numCellsScanned++;
+            if (cell->hash != KeyTraits::NullHash) {
+                stats.numCellsInUse++;
+                stats.addProbe((idx - ureg(cell->hash)) & m_sizeMask);
+            }
+        }
+        return stats;
+    }
+
     Mutator insertOrFindKey(const Key& key) {
         return Mutator(*this, key);
     }
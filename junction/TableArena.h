@@ -0,0 +1,152 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_TABLEARENA_H
+#define JUNCTION_TABLEARENA_H
+
+#include <junction/Core.h>
+#include <turf/Heap.h>
+
+namespace junction {
+
+// Where SingleMap_Linear and SingleMap_Leapfrog get their tables from, unless told otherwise.
+struct DefaultTableAllocator {
+    void* alloc(ureg size) {
+        return TURF_HEAP.alloc(size);
+    }
+
+    void free(void* ptr, ureg size) {
+        TURF_UNUSED(size);
+        TURF_HEAP.free(ptr);
+    }
+};
+
+// Keeps freed tables for reuse, so that short-lived maps which come and go by the thousand stop hitting the heap
+// once the arena has warmed up. Tables are kept by exact size, and since they're always a power-of-two number of
+// cells, the maps of one type only ever ask for a handful of sizes.
+//
+// Not thread-safe. Give each thread its own arena, and destroy the maps that use it before the arena itself.
+class TableArena {
+public:
+    // Pass as the Allocator parameter of SingleMap_Linear or SingleMap_Leapfrog, and construct each map with an
+    // Allocator that points to the arena.
+    class Allocator {
+    private:
+        TableArena* m_arena;
+
+    public:
+        Allocator(TableArena& arena) : m_arena(&arena) {
+        }
+
+        void* alloc(ureg size) {
+            return m_arena->alloc(size);
+        }
+
+        void free(void* ptr, ureg size) {
+            m_arena->free(ptr, size);
+        }
+    };
+
+    static const ureg NumSizeClasses = 16;
+
+private:
+    struct Block {
+        Block* next;
+    };
+
+    struct SizeClass {
+        ureg size;
+        ureg numBlocks;
+        Block* head;
+    };
+
+    SizeClass m_sizeClasses[NumSizeClasses];
+    ureg m_maxBlocksPerSize;
+
+    SizeClass* findSizeClass(ureg size, bool create) {
+        for (ureg i = 0; i < NumSizeClasses; i++) {
+            SizeClass& sc = m_sizeClasses[i];
+            if (sc.size == size)
+                return &sc;
+            if (sc.size == 0) {
+                if (!create)
+                    return NULL;
+                sc.size = size;
+                return &sc;
+            }
+        }
+        return NULL;
+    }
+
+public:
+    // Up to maxBlocksPerSize freed tables of each size are kept. The rest go back to the heap.
+    TableArena(ureg maxBlocksPerSize = 64) : m_maxBlocksPerSize(maxBlocksPerSize) {
+        for (ureg i = 0; i < NumSizeClasses; i++) {
+            m_sizeClasses[i].size = 0;
+            m_sizeClasses[i].numBlocks = 0;
+            m_sizeClasses[i].head = NULL;
+        }
+    }
+
+    ~TableArena() {
+        trim();
+    }
+
+    void* alloc(ureg size) {
+        TURF_ASSERT(size >= sizeof(Block));
+        SizeClass* sc = findSizeClass(size, false);
+        if (sc && sc->head) {
+            Block* block = sc->head;
+            sc->head = block->next;
+            sc->numBlocks--;
+            return block;
+        }
+        return TURF_HEAP.alloc(size);
+    }
+
+    void free(void* ptr, ureg size) {
+        SizeClass* sc = findSizeClass(size, true);
+        if (!sc || sc->numBlocks >= m_maxBlocksPerSize) {
+            TURF_HEAP.free(ptr);
+            return;
+        }
+        Block* block = (Block*) ptr;
+        block->next = sc->head;
+        sc->head = block;
+        sc->numBlocks++;
+    }
+
+    // How many freed tables the arena is keeping for reuse, across all sizes.
+    ureg getNumKeptTables() const {
+        ureg numKept = 0;
+        for (ureg i = 0; i < NumSizeClasses; i++)
+            numKept += m_sizeClasses[i].numBlocks;
+        return numKept;
+    }
+
+    // Returns every kept table to the heap.
+    void trim() {
+        for (ureg i = 0; i < NumSizeClasses; i++) {
+            SizeClass& sc = m_sizeClasses[i];
+            while (sc.head) {
+                Block* block = sc.head;
+                sc.head = block->next;
+                TURF_HEAP.free(block);
+            }
+            sc.numBlocks = 0;
+        }
+    }
+};
+
+} // namespace junction
+
+#endif // JUNCTION_TABLEARENA_H
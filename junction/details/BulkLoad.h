@@ -0,0 +1,176 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_DETAILS_BULKLOAD_H
+#define JUNCTION_DETAILS_BULKLOAD_H
+
+#include <junction/Core.h>
+#include <turf/Util.h>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+namespace junction {
+namespace details {
+
+// Shared by the buildFrom() functions of SingleMap_Leapfrog, ConcurrentMap_Leapfrog and ConcurrentMap_Grampa.
+// Instead of inserting one entry at a time, each of which probes a random spot in the table, buildFrom() sorts
+// the entries by bucket, then writes the table's cells and deltas in a single sequential sweep.
+
+template <class Hash, class Value>
+struct BulkEntry {
+    Hash hash;
+    Value value;
+};
+
+template <class Entry, class InputIt>
+void reserveBulkEntries(std::vector<Entry>&, InputIt, InputIt, std::input_iterator_tag) {
+    // A single-pass range can't be counted ahead of time.
+}
+
+template <class Entry, class InputIt>
+void reserveBulkEntries(std::vector<Entry>& entries, InputIt first, InputIt last, std::forward_iterator_tag) {
+    entries.reserve(entries.size() + ureg(std::distance(first, last)));
+}
+
+// Hashes every (key, value) pair in [first, last) into entries.
+template <class KeyTraits, class Hash, class Value, class InputIt>
+void collectBulkEntries(std::vector<BulkEntry<Hash, Value>>& entries, InputIt first, InputIt last) {
+    reserveBulkEntries(entries, first, last, typename std::iterator_traits<InputIt>::iterator_category());
+    for (; first != last; ++first) {
+        BulkEntry<Hash, Value> entry;
+        entry.hash = KeyTraits::hash(first->first);
+        entry.value = first->second;
+        TURF_ASSERT(entry.hash != KeyTraits::NullHash);
+        entries.push_back(entry);
+    }
+}
+
+// The bucket of a hash in a single table.
+template <class Hash>
+struct TableBucket {
+    ureg sizeMask;
+
+    TableBucket(ureg sizeMask) : sizeMask(sizeMask) {
+    }
+
+    ureg operator()(Hash hash) const {
+        return ureg(hash) & sizeMask;
+    }
+};
+
+// Copies entries to sorted, ordered by bucket. bucketOf must return values less than numBuckets, a power of two.
+// It's an LSD radix sort on the bucket index, a few bits at a time, so that each pass scatters the entries into at
+// most 1 << MaxRadixBits sequential streams rather than to numBuckets random spots. Each pass is stable, so when a
+// key appears more than once, the last value still wins. buildBulkTable() scribbles over the sorted entries, so each
+// attempt to build a table sorts them again.
+template <class Hash, class Value, class BucketOf>
+void sortBulkEntries(const std::vector<BulkEntry<Hash, Value>>& entries, std::vector<BulkEntry<Hash, Value>>& sorted,
+                     ureg numBuckets, const BucketOf& bucketOf) {
+    static const ureg MaxRadixBits = 11;
+    TURF_ASSERT(turf::util::isPowerOf2(numBuckets));
+    ureg numBits = 0;
+    while ((ureg(1) << numBits) < numBuckets)
+        numBits++;
+    // Split the bits evenly between the passes.
+    ureg numPasses = turf::util::max(ureg(1), (numBits + MaxRadixBits - 1) / MaxRadixBits);
+    ureg radixBits = (numBits + numPasses - 1) / numPasses;
+    ureg radixMask = (ureg(1) << radixBits) - 1;
+    std::vector<ureg> starts(radixMask + 2);
+    std::vector<BulkEntry<Hash, Value>> scratch;
+    sorted.resize(entries.size());
+    if (numPasses > 1)
+        scratch.resize(entries.size());
+    const BulkEntry<Hash, Value>* src = entries.data();
+    for (ureg pass = 0; pass < numPasses; pass++) {
+        ureg shift = pass * radixBits;
+        // Arrange for the last pass to land in sorted.
+        BulkEntry<Hash, Value>* dst = ((numPasses - pass) & 1) ? sorted.data() : scratch.data();
+        std::fill(starts.begin(), starts.end(), 0);
+        for (ureg i = 0; i < entries.size(); i++)
+            starts[((bucketOf(src[i].hash) >> shift) & radixMask) + 1]++;
+        for (ureg d = 0; d <= radixMask; d++)
+            starts[d + 1] += starts[d];
+        for (ureg i = 0; i < entries.size(); i++)
+            dst[starts[(bucketOf(src[i].hash) >> shift) & radixMask]++] = src[i];
+        src = dst;
+    }
+}
+
+// Lays out count entries, sorted by bucket, in an empty table of sizeMask + 1 cells.
+//
+// The sweep places each bucket's cells next to each other, starting at the bucket's own cell if it's still free,
+// or just past the cells of the previous bucket otherwise. Consecutive cells in a bucket are linked with a delta of
+// one. A bucket whose cells would run past the end of the table is left for later, since wrapping around would land
+// on cells that are already taken; once the sweep is done, those entries are passed to writer.insert(), which probes
+// as usual. Duplicate hashes are folded into a single cell holding the last value.
+//
+// Returns false if some delta would exceed linearSearchLimit, or if writer.insert() fails. The caller should then
+// retry with a larger table, the same way a TableMigration does when its destination overflows.
+//
+// The writer must provide:
+//     void setCell(ureg idx, Hash hash, Value value);
+//     void setFirstDelta(ureg idx, u8 delta); // deltas 0 - 3 in the CellGroup
+//     void setNextDelta(ureg idx, u8 delta);  // deltas 4 - 7 in the CellGroup
+//     bool insert(Hash hash, Value value);
+template <class Hash, class Value, class Writer>
+bool buildBulkTable(BulkEntry<Hash, Value>* entries, ureg count, ureg sizeMask, ureg linearSearchLimit, Writer& writer) {
+    ureg cursor = 0;      // The first cell not yet taken by the sweep
+    ureg numDeferred = 0; // Entries left for writer.insert(), moved to the front of the array
+    ureg i = 0;
+    while (i < count) {
+        ureg bucket = ureg(entries[i].hash) & sizeMask;
+        // Gather this bucket's run of entries, folding duplicates into their first occurrence.
+        BulkEntry<Hash, Value>* run = entries + i;
+        ureg runLength = 1;
+        for (i++; i < count && (ureg(entries[i].hash) & sizeMask) == bucket; i++) {
+            ureg j = 0;
+            while (j < runLength && run[j].hash != entries[i].hash)
+                j++;
+            if (j < runLength)
+                run[j].value = entries[i].value;
+            else
+                run[runLength++] = entries[i];
+        }
+        ureg start = turf::util::max(bucket, cursor);
+        if (start + runLength - 1 > sizeMask) {
+            for (ureg j = 0; j < runLength; j++)
+                entries[numDeferred++] = run[j];
+            continue;
+        }
+        if (start != bucket) {
+            if (start - bucket > linearSearchLimit)
+                return false;
+            writer.setFirstDelta(bucket, u8(start - bucket));
+        }
+        writer.setCell(start, run[0].hash, run[0].value);
+        for (ureg j = 1; j < runLength; j++) {
+            ureg idx = start + j;
+            if (idx - 1 == bucket)
+                writer.setFirstDelta(bucket, 1);
+            else
+                writer.setNextDelta(idx - 1, 1);
+            writer.setCell(idx, run[j].hash, run[j].value);
+        }
+        cursor = start + runLength;
+    }
+    for (ureg j = 0; j < numDeferred; j++) {
+        if (!writer.insert(entries[j].hash, entries[j].value))
+            return false;
+    }
+    return true;
+}
+
+} // namespace details
+} // namespace junction
+
+#endif // JUNCTION_DETAILS_BULKLOAD_H
@@ -23,7 +23,15 @@
 #include <turf/Heap.h>
 #include <junction/SimpleJobCoordinator.h>
 #include <junction/QSBR.h>
+#include <junction/details/MigrationStats.h>
+#include <junction/MigrationObserver.h>
+#include <junction/MapStats.h>
+#include <junction/details/BulkLoad.h>
+#include <junction/details/Snapshot.h>
 #include <memory.h>
+#if JUNCTION_TRACK_GRAMPA_STATS
+#include <turf/CPUTimer.h>
+#endif
 
 namespace junction {
 namespace details {
@@ -46,14 +54,24 @@ struct GrampaCounter {
 struct GrampaStats {
     GrampaCounter numTables;
     GrampaCounter numTableMigrations;
-    GrampaCounter numFlatTrees;
-    GrampaCounter numFlatTreeMigrations;
+    GrampaCounter numFlatTrees; // Nodes of the flattree
 
     static GrampaStats Instance; // Zero-initialized
 };
+
+// A snapshot of one leaf table, as returned by ConcurrentMap_Grampa::getLeafStats().
+struct GrampaLeafStats {
+    u64 baseHash;            // The lowest hash stored in this leaf
+    ureg rangeShift;         // The leaf covers (1 << rangeShift) hashes, or the entire hash space if it's the hash width
+    ureg size;               // Number of cells in the table
+    ureg numCellsInUse;      // Cells holding a value. Divide by size to get occupancy.
+    ureg maxProbeLength;     // Longest distance any insert probed from its hashed cell
+    ureg numMigrations;      // TableMigrations this range went through before this table was published
+    ureg numSampledAccesses; // Roughly one in AccessSamplePeriod lookups and inserts that reached this table
+};
 #endif
 
-TURF_TRACE_DECLARE(Grampa, 37)
+TURF_TRACE_DECLARE(Grampa, 36)
 
 template <class Map>
 struct Grampa {
@@ -61,18 +79,24 @@ struct Grampa {
     typedef typename Map::Value Value;
     typedef typename Map::KeyTraits KeyTraits;
     typedef typename Map::ValueTraits ValueTraits;
-
-    static const ureg RedirectFlatTree = 1;
-    static const ureg InitialSize = 8;
-    static const ureg TableMigrationUnitSize = 32;
-    static const ureg FlatTreeMigrationUnitSize = 32;
-    static const ureg LinearSearchLimit = 128;
-    static const ureg CellsInUseSample = LinearSearchLimit;
+    typedef typename Map::TuningTraits TuningTraits;
+
+    static const ureg InitialSize = TuningTraits::InitialSize;
+    static const ureg TableMigrationUnitSize = TuningTraits::TableMigrationUnitSize;
+    static const ureg MaxMigrationUnitsPerClaim = TuningTraits::MaxMigrationUnitsPerClaim;
+    static const ureg FlatTreeNodeBits = TuningTraits::FlatTreeNodeBits;
+    static const ureg LinearSearchLimit = TuningTraits::LinearSearchLimit;
+    static const ureg CellsInUseSample = TuningTraits::CellsInUseSample;
+    static const ureg ChurnSizeFactor = TuningTraits::ChurnSizeFactor;
     TURF_STATIC_ASSERT(LinearSearchLimit > 0 && LinearSearchLimit < 256);              // Must fit in CellGroup::links
     TURF_STATIC_ASSERT(CellsInUseSample > 0 && CellsInUseSample <= LinearSearchLimit); // Limit sample to failed search chain
+    TURF_STATIC_ASSERT(FlatTreeNodeBits > 0 && FlatTreeNodeBits <= 16);                // Keeps each node small enough to allocate
 
     static const ureg MinTableSize = 8;
-    static const ureg LeafSizeBits = 10;
+#if JUNCTION_TRACK_GRAMPA_STATS
+    static const ureg AccessSamplePeriod = 64;
+#endif
+    static const ureg LeafSizeBits = TuningTraits::LeafSizeBits;
     static const ureg LeafSize = (ureg(1) << LeafSizeBits);
 
     struct Cell {
@@ -93,11 +117,11 @@ struct Grampa {
     };
 
     struct Table {
-        // unsafeRangeShift determines how many slots are occupied by this Table in the flattree.
+        // unsafeRangeShift determines how many entries are occupied by this Table in its flattree node.
         // The range of hashes stored in this table is given by (1 << shift).
         // eg. If the entire map is stored in a single table, then Table::shift == HASH_BITS.
         // If the entire map is stored in two tables, then Table::shift == (HASH_BITS - 1) for each table.
-        // FlatTree::shift is always <= Table::shift for all the tables it contains.
+        // FlatTree::shift is always <= Table::shift for all the tables stored in the node's entries.
         const ureg sizeMask; // a power of two minus one
         const Hash baseHash;
         const ureg unsafeRangeShift;
@@ -105,18 +129,27 @@ struct Grampa {
             isPublished;                // To prevent publishing a subtree before its parent is published (happened in testing)
         junction::striped::Mutex mutex; // to DCLI the TableMigration (stored in the jobCoordinator)
         SimpleJobCoordinator jobCoordinator; // makes all blocked threads participate in the migration
+        SnapshotMapping* mapping;            // The snapshot file this table lies in, or NULL if it's on the heap
+#if JUNCTION_TRACK_GRAMPA_STATS
+        turf::Atomic<ureg> maxProbeLength;
+        turf::Atomic<ureg> numSampledAccesses;
+        ureg numMigrations; // Inherited from the source table + 1. Written before the table is published.
+#endif
 
         Table(ureg sizeMask, Hash baseHash, ureg unsafeRangeShift)
-            : sizeMask(sizeMask), baseHash(baseHash), unsafeRangeShift(unsafeRangeShift) {
+            : sizeMask(sizeMask), baseHash(baseHash), unsafeRangeShift(unsafeRangeShift), mapping(NULL) {
         }
 
-        static Table* create(ureg tableSize, Hash baseHash, ureg unsafeShift) {
+        static Table* create(ureg tableSize, Hash baseHash, ureg unsafeShift, Map& map) {
             TURF_ASSERT(turf::util::isPowerOf2(tableSize));
             TURF_ASSERT(unsafeShift > 0 && unsafeShift <= sizeof(Hash) * 8);
             TURF_ASSERT(tableSize >= 4);
             ureg numGroups = tableSize >> 2;
             Table* table = (Table*) TURF_HEAP.alloc(sizeof(Table) + sizeof(CellGroup) * numGroups);
             new (table) Table(tableSize - 1, baseHash, (u8) unsafeShift);
+            table->jobCoordinator.setConditionBank(map.getConditionBank());
+            table->jobCoordinator.setJobPool(&map.getJobPool());
+            table->jobCoordinator.setExpectedJobSize(tableSize);
             for (ureg i = 0; i < numGroups; i++) {
                 CellGroup* group = table->getCellGroups() + i;
                 for (ureg j = 0; j < 4; j++) {
@@ -127,6 +160,30 @@ struct Grampa {
                 }
             }
 #if JUNCTION_TRACK_GRAMPA_STATS
+            table->maxProbeLength.storeNonatomic(0);
+            table->numSampledAccesses.storeNonatomic(0);
+            table->numMigrations = 0;
+            GrampaStats::Instance.numTables.increment();
+#endif
+            return table;
+        }
+
+        // Constructs a Table header in the room that precedes a table's cells in a snapshot file. The cells are used
+        // as they are.
+        static Table* restore(u8* memory, ureg tableSize, Hash baseHash, ureg unsafeShift, Map& map, SnapshotMapping* mapping) {
+            TURF_ASSERT(turf::util::isPowerOf2(tableSize));
+            TURF_ASSERT(unsafeShift > 0 && unsafeShift <= sizeof(Hash) * 8);
+            TURF_ASSERT(tableSize >= 4);
+            Table* table = new (memory) Table(tableSize - 1, baseHash, (u8) unsafeShift);
+            table->jobCoordinator.setConditionBank(map.getConditionBank());
+            table->jobCoordinator.setJobPool(&map.getJobPool());
+            table->jobCoordinator.setExpectedJobSize(tableSize);
+            table->mapping = mapping;
+            mapping->addRef();
+#if JUNCTION_TRACK_GRAMPA_STATS
+            table->maxProbeLength.storeNonatomic(0);
+            table->numSampledAccesses.storeNonatomic(0);
+            table->numMigrations = 0;
             GrampaStats::Instance.numTables.increment();
 #endif
             return table;
@@ -136,8 +193,12 @@ struct Grampa {
 #if JUNCTION_TRACK_GRAMPA_STATS
             GrampaStats::Instance.numTables.decrement();
 #endif
+            SnapshotMapping* mapping = this->mapping;
             this->Table::~Table();
-            TURF_HEAP.free(this);
+            if (mapping)
+                mapping->release();
+            else
+                TURF_HEAP.free(this);
         }
 
         CellGroup* getCellGroups() const {
@@ -147,6 +208,27 @@ struct Grampa {
         ureg getNumMigrationUnits() const {
             return sizeMask / TableMigrationUnitSize + 1;
         }
+
+#if JUNCTION_TRACK_GRAMPA_STATS
+        // Counts every AccessSamplePeriod-th access made by the calling thread, across all tables. Like
+        // OperationScope, it uses a per-thread countdown, so unsampled accesses cost a decrement and a branch.
+        void sampleAccess() {
+            // Constant-initialized, so access needs no guard.
+            static thread_local ureg countdown = AccessSamplePeriod;
+            if (--countdown == 0) {
+                countdown = AccessSamplePeriod;
+                numSampledAccesses.fetchAdd(1, turf::Relaxed);
+            }
+        }
+
+        void recordProbeLength(ureg probeLength) {
+            ureg prevMax = maxProbeLength.load(turf::Relaxed);
+            while (probeLength > prevMax) {
+                if (maxProbeLength.compareExchangeWeak(prevMax, probeLength, turf::Relaxed, turf::Relaxed))
+                    break;
+            }
+        }
+#endif
     };
 
     class TableMigration : public SimpleJobCoordinator::Job {
@@ -170,6 +252,7 @@ struct Grampa {
         turf::Atomic<sreg> m_unitsRemaining;
         ureg m_numSources;
         ureg m_numDestinations; // The size of the subtree being created. Some table pointers may be repeated.
+        MigrationProgress m_progress;
 
         TableMigration(Map& map) : m_map(map) {
         }
@@ -183,8 +266,12 @@ struct Grampa {
             migration->m_unitsRemaining.storeNonatomic(0);
             migration->m_numSources = numSources;
             migration->m_numDestinations = numDestinations;
+            migration->m_progress.init(map.getMigrationObserver());
 #if JUNCTION_TRACK_GRAMPA_STATS
             GrampaStats::Instance.numTableMigrations.increment();
+#endif
+#if JUNCTION_TRACK_MIGRATION_STATS
+            MigrationStats::Instance.numTableMigrations.fetchAdd(1, turf::Relaxed);
 #endif
             // Caller is responsible for filling in source & destination pointers
             return migration;
@@ -218,39 +305,64 @@ struct Grampa {
             return (Table**) (getSources() + m_numSources);
         }
 
+        void notify(MigrationObserver* observer, MigrationObserver::EventType type) const {
+            ureg sourceSize = 0;
+            ureg totalUnits = 0;
+            for (ureg s = 0; s < m_numSources; s++) {
+                sourceSize += getSources()[s].table->sizeMask + 1;
+                totalUnits += getSources()[s].table->getNumMigrationUnits();
+            }
+            ureg destinationSize = 0;
+            for (ureg i = 0; i < m_numDestinations; i++) {
+                // Repeated table pointers are always adjacent.
+                if (i == 0 || getDestinations()[i] != getDestinations()[i - 1])
+                    destinationSize += getDestinations()[i]->sizeMask + 1;
+            }
+            m_progress.notify(observer, type, sourceSize, destinationSize, totalUnits - m_unitsRemaining.load(turf::Relaxed));
+        }
+
         sreg migrateRange(Table* srcTable, ureg startIdx);
         virtual void run() TURF_OVERRIDE;
     };
 
-    class FlatTreeMigration;
+    // The number of migration units a worker claims at once, given the units left in the source table and the
+    // number of workers. Claiming several units per fetchAdd keeps the shared source index from becoming a hotspot
+    // in large migrations. Claims shrink toward the end of each table so that the workers finish together.
+    static ureg getUnitsPerClaim(ureg unitsLeft, ureg numWorkers) {
+        ureg units = unitsLeft / (numWorkers * 2 + 1);
+        if (units > MaxMigrationUnitsPerClaim)
+            return MaxMigrationUnitsPerClaim;
+        return units > 0 ? units : 1;
+    }
 
+    // The flattree maps each hash to the leaf table that holds it. It's a radix tree of FlatTree nodes.
+    // Each node has (sizeMask + 1) entries, and indexes them with the bits of the hash just above shift:
+    // (hash >> shift) & sizeMask. An entry holds either a Table*, or a child FlatTree* tagged with 1.
+    // A table whose range spans several entries of a node fills all of them.
+    // A table whose range is smaller than an entry lies in a child node, which splits the entry's range FlatTreeNodeBits
+    // more ways. Nodes are never removed while the map has a flattree.
+    //
+    // Only the thread that publishes a TableMigration writes the entries that cover its source table's range, and it
+    // adds child nodes under those entries as needed. So a leaf split only touches its own part of the flattree,
+    // no matter how big the map is, and there's never a migration of the flattree itself.
     struct FlatTree {
-        // The size of the flattree is 1 << 64 - HASH_BITS.
-        // Or, stated another way, (Hash(-1) >> shift) + 1.
-        // To determine the flattree index for a given hash, we simply use: (hash >> shift)
-        // Smaller shift == more significant bits used as an index == bigger flattree.
-        // For example, the simplest flattree has only two entries, and only the most significant
-        // bit of each hash is used as the flattree index. In that case, shift == HASH_BITS - 1.
-        // Each time the flattree doubles in size, shift decreases by 1.
-        const ureg safeShift;
-        junction::striped::Mutex mutex;
-        FlatTreeMigration* migration; // Protected by mutex
-
-        FlatTree(ureg safeShift) : safeShift(safeShift), migration(NULL) {
-            // A FlatTree always has at least two tables, so the shift is always safe.
-            TURF_ASSERT(safeShift < sizeof(Hash) * 8);
-        }
-
-        static FlatTree* create(ureg safeShift) {
-            // A flattree always has at least two tables, so the shift is always safe.
-            TURF_ASSERT(safeShift < sizeof(Hash) * 8);
-            ureg numLeaves = (Hash(-1) >> safeShift) + 1;
-            FlatTree* flatTree = (FlatTree*) TURF_HEAP.alloc(sizeof(FlatTree) + sizeof(turf::Atomic<Table*>) * numLeaves);
-            new (flatTree) FlatTree(safeShift);
+        const ureg shift;
+        const ureg sizeMask;
+
+        FlatTree(ureg shift, ureg sizeMask) : shift(shift), sizeMask(sizeMask) {
+            // A node always has at least two entries, so the shift is always safe.
+            TURF_ASSERT(shift < sizeof(Hash) * 8);
+        }
+
+        static FlatTree* create(ureg shift, ureg sizeBits) {
+            TURF_ASSERT(sizeBits > 0 && shift + sizeBits <= sizeof(Hash) * 8);
+            ureg size = ureg(1) << sizeBits;
+            FlatTree* flatTree = (FlatTree*) TURF_HEAP.alloc(sizeof(FlatTree) + sizeof(turf::Atomic<uptr>) * size);
+            new (flatTree) FlatTree(shift, size - 1);
 #if JUNCTION_TRACK_GRAMPA_STATS
             GrampaStats::Instance.numFlatTrees.increment();
 #endif
-            // Caller will initialize flatTree->getTables()
+            // Caller will initialize flatTree->getEntries()
             return flatTree;
         }
 
@@ -262,63 +374,28 @@ struct Grampa {
             TURF_HEAP.free(this);
         }
 
-        turf::Atomic<Table*>* getTables() const {
-            return (turf::Atomic<Table*>*) (this + 1);
+        turf::Atomic<uptr>* getEntries() const {
+            return (turf::Atomic<uptr>*) (this + 1);
         }
 
         ureg getSize() const {
-            return (Hash(-1) >> safeShift) + 1;
-        }
-
-        ureg getNumMigrationUnits() const {
-            ureg sizeMask = Hash(-1) >> safeShift;
-            return sizeMask / FlatTreeMigrationUnitSize + 1;
+            return sizeMask + 1;
         }
     };
 
-    class FlatTreeMigration : public SimpleJobCoordinator::Job {
-    public:
-        Map& m_map;
-        FlatTree* m_source;
-        FlatTree* m_destination;
-        turf::Atomic<ureg> m_workerStatus;
-        turf::Atomic<ureg> m_sourceIndex;
-        turf::Atomic<sreg> m_unitsRemaining;
-        junction::striped::ManualResetEvent m_completed;
-
-        FlatTreeMigration(Map& map, FlatTree* flatTree, ureg shift) : m_map(map) {
-            m_source = flatTree;
-            m_destination = FlatTree::create(shift);
-            m_workerStatus.storeNonatomic(0);
-            m_sourceIndex.storeNonatomic(0);
-            m_unitsRemaining.storeNonatomic(flatTree->getNumMigrationUnits());
-#if JUNCTION_TRACK_GRAMPA_STATS
-            GrampaStats::Instance.numFlatTreeMigrations.increment();
-#endif
-        }
-
-        virtual ~FlatTreeMigration() TURF_OVERRIDE {
-#if JUNCTION_TRACK_GRAMPA_STATS
-            GrampaStats::Instance.numFlatTreeMigrations.decrement();
-#endif
-            // Delete source flattree.
-            m_source->destroy();
-        }
-
-        void destroy() {
-            delete this;
-        }
-
-        virtual void run() TURF_OVERRIDE;
-    };
-
     static void garbageCollectTable(Table* table) {
         TURF_ASSERT(table);
         DefaultQSBR.enqueue(&Table::destroy, table);
     }
 
+    // Queues flatTree and all of its child nodes for GC, but not the tables in them.
     static void garbageCollectFlatTree(FlatTree* flatTree) {
         TURF_ASSERT(flatTree);
+        for (ureg i = 0; i < flatTree->getSize(); i++) {
+            uptr entry = flatTree->getEntries()[i].load(turf::Relaxed);
+            if (entry & 1)
+                garbageCollectFlatTree((FlatTree*) (entry & ~uptr(1)));
+        }
         DefaultQSBR.enqueue(&FlatTree::destroy, flatTree);
     }
 
@@ -436,6 +513,9 @@ struct Grampa {
                             TURF_ASSERT(probeDelta == 0 || probeDelta == desiredDelta);
 #else
                             prevLink->store(desiredDelta, turf::Relaxed);
+#endif
+#if JUNCTION_TRACK_GRAMPA_STATS
+                            table->recordProbeLength(idx - ureg(hash));
 #endif
                             return InsertResult_InsertedNew;
                         } else {
@@ -477,6 +557,129 @@ struct Grampa {
         }
     }
 
+    // Lets details::buildBulkTable() fill a table that isn't visible to other threads yet.
+    struct BulkWriter {
+        Table* table;
+
+        BulkWriter(Table* table) : table(table) {
+        }
+
+        void setCell(ureg idx, Hash hash, Value value) {
+            Cell* cell = table->getCellGroups()[idx >> 2].cells + (idx & 3);
+            cell->hash.storeNonatomic(hash);
+            cell->value.storeNonatomic(value);
+        }
+
+        void setFirstDelta(ureg idx, u8 delta) {
+            table->getCellGroups()[idx >> 2].deltas[idx & 3].storeNonatomic(delta);
+        }
+
+        void setNextDelta(ureg idx, u8 delta) {
+            table->getCellGroups()[idx >> 2].deltas[(idx & 3) + 4].storeNonatomic(delta);
+        }
+
+        bool insert(Hash hash, Value value) {
+            Cell* cell;
+            ureg overflowIdx;
+            if (insertOrFind(hash, table, table->sizeMask, cell, overflowIdx) == InsertResult_Overflow)
+                return false;
+            cell->value.storeNonatomic(value);
+            return true;
+        }
+    };
+
+    static SnapshotLayout getSnapshotLayout() {
+        SnapshotLayout layout = {SnapshotMap_Grampa, sizeof(Hash), sizeof(Value), sizeof(CellGroup), sizeof(Table)};
+        return layout;
+    }
+
+    // Writes the room for the Table header, then the cells, starting at offset in the snapshot file.
+    static void saveTable(SnapshotWriter& writer, Table* table, u64 offset) {
+        writer.padTo(offset + sizeof(Table));
+        writer.write(table->getCellGroups(), sizeof(CellGroup) * ((table->sizeMask + 1) >> 2));
+    }
+
+    // Orders bulk entries by leaf, then by bucket within the leaf, for a flattree with the given safeShift.
+    struct BulkLeafBucket {
+        ureg safeShift;
+
+        BulkLeafBucket(ureg safeShift) : safeShift(safeShift) {
+        }
+
+        ureg operator()(Hash hash) const {
+            return (ureg(hash >> safeShift) << LeafSizeBits) | (ureg(hash) & (LeafSize - 1));
+        }
+    };
+
+    // Adds the buckets of table chosen by sampleSize to stats. See MapStats.
+    static void collectTableStats(Table* table, ureg sampleSize, MapStats& stats) {
+        ureg sizeMask = table->sizeMask;
+        ureg startIdx = MapStats::chooseSampleStart(sampleSize, sizeMask);
+        stats.numTables++;
+        stats.capacity += sizeMask + 1;
+        stats.bytesUsed += sizeof(Table) + sizeof(CellGroup) * ((sizeMask + 1) >> 2);
+        for (ureg i = 0; i < sampleSize; i++) {
+            ureg bucketIdx = (startIdx + i) & sizeMask;
+            CellGroup* group = table->getCellGroups() + (bucketIdx >> 2);
+            Cell* cell = group->cells + (bucketIdx & 3);
+            stats.numCellsScanned++;
+            Hash hash = cell->hash.load(turf::Relaxed);
+            if (hash != KeyTraits::NullHash) {
+                Value value = cell->value.load(turf::Relaxed);
+                if (value == Value(ValueTraits::NullValue)) {
+                    stats.numTombstones++;
+                } else if (value != Value(ValueTraits::Redirect)) {
+                    stats.numCellsInUse++;
+                    if ((hash & sizeMask) == bucketIdx)
+                        stats.addProbe(0);
+                }
+            }
+            // Follow the probe chain for this bucket. Every linked cell belongs to the bucket.
+            // Links are never removed from a table, so the chain is well-formed even while other threads insert.
+            ureg idx = bucketIdx;
+            u8 delta = group->deltas[idx & 3].load(turf::Relaxed);
+            for (ureg probes = 1; delta && probes <= sizeMask; probes++) {
+                idx = (idx + delta) & sizeMask;
+                group = table->getCellGroups() + (idx >> 2);
+                cell = group->cells + (idx & 3);
+                Value value = cell->value.load(turf::Relaxed);
+                if (value != Value(ValueTraits::NullValue) && value != Value(ValueTraits::Redirect))
+                    stats.addProbe(probes);
+                delta = group->deltas[(idx & 3) + 4].load(turf::Relaxed);
+            }
+        }
+    }
+
+    // Appends the live cells in the given bucket to entries, for the map's snapshot().
+    // Returns false, leaving entries partially appended, if a Redirect was found, ie. the table is being migrated.
+    static bool collectBucket(Table* table, ureg bucketIdx, std::vector<BulkEntry<Hash, Value>>& entries) {
+        ureg sizeMask = table->sizeMask;
+        ureg idx = bucketIdx;
+        CellGroup* group = table->getCellGroups() + (idx >> 2);
+        Cell* cell = group->cells + (idx & 3);
+        u8 delta = group->deltas[idx & 3].load(turf::Relaxed);
+        for (ureg probes = 0;; probes++) {
+            // Load the value first, so that if it's live, the hash it was stored with is visible too.
+            Value value = cell->value.load(turf::Acquire);
+            if (value == Value(ValueTraits::Redirect))
+                return false;
+            Hash hash = cell->hash.load(turf::Relaxed);
+            // The hashed cell might belong to another bucket. Every linked cell belongs to this one.
+            if (value != Value(ValueTraits::NullValue) && hash != KeyTraits::NullHash && (hash & sizeMask) == bucketIdx) {
+                BulkEntry<Hash, Value> entry;
+                entry.hash = hash;
+                entry.value = value;
+                entries.push_back(entry);
+            }
+            if (!delta || probes >= sizeMask)
+                return true;
+            idx = (idx + delta) & sizeMask;
+            group = table->getCellGroups() + (idx >> 2);
+            cell = group->cells + (idx & 3);
+            delta = group->deltas[(idx & 3) + 4].load(turf::Relaxed);
+        }
+    }
+
     static void beginTableMigrationToSize(Map& map, Table* table, ureg nextTableSize, ureg splitShift) {
         // Create new migration by DCLI.
         TURF_TRACE(Grampa, 15, "[beginTableMigrationToSize] called", 0, 0);
@@ -503,10 +706,14 @@ struct Grampa {
                 ureg hashOffsetDelta = subRangeShift < (sizeof(Hash) * 8) ? (ureg(1) << subRangeShift) : 0;
                 for (ureg i = 0; i < numDestinations; i++) {
                     migration->getDestinations()[i] =
-                        Table::create(nextTableSize, table->baseHash + hashOffsetDelta * i, subRangeShift);
+                        Table::create(nextTableSize, table->baseHash + hashOffsetDelta * i, subRangeShift, map);
                 }
-                // Publish the new migration.
+                if (MigrationObserver* observer = map.getMigrationObserver())
+                    migration->notify(observer, MigrationObserver::TableMigrationBegin);
+                // Publish the new migration. It's posted to the map's JobPool while holding table->mutex, so that the last
+                // worker, which retires it while holding the same mutex, can't run ahead of the post.
                 table->jobCoordinator.storeRelease(migration);
+                map.getJobPool().post(migration);
             }
         }
     }
@@ -516,6 +723,7 @@ struct Grampa {
         ureg sizeMask = table->sizeMask;
         ureg idx = overflowIdx - CellsInUseSample;
         ureg inUseCells = 0;
+        ureg erasedCells = 0;
         for (ureg linearProbesRemaining = CellsInUseSample; linearProbesRemaining > 0; linearProbesRemaining--) {
             CellGroup* group = table->getCellGroups() + ((idx & sizeMask) >> 2);
             Cell* cell = group->cells + (idx & 3);
@@ -527,11 +735,21 @@ struct Grampa {
             }
             if (value != Value(ValueTraits::NullValue))
                 inUseCells++;
+            else if (cell->hash.load(turf::Relaxed) != KeyTraits::NullHash)
+                erasedCells++;
             idx++;
         }
         float inUseRatio = float(inUseCells) / CellsInUseSample;
         float estimatedInUse = (sizeMask + 1) * inUseRatio;
         ureg nextTableSize = turf::util::roundUpPowerOf2(ureg(estimatedInUse * 2));
+        // Erased cells can't be handed to other keys, so under insert/erase churn, each migration only buys as many
+        // inserts as the new table has free cells. When erased cells outnumber live ones, the table overflowed from
+        // churn rather than growth, so size the new table at ChurnSizeFactor times the live cells instead of twice.
+        // That's only worth it up to LeafSize: splitting a leaf doesn't leave its halves any more free cells per key.
+        if (erasedCells > inUseCells && nextTableSize < LeafSize) {
+            ureg churnSize = turf::util::roundUpPowerOf2(ureg(estimatedInUse * ChurnSizeFactor));
+            nextTableSize = turf::util::min(churnSize, LeafSize);
+        }
         // FIXME: Support migrating to smaller tables.
         nextTableSize = turf::util::max(nextTableSize, sizeMask + 1);
         // Split into multiple tables if necessary.
@@ -542,20 +760,6 @@ struct Grampa {
         }
         beginTableMigrationToSize(map, table, nextTableSize, splitShift);
     }
-
-    static FlatTreeMigration* createFlatTreeMigration(Map& map, FlatTree* flatTree, ureg shift) {
-        turf::LockGuard<junction::striped::Mutex> guard(flatTree->mutex);
-        if (!flatTree->migration) {
-            flatTree->migration = new FlatTreeMigration(map, flatTree, shift);
-        }
-        return flatTree->migration;
-    }
-
-    static FlatTreeMigration* getExistingFlatTreeMigration(FlatTree* flatTree) {
-        turf::LockGuard<junction::striped::Mutex> guard(flatTree->mutex);
-        TURF_ASSERT(flatTree->migration); // Must already exist!
-        return flatTree->migration;
-    }
 }; // Grampa
 
 // Return index of the destination table that overflowed, or -1 if none
@@ -673,21 +877,35 @@ void Grampa<Map>::TableMigration::run() {
     } while (!m_workerStatus.compareExchangeWeak(probeStatus, probeStatus + 2, turf::Relaxed, turf::Relaxed));
     // # of workers has been incremented, and the end flag is clear.
     TURF_ASSERT((probeStatus & 1) == 0);
+    MigrationObserver* observer = m_map.getMigrationObserver();
+    MigrationProgress::WorkStart workStart;
+    if (observer)
+        workStart = m_progress.beginWork((probeStatus >> 1) + 1);
 
     // Iterate over all source tables.
     Source* sources = getSources();
     for (ureg s = 0; s < m_numSources; s++) {
         Source& source = sources[s];
-        // Loop over all migration units in this source table.
+        ureg srcSize = source.table->sizeMask + 1;
+        ureg unitsPerClaim = 1;
+        // Loop over all migration units in this source table, claiming one or more at a time.
         for (;;) {
-            if (m_workerStatus.load(turf::Relaxed) & 1) {
+            ureg status = m_workerStatus.load(turf::Relaxed);
+            if (status & 1) {
                 TURF_TRACE(Grampa, 27, "[TableMigration::run] detected end flag set", uptr(this), 0);
                 goto endMigration;
             }
-            ureg startIdx = source.sourceIndex.fetchAdd(TableMigrationUnitSize, turf::Relaxed);
-            if (startIdx >= source.table->sizeMask + 1)
+            ureg claimIdx = source.sourceIndex.fetchAdd(unitsPerClaim * TableMigrationUnitSize, turf::Relaxed);
+            if (claimIdx >= srcSize)
                 break; // No more migration units in this table. Try next source table.
-            sreg overflowTableIndex = migrateRange(source.table, startIdx);
+            ureg endIdx = turf::util::min(claimIdx + unitsPerClaim * TableMigrationUnitSize, srcSize);
+            ureg startIdx = claimIdx;
+            sreg overflowTableIndex = -1;
+            for (; startIdx < endIdx; startIdx += TableMigrationUnitSize) {
+                overflowTableIndex = migrateRange(source.table, startIdx);
+                if (overflowTableIndex >= 0)
+                    break;
+            }
             if (overflowTableIndex >= 0) {
                 // *** FAILED MIGRATION ***
                 // TableMigration failed due to destination table overflow.
@@ -706,19 +924,23 @@ void Grampa<Map>::TableMigration::run() {
                 m_workerStatus.fetchOr(1, turf::Relaxed);
                 goto endMigration;
             }
-            sreg prevRemaining = m_unitsRemaining.fetchSub(1, turf::Relaxed);
-            TURF_ASSERT(prevRemaining > 0);
-            if (prevRemaining == 1) {
+            ureg numUnits = (endIdx - claimIdx - 1) / TableMigrationUnitSize + 1;
+            sreg prevRemaining = m_unitsRemaining.fetchSub(numUnits, turf::Relaxed);
+            TURF_ASSERT(prevRemaining >= sreg(numUnits));
+            if (prevRemaining == sreg(numUnits)) {
                 // *** SUCCESSFUL MIGRATION ***
                 // That was the last chunk to migrate.
                 m_workerStatus.fetchOr(1, turf::Relaxed);
                 goto endMigration;
             }
+            unitsPerClaim = getUnitsPerClaim((srcSize - endIdx) / TableMigrationUnitSize, status >> 1);
         }
     }
     TURF_TRACE(Grampa, 30, "[TableMigration::run] out of migration units", uptr(this), 0);
 
 endMigration:
+    if (observer)
+        m_progress.endWork(workStart);
     // Decrement the shared # of workers.
     probeStatus =
         m_workerStatus.fetchSub(2, turf::AcquireRelease); // Ensure all modifications are visible to the thread that will publish
@@ -731,14 +953,31 @@ endMigration:
     // We're the very last worker thread.
     // Perform the appropriate post-migration step depending on whether the migration succeeded or failed.
     TURF_ASSERT(probeStatus == 3);
+    {
+        // Stop other threads from picking up this migration through the JobPool. The mutex orders this after the post.
+        turf::LockGuard<junction::striped::Mutex> guard(sources[0].table->mutex);
+        m_map.getJobPool().retire(this);
+    }
     sreg overflowTableIndex = m_overflowTableIndex.loadNonatomic(); // No racing writes at this point
     if (overflowTableIndex < 0) {
         // The migration succeeded. This is the most likely outcome. Publish the new subtree.
+#if JUNCTION_TRACK_GRAMPA_STATS
+        // The destinations hold hashes from every source, so they inherit the longest history among them.
+        ureg numMigrations = 0;
+        for (ureg s = 0; s < m_numSources; s++)
+            numMigrations = turf::util::max(numMigrations, sources[s].table->numMigrations);
+        for (ureg i = 0; i < m_numDestinations; i++)
+            getDestinations()[i]->numMigrations = numMigrations + 1;
+#endif
         m_map.publishTableMigration(this);
         // End the jobCoodinator.
         sources[0].table->jobCoordinator.end();
+        if (observer)
+            notify(observer, MigrationObserver::TableMigrationPublish);
     } else {
         // The migration failed due to the overflow of a destination table.
+        if (observer)
+            notify(observer, MigrationObserver::TableMigrationRetry);
         Table* origTable = sources[0].table;
         ureg count = ureg(1) << (origTable->unsafeRangeShift - getUnsafeShift());
         ureg lo = overflowTableIndex & ~(count - 1);
@@ -764,7 +1003,7 @@ endMigration:
                 migration->m_safeShift = 0;
                 // Double the destination table size.
                 migration->getDestinations()[0] = Table::create((overflowedTable->sizeMask + 1) * 2, overflowedTable->baseHash,
-                                                                overflowedTable->unsafeRangeShift);
+                                                                overflowedTable->unsafeRangeShift, m_map);
             } else {
                 // The overflowed table is already the size of a leaf. Split it into two ranges.
                 if (count == 1) {
@@ -786,14 +1025,14 @@ endMigration:
                     migration->m_safeShift = m_safeShift;
                     memcpy(migration->getDestinations(), getDestinations(), m_numDestinations * sizeof(Table*));
                 }
-                Table* splitTable1 = Table::create(LeafSize, origTable->baseHash, origTable->unsafeRangeShift - 1);
+                Table* splitTable1 = Table::create(LeafSize, origTable->baseHash, origTable->unsafeRangeShift - 1, m_map);
                 ureg i = 0;
                 for (; i < count / 2; i++) {
                     migration->getDestinations()[lo + i] = splitTable1;
                 }
                 ureg halfNumHashes = ureg(1) << (origTable->unsafeRangeShift - 1);
                 Table* splitTable2 =
-                    Table::create(LeafSize, origTable->baseHash + halfNumHashes, origTable->unsafeRangeShift - 1);
+                    Table::create(LeafSize, origTable->baseHash + halfNumHashes, origTable->unsafeRangeShift - 1, m_map);
                 for (; i < count; i++) {
                     migration->getDestinations()[lo + i] = splitTable2;
                 }
@@ -813,6 +1052,7 @@ endMigration:
             migration->m_unitsRemaining.storeNonatomic(unitsRemaining);
             // Publish the new migration.
             origTable->jobCoordinator.storeRelease(migration);
+            m_map.getJobPool().post(migration);
         }
     }
 
@@ -820,70 +1060,6 @@ endMigration:
     DefaultQSBR.enqueue(&TableMigration::destroy, this);
 }
 
-template <class Map>
-void Grampa<Map>::FlatTreeMigration::run() {
-    // Conditionally increment the shared # of workers.
-    ureg probeStatus = m_workerStatus.load(turf::Relaxed);
-    do {
-        if (probeStatus & 1) {
-            // End flag is already set, so do nothing.
-            TURF_TRACE(Grampa, 36, "[FlatTreeMigration::run] already ended", uptr(this), 0);
-            return;
-        }
-    } while (!m_workerStatus.compareExchangeWeak(probeStatus, probeStatus + 2, turf::Relaxed, turf::Relaxed));
-    // # of workers has been incremented, and the end flag is clear.
-    TURF_ASSERT((probeStatus & 1) == 0);
-
-    // Loop over all migration units
-    ureg srcSize = (Hash(-1) >> m_source->safeShift) + 1;
-    // FIXME: Support migration to smaller flattrees
-    TURF_ASSERT(m_destination->safeShift < m_source->safeShift);
-    ureg repeat = ureg(1) << (m_source->safeShift - m_destination->safeShift);
-    for (;;) {
-        ureg srcStart = m_sourceIndex.fetchAdd(FlatTreeMigrationUnitSize, turf::Relaxed);
-        if (srcStart >= srcSize)
-            break; // No more migration units in this flattree.
-        // Migrate this range
-        ureg srcEnd = turf::util::min(srcSize, srcStart + FlatTreeMigrationUnitSize);
-        ureg dst = srcStart * repeat;
-        for (ureg src = srcStart; src < srcEnd; src++) {
-            // Pointers in the source table can be changed at any time due to concurrent subtree publishing,
-            // so we need to exchange them with Redirect markers.
-            Table* t = m_source->getTables()[src].exchange((Table*) RedirectFlatTree, turf::Relaxed);
-            TURF_ASSERT(uptr(t) != RedirectFlatTree);
-            for (ureg r = repeat; r > 0; r--) {
-                m_destination->getTables()[dst].storeNonatomic(t);
-                dst++;
-            }
-        }
-        // Decrement m_unitsRemaining
-        sreg prevRemaining = m_unitsRemaining.fetchSub(1, turf::Relaxed);
-        if (prevRemaining == 1) {
-            // *** SUCCESSFUL MIGRATION ***
-            // That was the last chunk to migrate.
-            m_workerStatus.fetchOr(1, turf::Relaxed);
-            break;
-        }
-    }
-
-    // Decrement the shared # of workers.
-    probeStatus = m_workerStatus.fetchSub(
-        2, turf::AcquireRelease); // AcquireRelease makes all previous writes visible to the last worker thread.
-    if (probeStatus >= 4) {
-        // There are other workers remaining. Return here so that only the very last worker will proceed.
-        return;
-    }
-
-    // We're the very last worker thread.
-    // Publish the new flattree.
-    TURF_ASSERT(probeStatus == 3); // End flag must be set
-    m_map.publishFlatTreeMigration(this);
-    m_completed.signal();
-
-    // We're done with this FlatTreeMigration. Queue it for GC.
-    DefaultQSBR.enqueue(&FlatTreeMigration::destroy, this);
-}
-
 } // namespace details
 } // namespace junction
 
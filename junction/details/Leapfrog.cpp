@@ -17,7 +17,7 @@
 namespace junction {
 namespace details {
 
-TURF_TRACE_DEFINE_BEGIN(Leapfrog, 33) // autogenerated by TidySource.py
+TURF_TRACE_DEFINE_BEGIN(Leapfrog, 34) // autogenerated by TidySource.py
 TURF_TRACE_DEFINE("[find] called")
 TURF_TRACE_DEFINE("[find] found existing cell optimistically")
 TURF_TRACE_DEFINE("[find] found existing cell")
@@ -42,6 +42,7 @@ TURF_TRACE_DEFINE("[migrateRange] race to insert key")
 TURF_TRACE_DEFINE("[migrateRange] race to insert value")
 TURF_TRACE_DEFINE("[migrateRange] race inserted Redirect")
 TURF_TRACE_DEFINE("[migrateRange] in-use cell already redirected")
+TURF_TRACE_DEFINE("[migrateRange] dropped filtered value")
 TURF_TRACE_DEFINE("[migrateRange] racing update was erase")
 TURF_TRACE_DEFINE("[migrateRange] race to update migrated value")
 TURF_TRACE_DEFINE("[TableMigration::run] already ended")
@@ -51,7 +52,7 @@ TURF_TRACE_DEFINE("[TableMigration::run] race to set m_overflowed")
 TURF_TRACE_DEFINE("[TableMigration::run] out of migration units")
 TURF_TRACE_DEFINE("[TableMigration::run] not the last worker")
 TURF_TRACE_DEFINE("[TableMigration::run] a new TableMigration was already started")
-TURF_TRACE_DEFINE_END(Leapfrog, 33)
+TURF_TRACE_DEFINE_END(Leapfrog, 34)
 
 } // namespace details
 } // namespace junction
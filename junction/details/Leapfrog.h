@@ -23,11 +23,16 @@
 #include <turf/Heap.h>
 #include <junction/SimpleJobCoordinator.h>
 #include <junction/QSBR.h>
+#include <junction/details/MigrationStats.h>
+#include <junction/MigrationObserver.h>
+#include <junction/MapStats.h>
+#include <junction/details/BulkLoad.h>
+#include <junction/details/Snapshot.h>
 
 namespace junction {
 namespace details {
 
-TURF_TRACE_DECLARE(Leapfrog, 33)
+TURF_TRACE_DECLARE(Leapfrog, 34)
 
 template <class Map>
 struct Leapfrog {
@@ -35,11 +40,14 @@ struct Leapfrog {
     typedef typename Map::Value Value;
     typedef typename Map::KeyTraits KeyTraits;
     typedef typename Map::ValueTraits ValueTraits;
-
-    static const ureg InitialSize = 8;
-    static const ureg TableMigrationUnitSize = 32;
-    static const ureg LinearSearchLimit = 128;
-    static const ureg CellsInUseSample = LinearSearchLimit;
+    typedef typename Map::TuningTraits TuningTraits;
+
+    static const ureg InitialSize = TuningTraits::InitialSize;
+    static const ureg TableMigrationUnitSize = TuningTraits::TableMigrationUnitSize;
+    static const ureg MaxMigrationUnitsPerClaim = TuningTraits::MaxMigrationUnitsPerClaim;
+    static const ureg LinearSearchLimit = TuningTraits::LinearSearchLimit;
+    static const ureg CellsInUseSample = TuningTraits::CellsInUseSample;
+    static const ureg ChurnSizeFactor = TuningTraits::ChurnSizeFactor;
     TURF_STATIC_ASSERT(LinearSearchLimit > 0 && LinearSearchLimit < 256);              // Must fit in CellGroup::links
     TURF_STATIC_ASSERT(CellsInUseSample > 0 && CellsInUseSample <= LinearSearchLimit); // Limit sample to failed search chain
 
@@ -63,16 +71,19 @@ struct Leapfrog {
         const ureg sizeMask;                 // a power of two minus one
         turf::Mutex mutex;                   // to DCLI the TableMigration (stored in the jobCoordinator)
         SimpleJobCoordinator jobCoordinator; // makes all blocked threads participate in the migration
+        SnapshotMapping* mapping;            // The snapshot file this table lies in, or NULL if it's on the heap
 
-        Table(ureg sizeMask) : sizeMask(sizeMask) {
+        Table(ureg sizeMask) : sizeMask(sizeMask), mapping(NULL) {
         }
 
-        static Table* create(ureg tableSize) {
+        static Table* create(ureg tableSize, junction::striped::ConditionBank* conditionBank) {
             TURF_ASSERT(turf::util::isPowerOf2(tableSize));
             TURF_ASSERT(tableSize >= 4);
             ureg numGroups = tableSize >> 2;
             Table* table = (Table*) TURF_HEAP.alloc(sizeof(Table) + sizeof(CellGroup) * numGroups);
             new (table) Table(tableSize - 1);
+            table->jobCoordinator.setConditionBank(conditionBank);
+            table->jobCoordinator.setExpectedJobSize(tableSize);
             for (ureg i = 0; i < numGroups; i++) {
                 CellGroup* group = table->getCellGroups() + i;
                 for (ureg j = 0; j < 4; j++) {
@@ -85,9 +96,27 @@ struct Leapfrog {
             return table;
         }
 
+        // Constructs a Table header in the room that precedes a table's cells in a snapshot file. The cells are used
+        // as they are.
+        static Table* restore(u8* memory, ureg tableSize, junction::striped::ConditionBank* conditionBank,
+                              SnapshotMapping* mapping) {
+            TURF_ASSERT(turf::util::isPowerOf2(tableSize));
+            TURF_ASSERT(tableSize >= 4);
+            Table* table = new (memory) Table(tableSize - 1);
+            table->jobCoordinator.setConditionBank(conditionBank);
+            table->jobCoordinator.setExpectedJobSize(tableSize);
+            table->mapping = mapping;
+            mapping->addRef();
+            return table;
+        }
+
         void destroy() {
+            SnapshotMapping* mapping = this->mapping;
             this->Table::~Table();
-            TURF_HEAP.free(this);
+            if (mapping)
+                mapping->release();
+            else
+                TURF_HEAP.free(this);
         }
 
         CellGroup* getCellGroups() const {
@@ -112,6 +141,7 @@ struct Leapfrog {
         turf::Atomic<bool> m_overflowed;
         turf::Atomic<sreg> m_unitsRemaining;
         ureg m_numSources;
+        MigrationProgress m_progress;
 
         TableMigration(Map& map) : m_map(map) {
         }
@@ -124,6 +154,10 @@ struct Leapfrog {
             migration->m_overflowed.storeNonatomic(false);
             migration->m_unitsRemaining.storeNonatomic(0);
             migration->m_numSources = numSources;
+            migration->m_progress.init(map.getMigrationObserver());
+#if JUNCTION_TRACK_MIGRATION_STATS
+            MigrationStats::Instance.numTableMigrations.fetchAdd(1, turf::Relaxed);
+#endif
             // Caller is responsible for filling in sources & destination
             return migration;
         }
@@ -145,10 +179,31 @@ struct Leapfrog {
             return (Source*) (this + 1);
         }
 
+        void notify(MigrationObserver* observer, MigrationObserver::EventType type) const {
+            ureg sourceSize = 0;
+            ureg totalUnits = 0;
+            for (ureg s = 0; s < m_numSources; s++) {
+                sourceSize += getSources()[s].table->sizeMask + 1;
+                totalUnits += getSources()[s].table->getNumMigrationUnits();
+            }
+            m_progress.notify(observer, type, sourceSize, m_destination->sizeMask + 1,
+                              totalUnits - m_unitsRemaining.load(turf::Relaxed));
+        }
+
         bool migrateRange(Table* srcTable, ureg startIdx);
         virtual void run() TURF_OVERRIDE;
     };
 
+    // The number of migration units a worker claims at once, given the units left in the source table and the
+    // number of workers. Claiming several units per fetchAdd keeps the shared source index from becoming a hotspot
+    // in large migrations. Claims shrink toward the end of each table so that the workers finish together.
+    static ureg getUnitsPerClaim(ureg unitsLeft, ureg numWorkers) {
+        ureg units = unitsLeft / (numWorkers * 2 + 1);
+        if (units > MaxMigrationUnitsPerClaim)
+            return MaxMigrationUnitsPerClaim;
+        return units > 0 ? units : 1;
+    }
+
     static Cell* find(Hash hash, Table* table) {
         TURF_TRACE(Leapfrog, 0, "[find] called", uptr(table), hash);
         TURF_ASSERT(table);
@@ -305,6 +360,117 @@ struct Leapfrog {
         }
     }
 
+    // Lets details::buildBulkTable() fill a table that isn't visible to other threads yet.
+    struct BulkWriter {
+        Table* table;
+
+        BulkWriter(Table* table) : table(table) {
+        }
+
+        void setCell(ureg idx, Hash hash, Value value) {
+            Cell* cell = table->getCellGroups()[idx >> 2].cells + (idx & 3);
+            cell->hash.storeNonatomic(hash);
+            cell->value.storeNonatomic(value);
+        }
+
+        void setFirstDelta(ureg idx, u8 delta) {
+            table->getCellGroups()[idx >> 2].deltas[idx & 3].storeNonatomic(delta);
+        }
+
+        void setNextDelta(ureg idx, u8 delta) {
+            table->getCellGroups()[idx >> 2].deltas[(idx & 3) + 4].storeNonatomic(delta);
+        }
+
+        bool insert(Hash hash, Value value) {
+            Cell* cell;
+            ureg overflowIdx;
+            if (insertOrFind(hash, table, cell, overflowIdx) == InsertResult_Overflow)
+                return false;
+            cell->value.storeNonatomic(value);
+            return true;
+        }
+    };
+
+    static SnapshotLayout getSnapshotLayout() {
+        SnapshotLayout layout = {SnapshotMap_Leapfrog, sizeof(Hash), sizeof(Value), sizeof(CellGroup), sizeof(Table)};
+        return layout;
+    }
+
+    // Writes the room for the Table header, then the cells, starting at offset in the snapshot file.
+    static void saveTable(SnapshotWriter& writer, Table* table, u64 offset) {
+        writer.padTo(offset + sizeof(Table));
+        writer.write(table->getCellGroups(), sizeof(CellGroup) * ((table->sizeMask + 1) >> 2));
+    }
+
+    // Adds the buckets of table chosen by sampleSize to stats. See MapStats.
+    static void collectTableStats(Table* table, ureg sampleSize, MapStats& stats) {
+        ureg sizeMask = table->sizeMask;
+        ureg startIdx = MapStats::chooseSampleStart(sampleSize, sizeMask);
+        stats.numTables++;
+        stats.capacity += sizeMask + 1;
+        stats.bytesUsed += sizeof(Table) + sizeof(CellGroup) * ((sizeMask + 1) >> 2);
+        for (ureg i = 0; i < sampleSize; i++) {
+            ureg bucketIdx = (startIdx + i) & sizeMask;
+            CellGroup* group = table->getCellGroups() + (bucketIdx >> 2);
+            Cell* cell = group->cells + (bucketIdx & 3);
+            stats.numCellsScanned++;
+            Hash hash = cell->hash.load(turf::Relaxed);
+            if (hash != KeyTraits::NullHash) {
+                Value value = cell->value.load(turf::Relaxed);
+                if (value == Value(ValueTraits::NullValue)) {
+                    stats.numTombstones++;
+                } else if (value != Value(ValueTraits::Redirect)) {
+                    stats.numCellsInUse++;
+                    if ((hash & sizeMask) == bucketIdx)
+                        stats.addProbe(0);
+                }
+            }
+            // Follow the probe chain for this bucket. Every linked cell belongs to the bucket.
+            // Links are never removed from a table, so the chain is well-formed even while other threads insert.
+            ureg idx = bucketIdx;
+            u8 delta = group->deltas[idx & 3].load(turf::Relaxed);
+            for (ureg probes = 1; delta && probes <= sizeMask; probes++) {
+                idx = (idx + delta) & sizeMask;
+                group = table->getCellGroups() + (idx >> 2);
+                cell = group->cells + (idx & 3);
+                Value value = cell->value.load(turf::Relaxed);
+                if (value != Value(ValueTraits::NullValue) && value != Value(ValueTraits::Redirect))
+                    stats.addProbe(probes);
+                delta = group->deltas[(idx & 3) + 4].load(turf::Relaxed);
+            }
+        }
+    }
+
+    // Appends the live cells in the given bucket to entries, for the map's snapshot().
+    // Returns false, leaving entries partially appended, if a Redirect was found, ie. the table is being migrated.
+    static bool collectBucket(Table* table, ureg bucketIdx, std::vector<BulkEntry<Hash, Value>>& entries) {
+        ureg sizeMask = table->sizeMask;
+        ureg idx = bucketIdx;
+        CellGroup* group = table->getCellGroups() + (idx >> 2);
+        Cell* cell = group->cells + (idx & 3);
+        u8 delta = group->deltas[idx & 3].load(turf::Relaxed);
+        for (ureg probes = 0;; probes++) {
+            // Load the value first, so that if it's live, the hash it was stored with is visible too.
+            Value value = cell->value.load(turf::Acquire);
+            if (value == Value(ValueTraits::Redirect))
+                return false;
+            Hash hash = cell->hash.load(turf::Relaxed);
+            // The hashed cell might belong to another bucket. Every linked cell belongs to this one.
+            if (value != Value(ValueTraits::NullValue) && hash != KeyTraits::NullHash && (hash & sizeMask) == bucketIdx) {
+                BulkEntry<Hash, Value> entry;
+                entry.hash = hash;
+                entry.value = value;
+                entries.push_back(entry);
+            }
+            if (!delta || probes >= sizeMask)
+                return true;
+            idx = (idx + delta) & sizeMask;
+            group = table->getCellGroups() + (idx >> 2);
+            cell = group->cells + (idx & 3);
+            delta = group->deltas[(idx & 3) + 4].load(turf::Relaxed);
+        }
+    }
+
     static void beginTableMigrationToSize(Map& map, Table* table, ureg nextTableSize) {
         // Create new migration by DCLI.
         TURF_TRACE(Leapfrog, 15, "[beginTableMigrationToSize] called", 0, 0);
@@ -322,7 +488,9 @@ struct Leapfrog {
                 migration->m_unitsRemaining.storeNonatomic(table->getNumMigrationUnits());
                 migration->getSources()[0].table = table;
                 migration->getSources()[0].sourceIndex.storeNonatomic(0);
-                migration->m_destination = Table::create(nextTableSize);
+                migration->m_destination = Table::create(nextTableSize, map.getConditionBank());
+                if (MigrationObserver* observer = map.getMigrationObserver())
+                    migration->notify(observer, MigrationObserver::TableMigrationBegin);
                 // Publish the new migration.
                 table->jobCoordinator.storeRelease(migration);
             }
@@ -334,6 +502,7 @@ struct Leapfrog {
         ureg sizeMask = table->sizeMask;
         ureg idx = overflowIdx - CellsInUseSample;
         ureg inUseCells = 0;
+        ureg erasedCells = 0;
         for (ureg linearProbesRemaining = CellsInUseSample; linearProbesRemaining > 0; linearProbesRemaining--) {
             CellGroup* group = table->getCellGroups() + ((idx & sizeMask) >> 2);
             Cell* cell = group->cells + (idx & 3);
@@ -345,10 +514,16 @@ struct Leapfrog {
             }
             if (value != Value(ValueTraits::NullValue))
                 inUseCells++;
+            else if (cell->hash.load(turf::Relaxed) != KeyTraits::NullHash)
+                erasedCells++;
             idx++;
         }
         float inUseRatio = float(inUseCells) / CellsInUseSample;
         float estimatedInUse = (sizeMask + 1) * inUseRatio;
+        // Erased cells can't be handed to other keys, so under insert/erase churn, each migration only buys as many
+        // inserts as the new table has free cells. When erased cells outnumber live ones, the table overflowed from
+        // churn rather than growth, so size the new table at ChurnSizeFactor times the live cells instead of twice.
+        ureg sizeFactor = (erasedCells > inUseCells) ? ChurnSizeFactor : 2;
 #if JUNCTION_LEAPFROG_FORCE_MIGRATION_OVERFLOWS
         // Periodically underestimate the number of cells in use.
         // This exercises the code that handles overflow during migration.
@@ -357,7 +532,7 @@ struct Leapfrog {
             estimatedInUse /= 4;
         }
 #endif
-        ureg nextTableSize = turf::util::max(InitialSize, turf::util::roundUpPowerOf2(ureg(estimatedInUse * 2)));
+        ureg nextTableSize = turf::util::max(InitialSize, turf::util::roundUpPowerOf2(ureg(estimatedInUse * sizeFactor)));
         beginTableMigrationToSize(map, table, nextTableSize);
     }
 }; // Leapfrog
@@ -405,6 +580,18 @@ bool Leapfrog<Map>::TableMigration::migrateRange(Table* srcTable, ureg startIdx)
                     // srcValue is already marked Redirect due to previous incomplete migration.
                     TURF_TRACE(Leapfrog, 23, "[migrateRange] in-use cell already redirected", uptr(srcTable), srcIdx);
                     break;
+                } else {
+                    typename Map::MigrationFilter* filter = m_map.getMigrationFilter();
+                    if (filter && filter->shouldDrop(srcHash, srcValue)) {
+                        // Drop the cell instead of migrating it.
+                        if (srcCell->value.compareExchangeStrong(srcValue, Value(ValueTraits::Redirect), turf::Relaxed)) {
+                            TURF_TRACE(Leapfrog, 24, "[migrateRange] dropped filtered value", uptr(srcTable), srcIdx);
+                            filter->onDropped(srcHash, srcValue);
+                            break;
+                        }
+                        // There was a racing write (or erase) to the src. Examine the cell again.
+                        continue;
+                    }
                 }
 
                 // We've got a key/value pair to migrate.
@@ -442,11 +629,11 @@ bool Leapfrog<Map>::TableMigration::migrateRange(Table* srcTable, ureg startIdx)
                         // srcValue was non-NULL when we decided to migrate it, but it may have changed to NULL
                         // by a late-arriving erase.
                         if (srcValue == Value(ValueTraits::NullValue))
-                            TURF_TRACE(Leapfrog, 24, "[migrateRange] racing update was erase", uptr(srcTable), srcIdx);
+                            TURF_TRACE(Leapfrog, 25, "[migrateRange] racing update was erase", uptr(srcTable), srcIdx);
                         break;
                     }
                     // There was a late-arriving write (or erase) to the src. Migrate the new value and try again.
-                    TURF_TRACE(Leapfrog, 25, "[migrateRange] race to update migrated value", uptr(srcTable), srcIdx);
+                    TURF_TRACE(Leapfrog, 26, "[migrateRange] race to update migrated value", uptr(srcTable), srcIdx);
                     srcValue = doubleCheckedSrcValue;
                 }
                 // Cell successfully migrated. Proceed to next source cell.
@@ -465,63 +652,81 @@ void Leapfrog<Map>::TableMigration::run() {
     do {
         if (probeStatus & 1) {
             // End flag is already set, so do nothing.
-            TURF_TRACE(Leapfrog, 26, "[TableMigration::run] already ended", uptr(this), 0);
+            TURF_TRACE(Leapfrog, 27, "[TableMigration::run] already ended", uptr(this), 0);
             return;
         }
     } while (!m_workerStatus.compareExchangeWeak(probeStatus, probeStatus + 2, turf::Relaxed, turf::Relaxed));
     // # of workers has been incremented, and the end flag is clear.
     TURF_ASSERT((probeStatus & 1) == 0);
+    MigrationObserver* observer = m_map.getMigrationObserver();
+    MigrationProgress::WorkStart workStart;
+    if (observer)
+        workStart = m_progress.beginWork((probeStatus >> 1) + 1);
 
     // Iterate over all source tables.
     for (ureg s = 0; s < m_numSources; s++) {
         Source& source = getSources()[s];
-        // Loop over all migration units in this source table.
+        ureg srcSize = source.table->sizeMask + 1;
+        ureg unitsPerClaim = 1;
+        // Loop over all migration units in this source table, claiming one or more at a time.
         for (;;) {
-            if (m_workerStatus.load(turf::Relaxed) & 1) {
-                TURF_TRACE(Leapfrog, 27, "[TableMigration::run] detected end flag set", uptr(this), 0);
+            ureg status = m_workerStatus.load(turf::Relaxed);
+            if (status & 1) {
+                TURF_TRACE(Leapfrog, 28, "[TableMigration::run] detected end flag set", uptr(this), 0);
                 goto endMigration;
             }
-            ureg startIdx = source.sourceIndex.fetchAdd(TableMigrationUnitSize, turf::Relaxed);
-            if (startIdx >= source.table->sizeMask + 1)
+            ureg claimIdx = source.sourceIndex.fetchAdd(unitsPerClaim * TableMigrationUnitSize, turf::Relaxed);
+            if (claimIdx >= srcSize)
                 break; // No more migration units in this table. Try next source table.
-            bool overflowed = !migrateRange(source.table, startIdx);
+            ureg endIdx = turf::util::min(claimIdx + unitsPerClaim * TableMigrationUnitSize, srcSize);
+            ureg startIdx = claimIdx;
+            bool overflowed = false;
+            for (; startIdx < endIdx; startIdx += TableMigrationUnitSize) {
+                overflowed = !migrateRange(source.table, startIdx);
+                if (overflowed)
+                    break;
+            }
             if (overflowed) {
                 // *** FAILED MIGRATION ***
                 // TableMigration failed due to destination table overflow.
                 // No other thread can declare the migration successful at this point, because *this* unit will never complete,
                 // hence m_unitsRemaining won't reach zero.
                 // However, multiple threads can independently detect a failed migration at the same time.
-                TURF_TRACE(Leapfrog, 28, "[TableMigration::run] destination overflow", uptr(source.table), uptr(startIdx));
+                TURF_TRACE(Leapfrog, 29, "[TableMigration::run] destination overflow", uptr(source.table), uptr(startIdx));
                 // The reason we store overflowed in a shared variable is because we can must flush all the worker threads before
                 // we can safely deal with the overflow. Therefore, the thread that detects the failure is often different from
                 // the thread
                 // that deals with it.
                 bool oldOverflowed = m_overflowed.exchange(overflowed, turf::Relaxed);
                 if (oldOverflowed)
-                    TURF_TRACE(Leapfrog, 29, "[TableMigration::run] race to set m_overflowed", uptr(overflowed),
+                    TURF_TRACE(Leapfrog, 30, "[TableMigration::run] race to set m_overflowed", uptr(overflowed),
                                uptr(oldOverflowed));
                 m_workerStatus.fetchOr(1, turf::Relaxed);
                 goto endMigration;
             }
-            sreg prevRemaining = m_unitsRemaining.fetchSub(1, turf::Relaxed);
-            TURF_ASSERT(prevRemaining > 0);
-            if (prevRemaining == 1) {
+            ureg numUnits = (endIdx - claimIdx - 1) / TableMigrationUnitSize + 1;
+            sreg prevRemaining = m_unitsRemaining.fetchSub(numUnits, turf::Relaxed);
+            TURF_ASSERT(prevRemaining >= sreg(numUnits));
+            if (prevRemaining == sreg(numUnits)) {
                 // *** SUCCESSFUL MIGRATION ***
                 // That was the last chunk to migrate.
                 m_workerStatus.fetchOr(1, turf::Relaxed);
                 goto endMigration;
             }
+            unitsPerClaim = getUnitsPerClaim((srcSize - endIdx) / TableMigrationUnitSize, status >> 1);
         }
     }
-    TURF_TRACE(Leapfrog, 30, "[TableMigration::run] out of migration units", uptr(this), 0);
+    TURF_TRACE(Leapfrog, 31, "[TableMigration::run] out of migration units", uptr(this), 0);
 
 endMigration:
+    if (observer)
+        m_progress.endWork(workStart);
     // Decrement the shared # of workers.
     probeStatus = m_workerStatus.fetchSub(
         2, turf::AcquireRelease); // AcquireRelease makes all previous writes visible to the last worker thread.
     if (probeStatus >= 4) {
         // There are other workers remaining. Return here so that only the very last worker will proceed.
-        TURF_TRACE(Leapfrog, 31, "[TableMigration::run] not the last worker", uptr(this), uptr(probeStatus));
+        TURF_TRACE(Leapfrog, 32, "[TableMigration::run] not the last worker", uptr(this), uptr(probeStatus));
         return;
     }
 
@@ -534,18 +739,22 @@ endMigration:
         m_map.publishTableMigration(this);
         // End the jobCoodinator.
         getSources()[0].table->jobCoordinator.end();
+        if (observer)
+            notify(observer, MigrationObserver::TableMigrationPublish);
     } else {
         // The migration failed due to the overflow of the destination table.
+        if (observer)
+            notify(observer, MigrationObserver::TableMigrationRetry);
         Table* origTable = getSources()[0].table;
         turf::LockGuard<turf::Mutex> guard(origTable->mutex);
         SimpleJobCoordinator::Job* checkedJob = origTable->jobCoordinator.loadConsume();
         if (checkedJob != this) {
-            TURF_TRACE(Leapfrog, 32, "[TableMigration::run] a new TableMigration was already started", uptr(origTable),
+            TURF_TRACE(Leapfrog, 33, "[TableMigration::run] a new TableMigration was already started", uptr(origTable),
                        uptr(checkedJob));
         } else {
             TableMigration* migration = TableMigration::create(m_map, m_numSources + 1);
             // Double the destination table size.
-            migration->m_destination = Table::create((m_destination->sizeMask + 1) * 2);
+            migration->m_destination = Table::create((m_destination->sizeMask + 1) * 2, m_map.getConditionBank());
             // Transfer source tables to the new migration.
             for (ureg i = 0; i < m_numSources; i++) {
                 migration->getSources()[i].table = getSources()[i].table;
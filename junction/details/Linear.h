@@ -23,6 +23,9 @@
 #include <turf/Heap.h>
 #include <junction/SimpleJobCoordinator.h>
 #include <junction/QSBR.h>
+#include <junction/details/MigrationStats.h>
+#include <junction/MigrationObserver.h>
+#include <junction/MapStats.h>
 
 // Enable this to force migration overflows (for test purposes):
 #define JUNCTION_LINEAR_FORCE_MIGRATION_OVERFLOWS 0
@@ -41,6 +44,7 @@ struct Linear {
 
     static const ureg InitialSize = 8;
     static const ureg TableMigrationUnitSize = 32;
+    static const ureg MaxMigrationUnitsPerClaim = 16;
     static const ureg CellsInUseSample = 256;
 
     struct Cell {
@@ -51,16 +55,17 @@ struct Linear {
     struct Table {
         const ureg sizeMask; // a power of two minus one
         turf::Atomic<sreg> cellsRemaining;
-        turf::Mutex mutex;                   // to DCLI the TableMigration (stored in the jobCoordinator)
         SimpleJobCoordinator jobCoordinator; // makes all blocked threads participate in the migration
 
         Table(ureg sizeMask) : sizeMask(sizeMask), cellsRemaining(sreg(sizeMask * 0.75f)) {
         }
 
-        static Table* create(ureg tableSize) {
+        static Table* create(ureg tableSize, junction::striped::ConditionBank* conditionBank) {
             TURF_ASSERT(turf::util::isPowerOf2(tableSize));
             Table* table = (Table*) TURF_HEAP.alloc(sizeof(Table) + sizeof(Cell) * tableSize);
             new (table) Table(tableSize - 1);
+            table->jobCoordinator.setConditionBank(conditionBank);
+            table->jobCoordinator.setExpectedJobSize(tableSize);
             for (ureg j = 0; j < tableSize; j++) {
                 table->getCells()[j].hash.storeNonatomic(KeyTraits::NullHash);
                 table->getCells()[j].value.storeNonatomic(Value(ValueTraits::NullValue));
@@ -95,6 +100,7 @@ struct Linear {
         turf::Atomic<bool> m_overflowed;
         turf::Atomic<sreg> m_unitsRemaining;
         ureg m_numSources;
+        MigrationProgress m_progress;
 
         TableMigration(Map& map) : m_map(map) {
         }
@@ -107,6 +113,10 @@ struct Linear {
             migration->m_overflowed.storeNonatomic(false);
             migration->m_unitsRemaining.storeNonatomic(0);
             migration->m_numSources = numSources;
+            migration->m_progress.init(map.getMigrationObserver());
+#if JUNCTION_TRACK_MIGRATION_STATS
+            MigrationStats::Instance.numTableMigrations.fetchAdd(1, turf::Relaxed);
+#endif
             // Caller is responsible for filling in sources & destination
             return migration;
         }
@@ -128,10 +138,31 @@ struct Linear {
             return (Source*) (this + 1);
         }
 
+        void notify(MigrationObserver* observer, MigrationObserver::EventType type) const {
+            ureg sourceSize = 0;
+            ureg totalUnits = 0;
+            for (ureg s = 0; s < m_numSources; s++) {
+                sourceSize += getSources()[s].table->sizeMask + 1;
+                totalUnits += getSources()[s].table->getNumMigrationUnits();
+            }
+            m_progress.notify(observer, type, sourceSize, m_destination->sizeMask + 1,
+                              totalUnits - m_unitsRemaining.load(turf::Relaxed));
+        }
+
         bool migrateRange(Table* srcTable, ureg startIdx);
         virtual void run() TURF_OVERRIDE;
     };
 
+    // The number of migration units a worker claims at once, given the units left in the source table and the
+    // number of workers. Claiming several units per fetchAdd keeps the shared source index from becoming a hotspot
+    // in large migrations. Claims shrink toward the end of each table so that the workers finish together.
+    static ureg getUnitsPerClaim(ureg unitsLeft, ureg numWorkers) {
+        ureg units = unitsLeft / (numWorkers * 2 + 1);
+        if (units > MaxMigrationUnitsPerClaim)
+            return MaxMigrationUnitsPerClaim;
+        return units > 0 ? units : 1;
+    }
+
     static Cell* find(Hash hash, Table* table) {
         TURF_TRACE(Linear, 0, "[find] called", uptr(table), hash);
         TURF_ASSERT(table);
@@ -197,27 +228,49 @@ struct Linear {
         }
     }
 
+    // Adds the cells of table chosen by sampleSize to stats. See MapStats.
+    static void collectTableStats(Table* table, ureg sampleSize, MapStats& stats) {
+        ureg sizeMask = table->sizeMask;
+        ureg startIdx = MapStats::chooseSampleStart(sampleSize, sizeMask);
+        stats.numTables++;
+        stats.capacity += sizeMask + 1;
+        stats.bytesUsed += sizeof(Table) + sizeof(Cell) * (sizeMask + 1);
+        for (ureg i = 0; i < sampleSize; i++) {
+            ureg idx = (startIdx + i) & sizeMask;
+            Cell* cell = table->getCells() + idx;
+            stats.numCellsScanned++;
+            Hash hash = cell->hash.load(turf::Relaxed);
+            if (hash == KeyTraits::NullHash)
+                continue;
+            Value value = cell->value.load(turf::Relaxed);
+            if (value == Value(ValueTraits::NullValue)) {
+                stats.numTombstones++;
+            } else if (value != Value(ValueTraits::Redirect)) {
+                stats.numCellsInUse++;
+                stats.addProbe((idx - ureg(hash)) & sizeMask);
+            }
+        }
+    }
+
     static void beginTableMigrationToSize(Map& map, Table* table, ureg nextTableSize) {
-        // Create new migration by DCLI.
+        // Reserve the jobCoordinator with a single CAS. Threads that lose the race wait in participate() until the
+        // winner stores the new migration.
         TURF_TRACE(Linear, 8, "[beginTableMigrationToSize] called", 0, 0);
-        SimpleJobCoordinator::Job* job = table->jobCoordinator.loadConsume();
-        if (job) {
+        if (table->jobCoordinator.loadConsume()) {
             TURF_TRACE(Linear, 9, "[beginTableMigrationToSize] new migration already exists", 0, 0);
+        } else if (!table->jobCoordinator.tryReserve()) {
+            TURF_TRACE(Linear, 10, "[beginTableMigrationToSize] lost the race to reserve the jobCoordinator", 0, 0);
         } else {
-            turf::LockGuard<turf::Mutex> guard(table->mutex);
-            job = table->jobCoordinator.loadConsume(); // Non-atomic would be sufficient, but that's OK.
-            if (job) {
-                TURF_TRACE(Linear, 10, "[beginTableMigrationToSize] new migration already exists (double-checked)", 0, 0);
-            } else {
-                // Create new migration.
-                TableMigration* migration = TableMigration::create(map, 1);
-                migration->m_unitsRemaining.storeNonatomic(table->getNumMigrationUnits());
-                migration->getSources()[0].table = table;
-                migration->getSources()[0].sourceIndex.storeNonatomic(0);
-                migration->m_destination = Table::create(nextTableSize);
-                // Publish the new migration.
-                table->jobCoordinator.storeRelease(migration);
-            }
+            // Create new migration.
+            TableMigration* migration = TableMigration::create(map, 1);
+            migration->m_unitsRemaining.storeNonatomic(table->getNumMigrationUnits());
+            migration->getSources()[0].table = table;
+            migration->getSources()[0].sourceIndex.storeNonatomic(0);
+            migration->m_destination = Table::create(nextTableSize, map.getConditionBank());
+            if (MigrationObserver* observer = map.getMigrationObserver())
+                migration->notify(observer, MigrationObserver::TableMigrationBegin);
+            // Publish the new migration.
+            table->jobCoordinator.storeRelease(migration);
         }
     }
 
@@ -365,20 +418,34 @@ void Linear<Map>::TableMigration::run() {
     } while (!m_workerStatus.compareExchangeWeak(probeStatus, probeStatus + 2, turf::Relaxed, turf::Relaxed));
     // # of workers has been incremented, and the end flag is clear.
     TURF_ASSERT((probeStatus & 1) == 0);
+    MigrationObserver* observer = m_map.getMigrationObserver();
+    MigrationProgress::WorkStart workStart;
+    if (observer)
+        workStart = m_progress.beginWork((probeStatus >> 1) + 1);
 
     // Iterate over all source tables.
     for (ureg s = 0; s < m_numSources; s++) {
         Source& source = getSources()[s];
-        // Loop over all migration units in this source table.
+        ureg srcSize = source.table->sizeMask + 1;
+        ureg unitsPerClaim = 1;
+        // Loop over all migration units in this source table, claiming one or more at a time.
         for (;;) {
-            if (m_workerStatus.load(turf::Relaxed) & 1) {
+            ureg status = m_workerStatus.load(turf::Relaxed);
+            if (status & 1) {
                 TURF_TRACE(Linear, 21, "[TableMigration::run] detected end flag set", uptr(this), 0);
                 goto endMigration;
             }
-            ureg startIdx = source.sourceIndex.fetchAdd(TableMigrationUnitSize, turf::Relaxed);
-            if (startIdx >= source.table->sizeMask + 1)
+            ureg claimIdx = source.sourceIndex.fetchAdd(unitsPerClaim * TableMigrationUnitSize, turf::Relaxed);
+            if (claimIdx >= srcSize)
                 break; // No more migration units in this table. Try next source table.
-            bool overflowed = !migrateRange(source.table, startIdx);
+            ureg endIdx = turf::util::min(claimIdx + unitsPerClaim * TableMigrationUnitSize, srcSize);
+            ureg startIdx = claimIdx;
+            bool overflowed = false;
+            for (; startIdx < endIdx; startIdx += TableMigrationUnitSize) {
+                overflowed = !migrateRange(source.table, startIdx);
+                if (overflowed)
+                    break;
+            }
             if (overflowed) {
                 // *** FAILED MIGRATION ***
                 // TableMigration failed due to destination table overflow.
@@ -397,19 +464,23 @@ void Linear<Map>::TableMigration::run() {
                 m_workerStatus.fetchOr(1, turf::Relaxed);
                 goto endMigration;
             }
-            sreg prevRemaining = m_unitsRemaining.fetchSub(1, turf::Relaxed);
-            TURF_ASSERT(prevRemaining > 0);
-            if (prevRemaining == 1) {
+            ureg numUnits = (endIdx - claimIdx - 1) / TableMigrationUnitSize + 1;
+            sreg prevRemaining = m_unitsRemaining.fetchSub(numUnits, turf::Relaxed);
+            TURF_ASSERT(prevRemaining >= sreg(numUnits));
+            if (prevRemaining == sreg(numUnits)) {
                 // *** SUCCESSFUL MIGRATION ***
                 // That was the last chunk to migrate.
                 m_workerStatus.fetchOr(1, turf::Relaxed);
                 goto endMigration;
             }
+            unitsPerClaim = getUnitsPerClaim((srcSize - endIdx) / TableMigrationUnitSize, status >> 1);
         }
     }
     TURF_TRACE(Linear, 24, "[TableMigration::run] out of migration units", uptr(this), 0);
 
 endMigration:
+    if (observer)
+        m_progress.endWork(workStart);
     // Decrement the shared # of workers.
     probeStatus = m_workerStatus.fetchSub(
         2, turf::AcquireRelease); // AcquireRelease makes all previous writes visible to the last worker thread.
@@ -428,10 +499,14 @@ endMigration:
         m_map.publishTableMigration(this);
         // End the jobCoodinator.
         getSources()[0].table->jobCoordinator.end();
+        if (observer)
+            notify(observer, MigrationObserver::TableMigrationPublish);
     } else {
         // The migration failed due to the overflow of the destination table.
+        if (observer)
+            notify(observer, MigrationObserver::TableMigrationRetry);
         Table* origTable = getSources()[0].table;
-        turf::LockGuard<turf::Mutex> guard(origTable->mutex);
+        // Only the last worker of the current migration can replace it, so there's no race here.
         SimpleJobCoordinator::Job* checkedJob = origTable->jobCoordinator.loadConsume();
         if (checkedJob != this) {
             TURF_TRACE(Linear, 26, "[TableMigration::run] a new TableMigration was already started", uptr(origTable),
@@ -439,7 +514,7 @@ endMigration:
         } else {
             TableMigration* migration = TableMigration::create(m_map, m_numSources + 1);
             // Double the destination table size.
-            migration->m_destination = Table::create((m_destination->sizeMask + 1) * 2);
+            migration->m_destination = Table::create((m_destination->sizeMask + 1) * 2, m_map.getConditionBank());
             // Transfer source tables to the new migration.
             for (ureg i = 0; i < m_numSources; i++) {
                 migration->getSources()[i].table = getSources()[i].table;
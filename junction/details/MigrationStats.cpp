@@ -0,0 +1,23 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#include <junction/details/MigrationStats.h>
+
+namespace junction {
+namespace details {
+
+#if JUNCTION_TRACK_MIGRATION_STATS
+MigrationStats MigrationStats::Instance;
+#endif
+
+} // namespace details
+} // namespace junction
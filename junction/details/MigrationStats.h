@@ -0,0 +1,35 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_DETAILS_MIGRATIONSTATS_H
+#define JUNCTION_DETAILS_MIGRATIONSTATS_H
+
+#include <junction/Core.h>
+#include <turf/Atomic.h>
+
+namespace junction {
+namespace details {
+
+#if JUNCTION_TRACK_MIGRATION_STATS
+// Process-wide count of TableMigrations created by ConcurrentMap_Linear, ConcurrentMap_Leapfrog and
+// ConcurrentMap_Grampa. Includes migrations restarted after the destination table overflowed.
+struct MigrationStats {
+    turf::Atomic<ureg> numTableMigrations;
+
+    static MigrationStats Instance; // Zero-initialized
+};
+#endif
+
+} // namespace details
+} // namespace junction
+
+#endif // JUNCTION_DETAILS_MIGRATIONSTATS_H
@@ -0,0 +1,170 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#include <junction/Core.h>
+#include <junction/details/Snapshot.h>
+#include <turf/Heap.h>
+#include <turf/Util.h>
+#include <string.h>
+#include <new>
+
+#if JUNCTION_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace junction {
+namespace details {
+
+static const char SnapshotMagic[8] = {'J', 'U', 'N', 'C', 'S', 'N', 'A', 'P'};
+
+void SnapshotLayout::initHeader(SnapshotHeader& header) const {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SnapshotMagic, sizeof(SnapshotMagic));
+    header.version = SnapshotVersion;
+    header.mapKind = mapKind;
+    header.hashSize = hashSize;
+    header.valueSize = valueSize;
+    header.cellGroupSize = cellGroupSize;
+    header.tableHeaderSize = tableHeaderSize;
+}
+
+bool SnapshotLayout::matches(const SnapshotHeader& header) const {
+    return memcmp(header.magic, SnapshotMagic, sizeof(SnapshotMagic)) == 0 && header.version == SnapshotVersion &&
+           header.mapKind == mapKind && header.hashSize == hashSize && header.valueSize == valueSize &&
+           header.cellGroupSize == cellGroupSize && header.tableHeaderSize == tableHeaderSize;
+}
+
+SnapshotMapping* SnapshotMapping::open(const char* path) {
+    u8* data = NULL;
+    ureg size = 0;
+#if JUNCTION_USE_MMAP
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && u64(st.st_size) == u64(ureg(st.st_size))) {
+        size = ureg(st.st_size);
+        // Private and writable: the tables are modified in place, but the changes never reach the file.
+        void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED)
+            data = (u8*) addr;
+    }
+    ::close(fd);
+    if (!data)
+        return NULL;
+#else
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long end = ftell(file);
+        if (end > 0 && fseek(file, 0, SEEK_SET) == 0) {
+            size = ureg(end);
+            data = (u8*) TURF_HEAP.alloc(size);
+            if (fread(data, 1, size, file) != size) {
+                TURF_HEAP.free(data);
+                data = NULL;
+            }
+        }
+    }
+    fclose(file);
+    if (!data)
+        return NULL;
+#endif
+    SnapshotMapping* mapping = new (TURF_HEAP.alloc(sizeof(SnapshotMapping))) SnapshotMapping;
+    mapping->m_refCount.storeNonatomic(1);
+    mapping->m_data = data;
+    mapping->m_size = size;
+    return mapping;
+}
+
+const SnapshotHeader* SnapshotMapping::validate(const SnapshotLayout& layout) const {
+    if (m_size < sizeof(SnapshotHeader))
+        return NULL;
+    const SnapshotHeader* header = (const SnapshotHeader*) m_data;
+    if (!layout.matches(*header))
+        return NULL;
+    if (header->numTables > m_size || header->numSlots > m_size)
+        return NULL;
+    u64 directoryEnd = sizeof(SnapshotHeader) + header->numTables * sizeof(SnapshotTable) + header->numSlots * sizeof(u32);
+    if (directoryEnd > m_size)
+        return NULL;
+    const SnapshotTable* tables = getTables();
+    u64 prevEnd = directoryEnd; // Tables are written in order, so each one must start after the previous one ends
+    for (u64 i = 0; i < header->numTables; i++) {
+        const SnapshotTable& table = tables[i];
+        if (table.size < 4 || !turf::util::isPowerOf2(table.size) || (table.offset & (SnapshotAlignment - 1)) != 0)
+            return NULL;
+        if (table.offset < prevEnd || table.offset > m_size || table.size / 4 > m_size)
+            return NULL;
+        u64 tableBytes = header->tableHeaderSize + (table.size / 4) * header->cellGroupSize;
+        if (m_size - table.offset < tableBytes)
+            return NULL;
+        prevEnd = table.offset + tableBytes;
+    }
+    const u32* slots = getSlots();
+    for (u64 i = 0; i < header->numSlots; i++) {
+        if (slots[i] >= header->numTables)
+            return NULL;
+    }
+    return header;
+}
+
+void SnapshotMapping::release() {
+    if (m_refCount.fetchSub(1, turf::AcquireRelease) == 1) {
+#if JUNCTION_USE_MMAP
+        munmap(m_data, m_size);
+#else
+        TURF_HEAP.free(m_data);
+#endif
+        this->SnapshotMapping::~SnapshotMapping();
+        TURF_HEAP.free(this);
+    }
+}
+
+SnapshotWriter::SnapshotWriter(const char* path) : m_offset(0) {
+    m_file = fopen(path, "wb");
+    m_ok = (m_file != NULL);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (m_file)
+        fclose(m_file);
+}
+
+void SnapshotWriter::write(const void* data, ureg size) {
+    if (m_ok && size > 0)
+        m_ok = (fwrite(data, 1, size, m_file) == size);
+    m_offset += size;
+}
+
+void SnapshotWriter::padTo(u64 offset) {
+    static const u8 zeros[256] = {0};
+    TURF_ASSERT(offset >= m_offset);
+    while (m_offset < offset)
+        write(zeros, ureg(turf::util::min(offset - m_offset, u64(sizeof(zeros)))));
+}
+
+bool SnapshotWriter::close() {
+    if (m_file) {
+        if (fclose(m_file) != 0)
+            m_ok = false;
+        m_file = NULL;
+    }
+    return m_ok;
+}
+
+} // namespace details
+} // namespace junction
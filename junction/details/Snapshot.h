@@ -0,0 +1,154 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_DETAILS_SNAPSHOT_H
+#define JUNCTION_DETAILS_SNAPSHOT_H
+
+#include <junction/Core.h>
+#include <turf/Atomic.h>
+#include <stdio.h>
+
+namespace junction {
+namespace details {
+
+// Snapshot files written by ConcurrentMap_Leapfrog::saveSnapshot() and ConcurrentMap_Grampa::saveSnapshot().
+//
+// A snapshot is an image of the map's tables, cells and deltas included, so loading it involves no rehashing.
+// Each table is stored at a multiple of SnapshotAlignment, preceded by tableHeaderSize bytes of room for its Table
+// header. On load, the whole file is mapped privately (copy-on-write), each Table header is constructed in that room,
+// and the tables are used where they lie. Pages are read from the file as they're touched, and copied only when
+// written to.
+//
+// The cells are stored exactly as they are in memory, so a snapshot can only be loaded by a build with the same
+// layout: same Hash and Value sizes, same Table header size, same byte order. The header records all of these and
+// load fails on any mismatch, as it does for a different SnapshotVersion.
+//
+// File layout:
+//     SnapshotHeader
+//     SnapshotTable[numTables]
+//     u32[numSlots]  Grampa only: the table index of each flattree slot
+//     Tables, each at a multiple of SnapshotAlignment: tableHeaderSize bytes of room, then the CellGroups
+
+static const u32 SnapshotVersion = 1;
+static const ureg SnapshotAlignment = 4096;
+
+enum SnapshotMapKind {
+    SnapshotMap_Leapfrog = 1,
+    SnapshotMap_Grampa = 2,
+};
+
+struct SnapshotHeader {
+    char magic[8]; // "JUNCSNAP"
+    u32 version;
+    u32 mapKind;
+    u32 hashSize;
+    u32 valueSize;
+    u32 cellGroupSize;
+    u32 tableHeaderSize;
+    u64 numTables;
+    u64 numSlots;  // Number of flattree slots, or 0 if there's no flattree
+    u64 rootShift; // Each flattree slot covers 1 << rootShift hashes: the range of the smallest leaf
+};
+
+struct SnapshotTable {
+    u64 offset; // From the start of the file to the room for the Table header
+    u64 size;   // Number of cells
+    u64 baseHash;
+    u64 rangeShift;
+};
+
+// Everything in the header that depends on the build and the map type.
+struct SnapshotLayout {
+    u32 mapKind;
+    u32 hashSize;
+    u32 valueSize;
+    u32 cellGroupSize;
+    u32 tableHeaderSize;
+
+    void initHeader(SnapshotHeader& header) const;
+    bool matches(const SnapshotHeader& header) const;
+};
+
+// A loaded snapshot file, mapped privately, or read into the heap if JUNCTION_USE_MMAP is 0. Every table restored
+// from it holds a reference, and the file is released along with the last of them, whether that's when the map is
+// destroyed or when a TableMigration replaces the table.
+class SnapshotMapping {
+private:
+    turf::Atomic<ureg> m_refCount;
+    u8* m_data;
+    ureg m_size;
+
+    SnapshotMapping() {
+    }
+
+public:
+    // Returns NULL if the file can't be opened or mapped. The caller holds the first reference.
+    static SnapshotMapping* open(const char* path);
+
+    u8* getData() const {
+        return m_data;
+    }
+
+    ureg getSize() const {
+        return m_size;
+    }
+
+    // Checks the header against layout, and checks that every table and the slot list lie within the file, with the
+    // tables in order and not overlapping. Returns NULL if anything is wrong.
+    const SnapshotHeader* validate(const SnapshotLayout& layout) const;
+
+    const SnapshotTable* getTables() const {
+        return (const SnapshotTable*) (m_data + sizeof(SnapshotHeader));
+    }
+
+    const u32* getSlots() const {
+        const SnapshotHeader* header = (const SnapshotHeader*) m_data;
+        return (const u32*) (getTables() + header->numTables);
+    }
+
+    void addRef() {
+        m_refCount.fetchAdd(1, turf::Relaxed);
+    }
+
+    void release();
+};
+
+// Writes a snapshot file sequentially, remembering whether any write failed.
+class SnapshotWriter {
+private:
+    FILE* m_file;
+    u64 m_offset;
+    bool m_ok;
+
+public:
+    SnapshotWriter(const char* path);
+    ~SnapshotWriter();
+
+    void write(const void* data, ureg size);
+    // Pads with zeros up to offset.
+    void padTo(u64 offset);
+    // Closes the file, and returns false if it couldn't be opened or any write failed.
+    bool close();
+
+    u64 getOffset() const {
+        return m_offset;
+    }
+
+    static u64 alignUp(u64 offset) {
+        return (offset + SnapshotAlignment - 1) & ~u64(SnapshotAlignment - 1);
+    }
+};
+
+} // namespace details
+} // namespace junction
+
+#endif // JUNCTION_DETAILS_SNAPSHOT_H
@@ -0,0 +1,92 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_DETAILS_SNAPSHOTSCAN_H
+#define JUNCTION_DETAILS_SNAPSHOTSCAN_H
+
+#include <junction/Core.h>
+#include <vector>
+
+namespace junction {
+namespace details {
+
+// Shared by the snapshot() functions of ConcurrentMap_Leapfrog and ConcurrentMap_Grampa.
+//
+// A snapshot visits a table's buckets in order, a unit at a time. When the table is replaced by a TableMigration
+// partway through, the snapshot carries on from the first bucket of the new table, whose buckets don't line up
+// with the old ones. SnapshotScan remembers, for each table left behind, how many of its buckets were visited, so
+// that the entries already passed to the sink can be recognized by their hash and skipped. It costs one record per
+// migration that the snapshot runs into, rather than anything per entry.
+template <class Hash>
+class SnapshotScan {
+private:
+    struct Visited {
+        Hash baseHash;
+        ureg rangeShift;
+        ureg sizeMask;
+        ureg numBuckets; // Buckets 0 to numBuckets - 1 were visited
+    };
+
+    std::vector<Visited> m_visited;
+    Hash m_doneBelow; // Every hash below this was visited, in some table
+
+public:
+    SnapshotScan() : m_doneBelow(0) {
+    }
+
+    // Records that the first numBuckets buckets were visited in a table of sizeMask + 1 buckets, which holds the
+    // hashes from baseHash to baseHash + (1 << rangeShift) - 1.
+    void addVisited(Hash baseHash, ureg rangeShift, ureg sizeMask, ureg numBuckets) {
+        if (numBuckets == 0)
+            return;
+        Visited visited;
+        visited.baseHash = baseHash;
+        visited.rangeShift = rangeShift;
+        visited.sizeMask = sizeMask;
+        visited.numBuckets = numBuckets;
+        m_visited.push_back(visited);
+    }
+
+    // Records that every hash below doneBelow was visited. Used by ConcurrentMap_Grampa, which visits its leaves in
+    // hash order; the records for leaves that lie entirely below doneBelow are no longer needed.
+    void setDoneBelow(Hash doneBelow) {
+        m_doneBelow = doneBelow;
+        ureg j = 0;
+        for (ureg i = 0; i < m_visited.size(); i++) {
+            const Visited& visited = m_visited[i];
+            // end is 0 if the range runs to the top of the hash space.
+            Hash end = visited.rangeShift >= sizeof(Hash) * 8 ? 0 : Hash(visited.baseHash + (Hash(1) << visited.rangeShift));
+            if (end == 0 || end > doneBelow)
+                m_visited[j++] = visited;
+        }
+        m_visited.resize(j);
+    }
+
+    // Returns true if an entry with this hash would already have been passed to the sink.
+    bool wasVisited(Hash hash) const {
+        if (hash < m_doneBelow)
+            return true;
+        for (ureg i = 0; i < m_visited.size(); i++) {
+            const Visited& visited = m_visited[i];
+            if (visited.rangeShift < sizeof(Hash) * 8 && Hash(hash - visited.baseHash) >> visited.rangeShift != 0)
+                continue; // Not in that table's range
+            if ((ureg(hash) & visited.sizeMask) < visited.numBuckets)
+                return true;
+        }
+        return false;
+    }
+};
+
+} // namespace details
+} // namespace junction
+
+#endif // JUNCTION_DETAILS_SNAPSHOTSCAN_H
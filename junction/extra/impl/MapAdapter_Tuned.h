@@ -0,0 +1,109 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_EXTRA_IMPL_MAPADAPTER_TUNED_H
+#define JUNCTION_EXTRA_IMPL_MAPADAPTER_TUNED_H
+
+#include <junction/Core.h>
+#include <junction/QSBR.h>
+#include <junction/ConcurrentMap_Leapfrog.h>
+#include <junction/ConcurrentMap_Grampa.h>
+#include <turf/Util.h>
+
+// Leapfrog or Grampa with tuning constants taken from the user config, so that a script can sweep them.
+// See samples/MapScalabilityTests/SweepTuning.py. Any constant left undefined keeps its default.
+#ifndef JUNCTION_TUNED_MAP_GRAMPA
+#define JUNCTION_TUNED_MAP_GRAMPA 0
+#endif
+
+namespace junction {
+namespace extra {
+
+struct SweptTuningTraits : DefaultTuningTraits {
+#ifdef JUNCTION_TUNED_INITIAL_SIZE
+    static const ureg InitialSize = JUNCTION_TUNED_INITIAL_SIZE;
+#endif
+#ifdef JUNCTION_TUNED_TABLE_MIGRATION_UNIT_SIZE
+    static const ureg TableMigrationUnitSize = JUNCTION_TUNED_TABLE_MIGRATION_UNIT_SIZE;
+#endif
+#ifdef JUNCTION_TUNED_MAX_MIGRATION_UNITS_PER_CLAIM
+    static const ureg MaxMigrationUnitsPerClaim = JUNCTION_TUNED_MAX_MIGRATION_UNITS_PER_CLAIM;
+#endif
+#ifdef JUNCTION_TUNED_LINEAR_SEARCH_LIMIT
+    static const ureg LinearSearchLimit = JUNCTION_TUNED_LINEAR_SEARCH_LIMIT;
+#endif
+#ifdef JUNCTION_TUNED_CELLS_IN_USE_SAMPLE
+    static const ureg CellsInUseSample = JUNCTION_TUNED_CELLS_IN_USE_SAMPLE;
+#else
+    // Keep the sample within the search limit when only the limit is swept.
+    static const ureg CellsInUseSample = (LinearSearchLimit < DefaultTuningTraits::CellsInUseSample)
+                                             ? LinearSearchLimit
+                                             : DefaultTuningTraits::CellsInUseSample;
+#endif
+#ifdef JUNCTION_TUNED_CHURN_SIZE_FACTOR
+    static const ureg ChurnSizeFactor = JUNCTION_TUNED_CHURN_SIZE_FACTOR;
+#endif
+#ifdef JUNCTION_TUNED_FLATTREE_NODE_BITS
+    static const ureg FlatTreeNodeBits = JUNCTION_TUNED_FLATTREE_NODE_BITS;
+#endif
+#ifdef JUNCTION_TUNED_LEAF_SIZE_BITS
+    static const ureg LeafSizeBits = JUNCTION_TUNED_LEAF_SIZE_BITS;
+#endif
+};
+
+class MapAdapter {
+public:
+#if JUNCTION_TUNED_MAP_GRAMPA
+    static TURF_CONSTEXPR const char* getMapName() { return "Junction Grampa map (tuned)"; }
+#else
+    static TURF_CONSTEXPR const char* getMapName() { return "Junction Leapfrog map (tuned)"; }
+#endif
+
+    MapAdapter(ureg) {
+    }
+
+    class ThreadContext {
+    private:
+        QSBR::Context m_qsbrContext;
+
+    public:
+        ThreadContext(MapAdapter&, ureg) {
+        }
+
+        void registerThread() {
+            m_qsbrContext = DefaultQSBR.createContext();
+        }
+
+        void unregisterThread() {
+            DefaultQSBR.destroyContext(m_qsbrContext);
+        }
+
+        void update() {
+            DefaultQSBR.update(m_qsbrContext);
+        }
+    };
+
+#if JUNCTION_TUNED_MAP_GRAMPA
+    typedef ConcurrentMap_Grampa<u32, void*, DefaultKeyTraits<u32>, DefaultValueTraits<void*>, SweptTuningTraits> Map;
+#else
+    typedef ConcurrentMap_Leapfrog<u32, void*, DefaultKeyTraits<u32>, DefaultValueTraits<void*>, SweptTuningTraits> Map;
+#endif
+
+    static ureg getInitialCapacity(ureg maxPopulation) {
+        return turf::util::roundUpPowerOf2(maxPopulation / 4);
+    }
+};
+
+} // namespace extra
+} // namespace junction
+
+#endif // JUNCTION_EXTRA_IMPL_MAPADAPTER_TUNED_H
@@ -0,0 +1,79 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+
+#ifndef JUNCTION_STRIPED_ADAPTIVEBACKOFF_H
+#define JUNCTION_STRIPED_ADAPTIVEBACKOFF_H
+
+#include <junction/Core.h>
+#include <turf/Util.h>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
+namespace junction {
+namespace striped {
+
+// Tells the CPU that the current thread is busy-waiting. On x86, this keeps the spin loop from flooding the memory
+// pipeline and leaves more execution resources to the other hyperthread.
+inline void spinPause() {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__arm__) && defined(__ARM_ARCH) && __ARM_ARCH >= 7)
+    __asm__ __volatile__("yield");
+#endif
+    // Elsewhere, spinning just polls without pausing.
+}
+
+// Spins with exponentially growing runs of spinPause() until a budget runs out. The caller polls its condition
+// between calls to spin(), and blocks once spin() returns false:
+//
+//     AdaptiveBackoff backoff(spinLimit);
+//     while (!ready()) {
+//         if (!backoff.spin()) {
+//             block();
+//             break;
+//         }
+//     }
+class AdaptiveBackoff {
+private:
+    ureg m_remaining; // Pauses left in the budget
+    ureg m_runLength; // Pauses in the next run
+
+public:
+    // Runs are capped so that a thread never pauses for long between polls.
+    static const ureg MaxRunLength = 64;
+
+    AdaptiveBackoff(ureg spinLimit) : m_remaining(spinLimit), m_runLength(1) {
+    }
+
+    // Returns false, without pausing, once spinLimit pauses have been spent.
+    bool spin() {
+        if (m_remaining == 0)
+            return false;
+        ureg runLength = turf::util::min(m_runLength, m_remaining);
+        for (ureg i = 0; i < runLength; i++)
+            spinPause();
+        m_remaining -= runLength;
+        if (m_runLength < MaxRunLength)
+            m_runLength *= 2;
+        return true;
+    }
+};
+
+} // namespace striped
+} // namespace junction
+
+#endif // JUNCTION_STRIPED_ADAPTIVEBACKOFF_H
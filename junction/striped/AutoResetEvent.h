@@ -14,6 +14,61 @@
 #define JUNCTION_STRIPED_AUTORESETEVENT_H
 
 #include <junction/Core.h>
+
+#if JUNCTION_USE_FUTEX
+
+//-----------------------------------
+// Futex
+//-----------------------------------
+#include <junction/striped/Futex.h>
+
+namespace junction {
+namespace striped {
+
+class AutoResetEvent {
+private:
+    // Bit 0 is set while signaled. The remaining bits count the threads waiting, so that signal()
+    // only makes a system call when somebody needs waking.
+    static const u32 Signaled = 1;
+    static const u32 OneWaiter = 2;
+    turf::Atomic<u32> m_state;
+
+public:
+    AutoResetEvent(bool status) : m_state(status ? Signaled : 0) {
+    }
+
+    void wait() {
+        u32 state = m_state.load(turf::Relaxed);
+        for (;;) {
+            if (state & Signaled) {
+                // Consume the signal.
+                if (m_state.compareExchangeWeak(state, state & ~Signaled, turf::Acquire, turf::Relaxed))
+                    return;
+                continue;
+            }
+            if (!m_state.compareExchangeWeak(state, state + OneWaiter, turf::Relaxed, turf::Relaxed))
+                continue;
+            // Returns immediately if signal() (or another waiter) changed the state in the meantime.
+            futexWait(m_state, state + OneWaiter);
+            state = m_state.fetchSub(OneWaiter, turf::Relaxed) - OneWaiter;
+        }
+    }
+
+    void signal() {
+        u32 prevState = m_state.fetchOr(Signaled, turf::Release);
+        if (!(prevState & Signaled) && prevState >= OneWaiter)
+            futexWake(m_state, 1); // Exactly one waiter can consume the signal
+    }
+};
+
+} // namespace striped
+} // namespace junction
+
+#else // JUNCTION_USE_FUTEX
+
+//-----------------------------------
+// ConditionBank
+//-----------------------------------
 #include <junction/striped/ConditionBank.h>
 
 namespace junction {
@@ -52,4 +107,6 @@ public:
 } // namespace striped
 } // namespace junction
 
+#endif // JUNCTION_USE_FUTEX
+
 #endif // JUNCTION_STRIPED_AUTORESETEVENT_H
@@ -20,6 +20,10 @@ namespace striped {
 
 ConditionBank DefaultConditionBank;
 
+ConditionBank::ConditionBank(ureg size) : m_pairs(NULL), m_sizeMask(size - 1) {
+    TURF_ASSERT(turf::util::isPowerOf2(size));
+}
+
 ConditionBank::~ConditionBank() {
     m_initSpinLock.lock();
     ConditionPair* pairs = m_pairs.exchange(nullptr, turf::ConsumeRelease);
@@ -31,7 +35,7 @@ ConditionPair* ConditionBank::initialize() {
     m_initSpinLock.lock();
     ConditionPair* pairs = m_pairs.loadNonatomic();
     if (!pairs) {
-        pairs = new ConditionPair[SizeMask + 1];
+        pairs = new ConditionPair[m_sizeMask + 1];
         m_pairs.store(pairs, turf::Release);
     }
     m_initSpinLock.unlock();
@@ -27,15 +27,22 @@
 namespace junction {
 namespace striped {
 
+TURF_STATIC_ASSERT(JUNCTION_CONDITIONBANK_SIZE > 0 && (JUNCTION_CONDITIONBANK_SIZE & (JUNCTION_CONDITIONBANK_SIZE - 1)) == 0);
+
+// A fixed set of ConditionPairs shared by many objects, each of which hashes its own address to pick one.
+// Objects that collide on a pair can see each other's wakeups. To keep a busy group of maps from disturbing
+// the rest of the process, give them their own ConditionBank; see the concurrent map constructors.
 class ConditionBank {
 private:
-    static const ureg SizeMask = 1023;
     turf::Mutex_SpinLock m_initSpinLock;
     turf::Atomic<ConditionPair*> m_pairs;
+    const ureg m_sizeMask;
 
     ConditionPair* initialize();
 
 public:
+    // size must be a power of two. The ConditionPairs themselves are allocated on first use.
+    ConditionBank(ureg size = JUNCTION_CONDITIONBANK_SIZE);
     ~ConditionBank();
 
     ConditionPair& get(void* ptr) {
@@ -43,7 +50,7 @@ public:
         if (!pairs) {
             pairs = initialize();
         }
-        ureg index = turf::util::avalanche(uptr(ptr)) & SizeMask;
+        ureg index = turf::util::avalanche(uptr(ptr)) & m_sizeMask;
         return pairs[index];
     }
 };
@@ -61,6 +68,21 @@ extern ConditionBank DefaultConditionBank;
 //-----------------------------------
 // Striping disabled
 //-----------------------------------
+namespace junction {
+namespace striped {
+
+// Every object has its own ConditionPair, so there's nothing to share. Accepted and ignored wherever a
+// ConditionBank can be passed, so that code builds either way.
+class ConditionBank {
+public:
+    ConditionBank(ureg size = JUNCTION_CONDITIONBANK_SIZE) {
+        TURF_UNUSED(size);
+    }
+};
+
+} // namespace striped
+} // namespace junction
+
 #define JUNCTION_STRIPED_CONDITIONBANK_DEFINE_MEMBER() junction::striped::ConditionPair m_conditionPair;
 #define JUNCTION_STRIPED_CONDITIONBANK_GET(objectPtr) ((objectPtr)->m_conditionPair)
 
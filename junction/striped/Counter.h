@@ -0,0 +1,70 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef JUNCTION_STRIPED_COUNTER_H
+#define JUNCTION_STRIPED_COUNTER_H
+
+#include <junction/Core.h>
+#include <turf/Atomic.h>
+
+namespace junction {
+namespace striped {
+
+// A counter that many threads bump at once, such as a cache's hit count.
+// It's split into NumStripes counters, each on its own cache line. Each thread is assigned a stripe, round-robin,
+// the first time it adds to any Counter, so threads only contend when there are more of them than stripes.
+// get() sums the stripes, so it's slower than add() and may miss adds that are in progress.
+class Counter {
+public:
+    static const ureg NumStripes = 16;
+    static const ureg CacheLineSize = 64;
+
+private:
+    struct Stripe {
+        turf::Atomic<ureg> count;
+        u8 padding[CacheLineSize - sizeof(turf::Atomic<ureg>)];
+    };
+
+    Stripe m_stripes[NumStripes];
+
+    static ureg getThreadStripe() {
+        // Constant-initialized, so access needs no guard.
+        static thread_local ureg stripe = NumStripes;
+        if (stripe == NumStripes) {
+            static turf::Atomic<ureg> nextStripe(0);
+            stripe = nextStripe.fetchAdd(1, turf::Relaxed) % NumStripes;
+        }
+        return stripe;
+    }
+
+public:
+    Counter() {
+        for (ureg i = 0; i < NumStripes; i++)
+            m_stripes[i].count.storeNonatomic(0);
+    }
+
+    void add(ureg value) {
+        m_stripes[getThreadStripe()].count.fetchAdd(value, turf::Relaxed);
+    }
+
+    ureg get() const {
+        ureg sum = 0;
+        for (ureg i = 0; i < NumStripes; i++)
+            sum += m_stripes[i].count.load(turf::Relaxed);
+        return sum;
+    }
+};
+
+} // namespace striped
+} // namespace junction
+
+#endif // JUNCTION_STRIPED_COUNTER_H
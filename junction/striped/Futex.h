@@ -0,0 +1,48 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+
+#ifndef JUNCTION_STRIPED_FUTEX_H
+#define JUNCTION_STRIPED_FUTEX_H
+
+#include <junction/Core.h>
+
+#if JUNCTION_USE_FUTEX
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace junction {
+namespace striped {
+
+// Thin wrappers around the Linux futex system call, used by the one-word striped::Mutex, AutoResetEvent and
+// ManualResetEvent. The kernel keeps a wait queue per address, so waking never disturbs threads that happen to
+// wait on an unrelated object, unlike a shared ConditionPair.
+TURF_STATIC_ASSERT(sizeof(turf::Atomic<u32>) == sizeof(u32));
+
+// Blocks until woken, unless the word no longer holds expected. May also return spuriously.
+inline void futexWait(turf::Atomic<u32>& word, u32 expected) {
+    syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+// Wakes up to count threads blocked in futexWait on the same word.
+inline void futexWake(turf::Atomic<u32>& word, int count) {
+    syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+} // namespace striped
+} // namespace junction
+
+#endif // JUNCTION_USE_FUTEX
+
+#endif // JUNCTION_STRIPED_FUTEX_H
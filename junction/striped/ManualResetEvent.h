@@ -15,7 +15,62 @@
 
 #include <junction/Core.h>
 
-#if JUNCTION_USE_STRIPING
+#if JUNCTION_USE_FUTEX
+
+//-----------------------------------
+// Futex
+//-----------------------------------
+#include <junction/striped/Futex.h>
+#include <limits.h>
+
+namespace junction {
+namespace striped {
+
+class ManualResetEvent {
+private:
+    static const u32 Signaled = 1;
+    static const u32 HasWaiters = 2;
+    turf::Atomic<u32> m_state;
+
+public:
+    ManualResetEvent(bool initialState = false) : m_state(initialState ? Signaled : 0) {
+    }
+
+    ~ManualResetEvent() {
+    }
+
+    void signal() {
+        u32 prevState = m_state.fetchOr(Signaled, turf::Release); // Synchronizes-with the load in wait
+        if (prevState == HasWaiters)
+            futexWake(m_state, INT_MAX); // Every waiter on this event, and nobody else
+    }
+
+    bool isSignaled() const {
+        return m_state.load(turf::Relaxed) & Signaled;
+    }
+
+    void reset() {
+        m_state.fetchAnd(~Signaled, turf::Relaxed);
+    }
+
+    void wait() {
+        u32 state = m_state.load(turf::Acquire); // Synchronizes-with the fetchOr in signal
+        while ((state & Signaled) == 0) {
+            if (state != HasWaiters) {
+                TURF_ASSERT(state == 0);
+                if (!m_state.compareExchangeWeak(state, HasWaiters, turf::Acquire, turf::Acquire))
+                    continue;
+            }
+            futexWait(m_state, HasWaiters);
+            state = m_state.load(turf::Acquire);
+        }
+    }
+};
+
+} // namespace striped
+} // namespace junction
+
+#elif JUNCTION_USE_STRIPING
 
 //-----------------------------------
 // Striping enabled
@@ -95,6 +150,6 @@ typedef turf::ManualResetEvent ManualResetEvent;
 } // namespace striped
 } // namespace junction
 
-#endif // JUNCTION_USE_STRIPING
+#endif // JUNCTION_USE_FUTEX
 
 #endif // JUNCTION_STRIPED_MANUALRESETEVENT_H
@@ -15,7 +15,56 @@
 
 #include <junction/Core.h>
 
-#if JUNCTION_USE_STRIPING
+#if JUNCTION_USE_FUTEX
+
+//-----------------------------------
+// Futex
+//-----------------------------------
+#include <junction/striped/Futex.h>
+#include <turf/Mutex.h> // For turf::LockGuard
+
+namespace junction {
+namespace striped {
+
+// Not recursive
+class Mutex {
+private:
+    // 0: unlocked, 1: locked, 2: locked and other threads may be waiting
+    turf::Atomic<u32> m_state;
+
+    void lockSlow(u32 state) {
+        if (state != 2)
+            state = m_state.exchange(2, turf::Acquire);
+        while (state != 0) {
+            futexWait(m_state, 2);
+            state = m_state.exchange(2, turf::Acquire);
+        }
+    }
+
+public:
+    Mutex() : m_state(0) {
+    }
+
+    void lock() {
+        u32 state = m_state.compareExchange(0, 1, turf::Acquire);
+        if (state != 0)
+            lockSlow(state);
+    }
+
+    bool tryLock() {
+        return m_state.compareExchange(0, 1, turf::Acquire) == 0;
+    }
+
+    void unlock() {
+        if (m_state.exchange(0, turf::Release) == 2)
+            futexWake(m_state, 1);
+    }
+};
+
+} // namespace striped
+} // namespace junction
+
+#elif JUNCTION_USE_STRIPING
 
 //-----------------------------------
 // Striping enabled
@@ -71,6 +120,6 @@ typedef turf::Mutex Mutex;
 } // namespace striped
 } // namespace junction
 
-#endif // JUNCTION_USE_STRIPING
+#endif // JUNCTION_USE_FUTEX
 
 #endif // JUNCTION_STRIPED_MUTEX_H
@@ -0,0 +1,244 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#include <junction/Core.h>
+#include <turf/CPUTimer.h>
+#include <turf/Heap.h>
+#include <turf/Util.h>
+#include <turf/extra/JobDispatcher.h>
+#include <turf/extra/Options.h>
+#include <junction/extra/MapAdapter.h>
+#include <junction/details/MigrationStats.h>
+#include <vector>
+#include <stdio.h>
+
+using namespace turf::intTypes;
+typedef junction::extra::MapAdapter MapAdapter;
+
+static const ureg DefaultKeysPerThread = 2000;
+static const ureg DefaultCollideShift = 8;
+static const ureg DefaultMaxMegabytes = 1024;
+static const ureg DefaultMaxMigrations = 1000;
+static const ureg MemorySampleInterval = 16;
+static const u32 Prime = 0x4190ab09;
+
+#define HAS_MEMORY_STATS (TURF_USE_DLMALLOC && TURF_DLMALLOC_FAST_STATS)
+
+// Each distribution maps a key index, starting at 1, to a key.
+// The last two are specific to DefaultKeyTraits, since they're built by inverting turf::util::avalanche.
+enum Distribution {
+    Distribution_Random,         // The same scrambled keys as the other samples, for comparison
+    Distribution_HighBits,       // Keys that differ only in their high bits
+    Distribution_SequentialHash, // Keys whose hashes are sequential, as if a weak hash were applied to sequential keys
+    Distribution_CollidingHash,  // Keys whose hashes share their low bits, so they collide in every small table
+    Distribution_Count
+};
+
+static const char* DistributionNames[] = {"random", "highBits", "sequentialHash", "collidingHash"};
+
+static ureg getUsedBytes() {
+#if HAS_MEMORY_STATS
+    return TURF_HEAP.getInUseBytes();
+#else
+    return 0;
+#endif
+}
+
+static ureg getNumMigrations() {
+#if JUNCTION_TRACK_MIGRATION_STATS
+    return junction::details::MigrationStats::Instance.numTableMigrations.load(turf::Relaxed);
+#else
+    return 0;
+#endif
+}
+
+struct SharedState {
+    MapAdapter& adapter;
+    MapAdapter::Map* map;
+    Distribution distribution;
+    ureg keysPerThread;
+    ureg collideShift;
+    ureg maxBytes;
+    ureg maxMigrations;
+    ureg startBytes;
+    ureg startMigrations;
+    turf::Atomic<u32> abortFlag;
+
+    SharedState(MapAdapter& adapter, ureg keysPerThread, ureg collideShift, ureg maxBytes, ureg maxMigrations)
+        : adapter(adapter), map(NULL), distribution(Distribution_Random), keysPerThread(keysPerThread),
+          collideShift(collideShift), maxBytes(maxBytes), maxMigrations(maxMigrations), startBytes(0),
+          startMigrations(0) {
+        abortFlag.storeNonatomic(0);
+    }
+
+    u32 makeKey(u32 index) const {
+        switch (distribution) {
+        case Distribution_HighBits:
+            return (index << 12) | 1;
+        case Distribution_SequentialHash:
+            return turf::util::deavalanche(index);
+        case Distribution_CollidingHash:
+            return turf::util::deavalanche(index << collideShift);
+        default:
+            return index * Prime;
+        }
+    }
+
+    // Stops the run once the map has exceeded the memory or migration budget.
+    // Without this, a map that keeps doubling on colliding keys would exhaust memory.
+    bool checkBudget(ureg& peakBytes) {
+        // Tables left over from the previous distribution may still be freed by QSBR during this one, so usage can
+        // dip below startBytes. Count that as zero rather than letting the subtraction wrap around.
+        ureg totalBytes = getUsedBytes();
+        ureg usedBytes = totalBytes > startBytes ? totalBytes - startBytes : 0;
+        peakBytes = turf::util::max(peakBytes, usedBytes);
+        if (usedBytes > maxBytes || getNumMigrations() - startMigrations > maxMigrations) {
+            abortFlag.store(1, turf::Relaxed);
+            return false;
+        }
+        return true;
+    }
+};
+
+class ThreadState {
+public:
+    SharedState* m_shared;
+    MapAdapter::ThreadContext m_threadCtx;
+    ureg m_threadIndex;
+    ureg m_mapOpsDone;
+    ureg m_peakBytes;
+    double m_duration;
+
+    ThreadState(SharedState* shared, ureg threadIndex)
+        : m_shared(shared), m_threadCtx(shared->adapter, threadIndex), m_threadIndex(threadIndex), m_mapOpsDone(0),
+          m_peakBytes(0), m_duration(0) {
+    }
+
+    void registerThread() {
+        m_threadCtx.registerThread();
+    }
+
+    void unregisterThread() {
+        m_threadCtx.unregisterThread();
+    }
+
+    void run() {
+        MapAdapter::Map* map = m_shared->map;
+        turf::CPUTimer::Converter converter;
+        u32 firstIndex = u32(m_threadIndex * m_shared->keysPerThread + 1);
+        u32 lastIndex = u32(firstIndex + m_shared->keysPerThread);
+        m_mapOpsDone = 0;
+        m_peakBytes = 0;
+
+        turf::CPUTimer::Point start = turf::CPUTimer::get();
+        u32 index = firstIndex;
+        for (; index < lastIndex; index++) {
+            if (m_shared->abortFlag.load(turf::Relaxed))
+                break;
+            u32 key = m_shared->makeKey(index);
+            if (key >= 2) {
+                map->assign(key, (void*) uptr(key));
+                m_mapOpsDone++;
+            }
+            if ((index % MemorySampleInterval) == 0) {
+                m_threadCtx.update();
+                if (!m_shared->checkBudget(m_peakBytes))
+                    break;
+            }
+        }
+        // Look up every key that was inserted.
+        for (u32 i = firstIndex; i < index; i++) {
+            u32 key = m_shared->makeKey(i);
+            if (key >= 2) {
+                volatile void* value = map->get(key);
+                TURF_UNUSED(value);
+                m_mapOpsDone++;
+            }
+        }
+        turf::CPUTimer::Point end = turf::CPUTimer::get();
+        m_threadCtx.update();
+        m_shared->checkBudget(m_peakBytes);
+        m_duration = converter.toSeconds(end - start);
+    }
+};
+
+static const turf::extra::Option Options[] = {
+    {"keysPerThread", 'k', true, "number of keys inserted by each thread"},
+    {"collideShift", 's', true, "number of low hash bits shared by the colliding keys"},
+    {"maxMegabytes", 'm', true, "abandon a distribution once the map uses this much memory"},
+    {"maxMigrations", 'g', true, "abandon a distribution after this many table migrations"},
+};
+
+int main(int argc, const char** argv) {
+    turf::extra::Options options(Options, TURF_STATIC_ARRAY_SIZE(Options));
+    options.parse(argc, argv);
+    ureg keysPerThread = options.getInteger("keysPerThread", DefaultKeysPerThread);
+    ureg collideShift = options.getInteger("collideShift", DefaultCollideShift);
+    ureg maxBytes = options.getInteger("maxMegabytes", DefaultMaxMegabytes) << 20;
+    ureg maxMigrations = options.getInteger("maxMigrations", DefaultMaxMigrations);
+
+    turf::extra::JobDispatcher dispatcher;
+    ureg numThreads = dispatcher.getNumPhysicalCores();
+    TURF_ASSERT(numThreads > 0);
+    ureg numKeys = numThreads * keysPerThread;
+    // Every distribution must produce distinct keys.
+    TURF_ASSERT(numKeys < (ureg(1) << 20));
+    TURF_ASSERT((u64(numKeys) << collideShift) <= 0xffffffffu);
+    MapAdapter adapter(numThreads);
+
+    SharedState shared(adapter, keysPerThread, collideShift, maxBytes, maxMigrations);
+    std::vector<ThreadState> threads;
+    threads.reserve(numThreads);
+    for (ureg t = 0; t < numThreads; t++)
+        threads.push_back(ThreadState(&shared, t));
+    for (ureg t = 0; t < numThreads; t++)
+        dispatcher.kickOne(t, &ThreadState::registerThread, threads[t]);
+
+    printf("{\n");
+    printf("'mapType': '%s',\n", MapAdapter::getMapName());
+    printf("'numThreads': %d,\n", (int) numThreads);
+    printf("'numKeys': %d,\n", (int) numKeys);
+    printf("'collideShift': %d,\n", (int) collideShift);
+    // migrations and peakBytes are -1 when the build doesn't track them.
+    // completed is 0 if the distribution was abandoned for exceeding the budget.
+    printf("'labels': ('distribution', 'mapOpsDone', 'totalTime', 'migrations', 'peakBytes', 'completed'),\n");
+    printf("'points': [\n");
+    for (ureg d = 0; d < Distribution_Count; d++) {
+        shared.distribution = Distribution(d);
+        shared.abortFlag.storeNonatomic(0);
+        shared.startBytes = getUsedBytes();
+        shared.startMigrations = getNumMigrations();
+        ureg mapOpsDone = 0;
+        ureg peakBytes = 0;
+        double totalTime = 0;
+        {
+            MapAdapter::Map map(MapAdapter::getInitialCapacity(numKeys));
+            shared.map = &map;
+            dispatcher.kickMulti(&ThreadState::run, &threads[0], numThreads);
+            for (ureg t = 0; t < numThreads; t++) {
+                mapOpsDone += threads[t].m_mapOpsDone;
+                peakBytes = turf::util::max(peakBytes, threads[t].m_peakBytes);
+                totalTime += threads[t].m_duration;
+            }
+            shared.map = NULL;
+        }
+        sreg migrations = JUNCTION_TRACK_MIGRATION_STATS ? sreg(getNumMigrations() - shared.startMigrations) : -1;
+        printf("    ('%s', %lld, %f, %lld, %lld, %d),\n", DistributionNames[d], (long long) mapOpsDone, totalTime,
+               (long long) migrations, HAS_MEMORY_STATS ? (long long) peakBytes : -1LL,
+               shared.abortFlag.load(turf::Relaxed) ? 0 : 1);
+    }
+    printf("],\n");
+    printf("}\n");
+
+    dispatcher.kickMulti(&ThreadState::unregisterThread, &threads[0], threads.size());
+    return 0;
+}
@@ -16,6 +16,21 @@
 #include "TestInsertDifferentKeys.h"
 #include "TestChurn.h"
 #include "TestDoubleAssign.h"
+#include "TestCounterMap.h"
+#include "TestCache.h"
+#include "TestExpiringMap.h"
+#include "TestCompareExchange.h"
+#include "TestSingleMapChurn.h"
+#include "TestSingleMapReuse.h"
+#include "TestCrudePlus.h"
+#include "TestBuildFrom.h"
+#include "TestSnapshotFile.h"
+#include "TestSnapshotScan.h"
+#include "TestFlatTreeDepth.h"
+#include "TestChurnMigrations.h"
+#include <junction/ConcurrentMap_Linear.h>
+#include <junction/ConcurrentMap_Leapfrog.h>
+#include <junction/ConcurrentMap_Grampa.h>
 #include <turf/extra/Options.h>
 #include <junction/details/Grampa.h> // for GrampaStats
 
@@ -28,12 +43,52 @@ int main(int argc, const char** argv) {
     TestInsertDifferentKeys testInsertDifferentKeys(env);
     TestChurn testChurn(env);
     TestDoubleAssign testDoubleAssign(env);
+    TestCounterMap testCounterMap(env);
+    TestCache testCache(env);
+    TestExpiringMap testExpiringMap(env);
+    TestCompareExchange<junction::ConcurrentMap_Linear<u32, uptr>> testCompareExchangeLinear(env);
+    TestCompareExchange<junction::ConcurrentMap_Leapfrog<u32, uptr>> testCompareExchangeLeapfrog(env);
+    TestCompareExchange<junction::ConcurrentMap_Grampa<u32, uptr>> testCompareExchangeGrampa(env);
+    TestSingleMapChurn testSingleMapChurn(env);
+    TestSingleMapReuse<junction::SingleMap_Leapfrog> testSingleMapReuseLeapfrog(env);
+    TestSingleMapReuse<junction::SingleMap_Linear> testSingleMapReuseLinear(env);
+    TestCrudePlus testCrudePlus(env);
+    TestBuildFrom<junction::SingleMap_Leapfrog<u32, void*>> testBuildFromSingleMap(env);
+    TestBuildFrom<junction::ConcurrentMap_Leapfrog<u32, void*>> testBuildFromLeapfrog(env);
+    TestBuildFrom<junction::ConcurrentMap_Grampa<u32, void*>> testBuildFromGrampa(env);
+    TestSnapshotFile<junction::ConcurrentMap_Leapfrog<u32, uptr>> testSnapshotFileLeapfrog(env, "MapCorrectnessTests.lf.snap");
+    TestSnapshotFile<junction::ConcurrentMap_Grampa<u32, uptr>> testSnapshotFileGrampa(env, "MapCorrectnessTests.gr.snap");
+    TestSnapshotScan<junction::ConcurrentMap_Leapfrog<u32, uptr>> testSnapshotScanLeapfrog(env);
+    TestSnapshotScan<junction::ConcurrentMap_Grampa<u32, uptr>> testSnapshotScanGrampa(env);
+    TestFlatTreeDepth testFlatTreeDepth(env, "MapCorrectnessTests.ft.snap");
+    TestChurnMigrations<junction::ConcurrentMap_Leapfrog<u32, uptr>> testChurnMigrationsLeapfrog(env);
+    TestChurnMigrations<junction::ConcurrentMap_Grampa<u32, uptr>> testChurnMigrationsGrampa(env);
     for (;;) {
         for (ureg c = 0; c < IterationsPerLog; c++) {
             testInsertSameKeys.run();
             testInsertDifferentKeys.run();
             testChurn.run();
             testDoubleAssign.run();
+            testCounterMap.run();
+            testCache.run();
+            testExpiringMap.run();
+            testCompareExchangeLinear.run();
+            testCompareExchangeLeapfrog.run();
+            testCompareExchangeGrampa.run();
+            testSingleMapChurn.run();
+            testSingleMapReuseLeapfrog.run();
+            testSingleMapReuseLinear.run();
+            testCrudePlus.run();
+            testBuildFromSingleMap.run();
+            testBuildFromLeapfrog.run();
+            testBuildFromGrampa.run();
+            testSnapshotFileLeapfrog.run();
+            testSnapshotFileGrampa.run();
+            testSnapshotScanLeapfrog.run();
+            testSnapshotScanGrampa.run();
+            testFlatTreeDepth.run();
+            testChurnMigrationsLeapfrog.run();
+            testChurnMigrationsGrampa.run();
         }
         turf::Trace::Instance.dumpStats();
 
@@ -47,8 +102,6 @@ int main(int argc, const char** argv) {
                (int) stats.numTableMigrations.total.load(turf::Relaxed));
         printf("numFlatTrees: %d/%d\n", (int) stats.numFlatTrees.current.load(turf::Relaxed),
                (int) stats.numFlatTrees.total.load(turf::Relaxed));
-        printf("numFlatTreeMigrations: %d/%d\n", (int) stats.numFlatTreeMigrations.current.load(turf::Relaxed),
-               (int) stats.numFlatTreeMigrations.total.load(turf::Relaxed));
 #endif
     }
 
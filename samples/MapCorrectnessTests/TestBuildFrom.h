@@ -0,0 +1,88 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTBUILDFROM_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTBUILDFROM_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <junction/SingleMap_Leapfrog.h>
+#include <junction/MapTraits.h>
+#include <utility>
+#include <vector>
+
+// Fills one map with buildFrom() and another by assigning the same pairs one at a time, in order, then checks that
+// both hold the same value for every key. Some keys appear up to three times, so the last value must win. Runs once
+// with fewer keys than fit in a Grampa leaf, and once with enough to need a flattree. Runs on a single thread.
+template <class Map>
+class TestBuildFrom {
+public:
+    typedef std::pair<u32, void*> Pair;
+
+    static const ureg LeafSize = ureg(1) << junction::DefaultTuningTraits::LeafSizeBits;
+    static const ureg NumRounds = 3;
+
+    TestEnvironment& m_env;
+
+    TestBuildFrom(TestEnvironment& env) : m_env(env) {
+    }
+
+    template <class M>
+    static void assignValue(M& map, u32 key, void* value) {
+        map.assign(key, value);
+    }
+
+    static void assignValue(junction::SingleMap_Leapfrog<u32, void*>& map, u32 key, void* value) {
+        map.set(key, value);
+    }
+
+    static u32 keyForIndex(ureg index) {
+        return u32(index + 1);
+    }
+
+    static void* valueFor(u32 key, ureg round) {
+        return (void*) ((uptr(key) << 4) | (round << 2));
+    }
+
+    void check(ureg numKeys) {
+        // Key k appears in rounds 0 to k % NumRounds, so a third of the keys have a single value, and the rest are
+        // overwritten once or twice, far from where they first appeared.
+        std::vector<Pair> pairs;
+        for (ureg round = 0; round < NumRounds; round++) {
+            for (ureg i = 0; i < numKeys; i++) {
+                u32 key = keyForIndex(i);
+                if (key % NumRounds >= round)
+                    pairs.push_back(Pair(key, valueFor(key, round)));
+            }
+        }
+        Map built;
+        built.buildFrom(pairs.begin(), pairs.end());
+        Map assigned;
+        for (ureg i = 0; i < pairs.size(); i++)
+            assignValue(assigned, pairs[i].first, pairs[i].second);
+        for (ureg i = 0; i < numKeys; i++) {
+            u32 key = keyForIndex(i);
+            void* value = built.get(key);
+            if (value != valueFor(key, key % NumRounds) || value != assigned.get(key))
+                TURF_DEBUG_BREAK();
+        }
+        if (built.get(keyForIndex(numKeys)) != NULL)
+            TURF_DEBUG_BREAK();
+    }
+
+    void run() {
+        check(LeafSize / 4);
+        check(LeafSize * 8);
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTBUILDFROM_H
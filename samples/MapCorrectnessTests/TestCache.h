@@ -0,0 +1,69 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTCACHE_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTCACHE_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <junction/ConcurrentCache.h>
+
+class TestCache {
+public:
+    static const ureg Capacity = 1000;
+    static const ureg KeyRange = 10000;
+    static const ureg OpsPerThread = 20000;
+    typedef junction::ConcurrentCache<u32, uptr> Cache;
+
+    TestEnvironment& m_env;
+    Cache* m_cache;
+
+    TestCache(TestEnvironment& env) : m_env(env), m_cache(NULL) {
+    }
+
+    static uptr valueForKey(u32 key) {
+        return uptr(key) << 2; // Keep the two low bits clear
+    }
+
+    void accessKeys(ureg threadIndex) {
+        for (ureg i = 0; i < OpsPerThread; i++) {
+            u32 key = u32((i * 7919 + threadIndex * 104729) % KeyRange + 1);
+            if (i % 4 == 0) {
+                m_cache->assign(key, valueForKey(key));
+            } else {
+                uptr value = m_cache->get(key);
+                if (value != 0 && value != valueForKey(key))
+                    TURF_DEBUG_BREAK();
+            }
+            if ((i & 255) == 0)
+                m_env.threads[threadIndex].update();
+        }
+        m_env.threads[threadIndex].update();
+    }
+
+    void run() {
+        m_cache = new Cache(Capacity);
+        m_env.dispatcher.kick(&TestCache::accessKeys, *this);
+        // Each thread may overshoot by one entry while another thread is sweeping.
+        if (m_cache->getSize() > Capacity + m_env.numThreads)
+            TURF_DEBUG_BREAK();
+        ureg population = 0;
+        for (Cache::Map::Iterator iter(m_cache->getMap()); iter.isValid(); iter.next())
+            population++;
+        if (population != m_cache->getSize())
+            TURF_DEBUG_BREAK();
+        delete m_cache;
+        m_cache = NULL;
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTCACHE_H
@@ -0,0 +1,103 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTCHURNMIGRATIONS_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTCHURNMIGRATIONS_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <junction/MigrationObserver.h>
+#include <turf/Util.h>
+
+// Every thread erases and inserts keys over a rotating window of its own, and a MigrationObserver counts the
+// migrations. Erased cells stay reserved until the next migration, so the map keeps migrating, but a migration
+// caused by erased cells must size the new table at ChurnSizeFactor times the live keys. With the default factor of
+// 4, that allows at most one migration per MinInsertsPerMigration inserts. Sizing it at twice the live keys, as for
+// growth, migrates about twice as often as that. The window fits in a single Grampa leaf.
+template <class Map>
+class TestChurnMigrations {
+public:
+    static const ureg KeysToMaintain = 80;  // Across all threads
+    static const ureg ChurnSteps = 100000;  // Across all threads
+    static const ureg MinInsertsPerMigration = KeysToMaintain * 3;
+    static const u32 KeysPerThreadRange = 0x1000000;
+
+    struct CountingObserver : junction::MigrationObserver {
+        turf::Atomic<ureg> numPublished;
+
+        CountingObserver() {
+            numPublished.storeNonatomic(0);
+        }
+
+        virtual void onMigrationEvent(const Event& event) {
+            if (event.type == TableMigrationPublish)
+                numPublished.fetchAdd(1, turf::Relaxed);
+        }
+    };
+
+    TestEnvironment& m_env;
+    Map* m_map;
+    ureg m_keysPerThread;
+    ureg m_stepsPerThread;
+
+    TestChurnMigrations(TestEnvironment& env) : m_env(env), m_map(NULL), m_keysPerThread(0), m_stepsPerThread(0) {
+    }
+
+    static u32 keyForIndex(ureg threadIndex, ureg index) {
+        return u32(threadIndex * KeysPerThreadRange + index + 1);
+    }
+
+    static uptr valueForKey(u32 key) {
+        return uptr(key) << 2;
+    }
+
+    void warmUp(ureg threadIndex) {
+        for (ureg i = 0; i < m_keysPerThread; i++)
+            m_map->assign(keyForIndex(threadIndex, i), valueForKey(keyForIndex(threadIndex, i)));
+        m_env.threads[threadIndex].update();
+    }
+
+    void churn(ureg threadIndex) {
+        for (ureg i = 0; i < m_stepsPerThread; i++) {
+            u32 oldKey = keyForIndex(threadIndex, i);
+            if (m_map->erase(oldKey) != valueForKey(oldKey))
+                TURF_DEBUG_BREAK();
+            u32 newKey = keyForIndex(threadIndex, i + m_keysPerThread);
+            m_map->assign(newKey, valueForKey(newKey));
+            if (m_map->get(oldKey) != uptr(0))
+                TURF_DEBUG_BREAK();
+        }
+        for (ureg i = m_stepsPerThread; i < m_stepsPerThread + m_keysPerThread; i++) {
+            if (m_map->get(keyForIndex(threadIndex, i)) != valueForKey(keyForIndex(threadIndex, i)))
+                TURF_DEBUG_BREAK();
+        }
+        m_env.threads[threadIndex].update();
+    }
+
+    void run() {
+        m_keysPerThread = turf::util::max(KeysToMaintain / m_env.numThreads, ureg(1));
+        m_stepsPerThread = ChurnSteps / m_env.numThreads;
+        CountingObserver observer;
+        m_map = new Map;
+        m_map->setMigrationObserver(&observer);
+        m_env.dispatcher.kick(&TestChurnMigrations::warmUp, *this);
+        ureg migrationsAfterWarmUp = observer.numPublished.load(turf::Relaxed);
+        m_env.dispatcher.kick(&TestChurnMigrations::churn, *this);
+        ureg churnMigrations = observer.numPublished.load(turf::Relaxed) - migrationsAfterWarmUp;
+        if (churnMigrations > m_stepsPerThread * m_env.numThreads / MinInsertsPerMigration)
+            TURF_DEBUG_BREAK();
+        delete m_map;
+        m_map = NULL;
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTCHURNMIGRATIONS_H
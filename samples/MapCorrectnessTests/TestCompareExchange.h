@@ -0,0 +1,125 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTCOMPAREEXCHANGE_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTCOMPAREEXCHANGE_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <turf/Atomic.h>
+
+// Runs compareExchange() increments, then eraseIfEquals(), on keys shared by every thread. Meanwhile, each thread
+// keeps inserting keys of its own into a map that starts out tiny, so that the CASes keep running into migrations.
+template <class Map>
+class TestCompareExchange {
+public:
+    static const ureg KeysToCount = 500;
+    static const ureg AddsPerKey = 10;
+    static const u32 FillerKeyBase = 0x10000000;
+    static const ureg FillersPerThread = KeysToCount * AddsPerKey;
+
+    TestEnvironment& m_env;
+    Map* m_map;
+    turf::Atomic<ureg> m_numErased;
+
+    TestCompareExchange(TestEnvironment& env) : m_env(env), m_map(NULL) {
+    }
+
+    // Values are counts shifted left by two, keeping clear of NullValue and Redirect.
+    static uptr valueForCount(ureg count) {
+        return uptr(count) << 2;
+    }
+
+    void insertFiller(ureg threadIndex, ureg i) {
+        u32 key = u32(FillerKeyBase + threadIndex * FillersPerThread * 2 + i);
+        m_map->assign(key, valueForCount(1));
+    }
+
+    void addToKeys(ureg threadIndex) {
+        ureg numFillers = 0;
+        // Start each thread at a different key so that the CASes race with each other.
+        for (ureg i = 0; i < KeysToCount; i++) {
+            u32 key = u32((i + threadIndex * 97) % KeysToCount + 1);
+            for (ureg a = 0; a < AddsPerKey; a++) {
+                for (;;) {
+                    uptr expected = m_map->get(key);
+                    if (m_map->compareExchange(key, expected, expected + valueForCount(1)) == expected)
+                        break;
+                }
+                insertFiller(threadIndex, numFillers++);
+            }
+        }
+        m_env.threads[threadIndex].update();
+    }
+
+    void eraseKeys(ureg threadIndex) {
+        uptr total = valueForCount(AddsPerKey * m_env.numThreads);
+        ureg numErased = 0;
+        ureg numFillers = FillersPerThread;
+        for (ureg i = 0; i < KeysToCount; i++) {
+            u32 key = u32((i + threadIndex * 97) % KeysToCount + 1);
+            // A mismatched value must never be erased, even after a redirect.
+            if (m_map->eraseIfEquals(key, total + valueForCount(1)))
+                TURF_DEBUG_BREAK();
+            if (m_map->eraseIfEquals(key, total))
+                numErased++;
+            // Double the population again, so that the erases run into migrations too.
+            for (ureg a = 0; a < AddsPerKey; a++)
+                insertFiller(threadIndex, numFillers++);
+        }
+        m_numErased.fetchAdd(numErased, turf::Relaxed);
+        m_env.threads[threadIndex].update();
+    }
+
+    void checkCounts(uptr expected) {
+        for (ureg i = 0; i < KeysToCount; i++) {
+            if (m_map->get(u32(i + 1)) != expected)
+                TURF_DEBUG_BREAK();
+        }
+    }
+
+    // A conditional erase that's redirected after its key was erased must not insert the key into the new table.
+    // The erased cell would show up there as a tombstone. Runs on a single thread.
+    void checkEraseAfterMigration() {
+        Map map(8);
+        u32 key = 1;
+        map.assign(key, valueForCount(1));
+        typename Map::Mutator mutator = map.find(key);
+        map.erase(key);
+        // Migrate the table, which purges the erased cell and redirects it.
+        for (ureg i = 0; i < KeysToCount; i++)
+            map.assign(u32(FillerKeyBase + i), valueForCount(1));
+        if (map.collectStats().numTombstones != 0)
+            TURF_DEBUG_BREAK();
+        if (mutator.eraseIfEquals(valueForCount(1)) || mutator.getValue() != 0)
+            TURF_DEBUG_BREAK();
+        if (map.collectStats().numTombstones != 0 || map.get(key) != 0)
+            TURF_DEBUG_BREAK();
+    }
+
+    void run() {
+        checkEraseAfterMigration();
+        m_map = new Map(8);
+        m_numErased.storeNonatomic(0);
+        m_env.dispatcher.kick(&TestCompareExchange::addToKeys, *this);
+        checkCounts(valueForCount(AddsPerKey * m_env.numThreads));
+        m_env.dispatcher.kick(&TestCompareExchange::eraseKeys, *this);
+        // Every key was erased, and by exactly one thread.
+        if (m_numErased.loadNonatomic() != KeysToCount)
+            TURF_DEBUG_BREAK();
+        checkCounts(0);
+        delete m_map;
+        m_map = NULL;
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTCOMPAREEXCHANGE_H
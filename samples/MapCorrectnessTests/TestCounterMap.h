@@ -0,0 +1,94 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTCOUNTERMAP_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTCOUNTERMAP_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <junction/ConcurrentCounterMap.h>
+
+class TestCounterMap {
+public:
+    static const ureg KeysToCount = 1000;
+    static const ureg AddsPerKey = 20;
+    typedef junction::ConcurrentCounterMap<u32> CounterMap;
+
+    TestEnvironment& m_env;
+    CounterMap* m_map;
+
+    TestCounterMap(TestEnvironment& env) : m_env(env), m_map(NULL) {
+    }
+
+    void addToKeys(ureg threadIndex) {
+        // Start each thread at a different key so that some adds race with migrations.
+        for (ureg i = 0; i < KeysToCount; i++) {
+            u32 key = u32((i + threadIndex * 97) % KeysToCount + 1);
+            for (ureg a = 0; a < AddsPerKey; a++)
+                m_map->increment(key);
+        }
+        m_env.threads[threadIndex].update();
+    }
+
+    void subtractFromKeys(ureg threadIndex) {
+        for (ureg i = 0; i < KeysToCount; i++) {
+            u32 key = u32((i + threadIndex * 97) % KeysToCount + 1);
+            m_map->add(key, -sreg(AddsPerKey));
+        }
+        m_env.threads[threadIndex].update();
+    }
+
+    void checkCounts(sreg expected) {
+        for (ureg i = 0; i < KeysToCount; i++) {
+            if (m_map->get(u32(i + 1)) != expected)
+                TURF_DEBUG_BREAK();
+        }
+    }
+
+    // With DefaultValueTraits, Redirect is 1, so counting would store it. Such maps must refuse fetchAdd().
+    typedef junction::ConcurrentMap_Leapfrog<u32, u32> DefaultMap;
+    TURF_STATIC_ASSERT(!DefaultMap::SupportsFetchAdd);
+    TURF_STATIC_ASSERT(CounterMap::Map::SupportsFetchAdd);
+
+    // Counts that overflow onto Redirect, the most negative value, must step over it rather than store it. Runs on
+    // a single thread. The map starts out tiny, so the counts are migrated several times along the way.
+    void checkOverflow() {
+        typedef junction::ConcurrentCounterMap<u32, u32> UnsignedMap;
+        UnsignedMap map;
+        for (ureg i = 0; i < KeysToCount; i++) {
+            u32 key = u32(i + 1);
+            map.add(key, 0x7fffffff);
+            if (map.increment(key) != 0x7fffffff || map.get(key) != 0x80000001)
+                TURF_DEBUG_BREAK();
+            if (map.decrement(key) != 0x80000001 || map.get(key) != 0x7fffffff)
+                TURF_DEBUG_BREAK();
+            map.increment(key); // Back to 0x80000001
+        }
+        for (ureg i = 0; i < KeysToCount; i++) {
+            if (map.get(u32(i + 1)) != 0x80000001)
+                TURF_DEBUG_BREAK();
+        }
+    }
+
+    void run() {
+        checkOverflow();
+        m_map = new CounterMap;
+        m_env.dispatcher.kick(&TestCounterMap::addToKeys, *this);
+        checkCounts(sreg(AddsPerKey * m_env.numThreads));
+        m_env.dispatcher.kick(&TestCounterMap::subtractFromKeys, *this);
+        checkCounts(0); // Every count returned to zero, so every key was erased.
+        delete m_map;
+        m_map = NULL;
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTCOUNTERMAP_H
@@ -0,0 +1,108 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTCRUDEPLUS_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTCRUDEPLUS_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <junction/ConcurrentMap_CrudePlus.h>
+
+// Runs assign(), get() and erase() on every thread against a ConcurrentMap_CrudePlus that starts at its minimum
+// capacity, so that the operations race with many calls to grow(). Some keys are erased and inserted again. Then
+// every key is erased while fresh keys come and go, and the map must not grow to hold all the erased keys.
+class TestCrudePlus {
+public:
+    typedef junction::ConcurrentMap_CrudePlus<u32, uptr> Map;
+
+    static const ureg KeysPerThread = 2000;
+    static const ureg ReinsertPeriod = 3;
+    static const ureg ChurnKeysPerThread = 20000;
+    static const u32 ChurnKeyBase = 0x10000000;
+
+    TestEnvironment& m_env;
+    Map* m_map;
+
+    TestCrudePlus(TestEnvironment& env) : m_env(env), m_map(NULL) {
+    }
+
+    static u32 keyFor(ureg threadIndex, ureg i) {
+        return u32(threadIndex * KeysPerThread + i + 1);
+    }
+
+    // The low two bits keep values clear of NullValue and Redirect, and tell the two values of a key apart.
+    static uptr valueFor(u32 key, bool reinserted) {
+        return (uptr(key) << 2) | (reinserted ? 2 : 0);
+    }
+
+    void insertKeys(ureg threadIndex) {
+        for (ureg i = 0; i < KeysPerThread; i++) {
+            u32 key = keyFor(threadIndex, i);
+            m_map->assign(key, valueFor(key, false));
+            if (m_map->get(key) != valueFor(key, false))
+                TURF_DEBUG_BREAK();
+            if (i % ReinsertPeriod == 0) {
+                if (m_map->erase(key) != valueFor(key, false))
+                    TURF_DEBUG_BREAK();
+                if (m_map->get(key) != 0)
+                    TURF_DEBUG_BREAK();
+                // The key still has its cell, unless a rehash just dropped it.
+                m_map->assign(key, valueFor(key, true));
+                if (m_map->get(key) != valueFor(key, true))
+                    TURF_DEBUG_BREAK();
+            }
+        }
+        m_env.threads[threadIndex].update();
+    }
+
+    void eraseKeys(ureg threadIndex) {
+        for (ureg i = 0; i < KeysPerThread; i++) {
+            u32 key = keyFor(threadIndex, i);
+            if (m_map->erase(key) != valueFor(key, i % ReinsertPeriod == 0))
+                TURF_DEBUG_BREAK();
+        }
+        // Each fresh key claims a cell, so these keep triggering rehashes of a table that's full of erased keys.
+        for (ureg i = 0; i < ChurnKeysPerThread; i++) {
+            u32 key = u32(ChurnKeyBase + threadIndex * ChurnKeysPerThread + i);
+            m_map->assign(key, valueFor(key, false));
+            if (m_map->erase(key) != valueFor(key, false))
+                TURF_DEBUG_BREAK();
+        }
+        m_env.threads[threadIndex].update();
+    }
+
+    void run() {
+        m_map = new Map(Map::MinCapacity);
+        m_env.dispatcher.kick(&TestCrudePlus::insertKeys, *this);
+        for (ureg t = 0; t < m_env.numThreads; t++) {
+            for (ureg i = 0; i < KeysPerThread; i++) {
+                u32 key = keyFor(t, i);
+                if (m_map->get(key) != valueFor(key, i % ReinsertPeriod == 0))
+                    TURF_DEBUG_BREAK();
+            }
+        }
+        m_env.dispatcher.kick(&TestCrudePlus::eraseKeys, *this);
+        for (ureg t = 0; t < m_env.numThreads; t++) {
+            for (ureg i = 0; i < KeysPerThread; i++) {
+                if (m_map->get(keyFor(t, i)) != 0)
+                    TURF_DEBUG_BREAK();
+            }
+        }
+        // Had the rehashes kept erased keys, the map would need a cell for every key ever inserted.
+        if (m_map->getCapacity() >= (KeysPerThread + ChurnKeysPerThread) * m_env.numThreads)
+            TURF_DEBUG_BREAK();
+        delete m_map;
+        m_map = NULL;
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTCRUDEPLUS_H
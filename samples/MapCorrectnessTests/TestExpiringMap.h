@@ -0,0 +1,80 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTEXPIRINGMAP_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTEXPIRINGMAP_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <junction/ConcurrentExpiringMap.h>
+
+class TestExpiringMap {
+public:
+    static const ureg KeysPerThread = 2000;
+    typedef junction::ConcurrentExpiringMap<u32> ExpiringMap;
+
+    TestEnvironment& m_env;
+    ExpiringMap* m_map;
+    turf::Atomic<ureg> m_numExpired;
+
+    TestExpiringMap(TestEnvironment& env) : m_env(env), m_map(NULL), m_numExpired(0) {
+    }
+
+    static void onExpire(u32, u32, void* param) {
+        ((TestExpiringMap*) param)->m_numExpired.fetchAdd(1, turf::Relaxed);
+    }
+
+    // Short-lived keys expire at time 2, long-lived keys at time 3.
+    void insertShortLived(ureg threadIndex) {
+        u32 base = u32(threadIndex * KeysPerThread * 2);
+        for (ureg i = 0; i < KeysPerThread; i++)
+            m_map->assign(base + u32(i) + 1, u32(i) + 1, 2);
+        m_env.threads[threadIndex].update();
+    }
+
+    // Inserting the long-lived keys forces several migrations, which drop the expired short-lived keys.
+    void insertLongLived(ureg threadIndex) {
+        u32 base = u32(threadIndex * KeysPerThread * 2 + KeysPerThread);
+        for (ureg i = 0; i < KeysPerThread; i++) {
+            m_map->assign(base + u32(i) + 1, u32(i) + 1, 3);
+            if (i % 128 == 0)
+                m_map->sweep(1);
+        }
+        m_env.threads[threadIndex].update();
+    }
+
+    void run() {
+        m_map = new ExpiringMap(ExpiringMap::Details::InitialSize, onExpire, this);
+        m_numExpired.storeNonatomic(0);
+        m_map->setCurrentTime(1);
+        m_env.dispatcher.kick(&TestExpiringMap::insertShortLived, *this);
+        m_map->setCurrentTime(2);
+        m_env.dispatcher.kick(&TestExpiringMap::insertLongLived, *this);
+        m_map->sweep(m_map->getNumSweepUnits());
+        // Every short-lived key has been reported exactly once, whichever way it was removed.
+        if (m_numExpired.load(turf::Relaxed) != KeysPerThread * m_env.numThreads)
+            TURF_DEBUG_BREAK();
+        for (ureg t = 0; t < m_env.numThreads; t++) {
+            u32 base = u32(t * KeysPerThread * 2);
+            for (ureg i = 0; i < KeysPerThread; i++) {
+                if (m_map->get(base + u32(i) + 1) != 0)
+                    TURF_DEBUG_BREAK();
+                if (m_map->get(base + u32(KeysPerThread + i) + 1) != u32(i) + 1)
+                    TURF_DEBUG_BREAK();
+            }
+        }
+        delete m_map;
+        m_map = NULL;
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTEXPIRINGMAP_H
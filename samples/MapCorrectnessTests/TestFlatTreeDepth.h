@@ -0,0 +1,135 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTFLATTREEDEPTH_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTFLATTREEDEPTH_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <junction/ConcurrentMap_Grampa.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Every thread inserts keys whose hashes share their top 15 bits, along with keys whose hashes are spread out.
+// The narrow keys only fit in leaves that cover a small part of the hash space, so the leaves that hold them sit
+// several flattree nodes deep, next to leaves that never split at all. Leaves split concurrently at every level.
+// Then every key is checked with get(), the Iterator, snapshot() and collectStats(), and again after a
+// saveSnapshot() / loadSnapshot() round trip, which rebuilds the flattree from its slots.
+class TestFlatTreeDepth {
+public:
+    typedef junction::ConcurrentMap_Grampa<u32, uptr> Map;
+    typedef Map::KeyTraits KeyTraits;
+
+    static const ureg LeafSize = ureg(1) << junction::DefaultTuningTraits::LeafSizeBits;
+    static const u32 NarrowRange = 0x20000;
+    static const u32 NarrowBase = 0x5a5a0000; // A multiple of NarrowRange
+    static const ureg NumNarrowKeys = LeafSize * 16;
+    static const ureg NumWideKeys = LeafSize * 16;
+
+    struct CountingSink {
+        ureg& count;
+
+        CountingSink(ureg& count) : count(count) {
+        }
+
+        void operator()(u32 key, uptr value) {
+            if (value != valueForKey(key))
+                TURF_DEBUG_BREAK();
+            count++;
+        }
+    };
+
+    TestEnvironment& m_env;
+    std::string m_path;
+    Map* m_map;
+
+    TestFlatTreeDepth(TestEnvironment& env, const char* path) : m_env(env), m_path(path), m_map(NULL) {
+    }
+
+    static uptr valueForKey(u32 key) {
+        return uptr(key) << 2;
+    }
+
+    static u32 narrowKey(ureg i) {
+        return KeyTraits::dehash(u32(NarrowBase + i));
+    }
+
+    // Spreads the hashes with an odd multiplier, and steps over the narrow range.
+    static u32 wideKey(ureg i) {
+        u32 hash = u32((i + 1) * 0x9e3779b1u);
+        if (hash - NarrowBase < NarrowRange)
+            hash ^= 0x80000000u;
+        return KeyTraits::dehash(hash);
+    }
+
+    void insertKeys(ureg threadIndex) {
+        for (ureg i = threadIndex; i < NumNarrowKeys; i += m_env.numThreads) {
+            m_map->assign(narrowKey(i), valueForKey(narrowKey(i)));
+            m_map->assign(wideKey(i), valueForKey(wideKey(i)));
+            if (m_map->get(narrowKey(i)) != valueForKey(narrowKey(i)))
+                TURF_DEBUG_BREAK();
+        }
+        m_env.threads[threadIndex].update();
+    }
+
+    void checkKeys() {
+        for (ureg i = 0; i < NumNarrowKeys; i++) {
+            if (m_map->get(narrowKey(i)) != valueForKey(narrowKey(i)))
+                TURF_DEBUG_BREAK();
+        }
+        for (ureg i = 0; i < NumWideKeys; i++) {
+            if (m_map->get(wideKey(i)) != valueForKey(wideKey(i)))
+                TURF_DEBUG_BREAK();
+        }
+        ureg count = 0;
+        for (Map::Iterator iter(*m_map); iter.isValid(); iter.next()) {
+            if (iter.getValue() != valueForKey(iter.getKey()))
+                TURF_DEBUG_BREAK();
+            count++;
+        }
+        if (count != NumNarrowKeys + NumWideKeys)
+            TURF_DEBUG_BREAK();
+        count = 0;
+        m_map->snapshot(CountingSink(count));
+        if (count != NumNarrowKeys + NumWideKeys)
+            TURF_DEBUG_BREAK();
+        junction::MapStats stats = m_map->collectStats();
+        if (stats.numCellsInUse != NumNarrowKeys + NumWideKeys)
+            TURF_DEBUG_BREAK();
+        // The narrow keys alone need this many leaves.
+        if (stats.numTables < NumNarrowKeys / LeafSize)
+            TURF_DEBUG_BREAK();
+    }
+
+    void run() {
+        TURF_STATIC_ASSERT(NumNarrowKeys <= NarrowRange && NumNarrowKeys == NumWideKeys);
+        m_map = new Map;
+        m_env.dispatcher.kick(&TestFlatTreeDepth::insertKeys, *this);
+        checkKeys();
+        if (!m_map->saveSnapshot(m_path.c_str()))
+            TURF_DEBUG_BREAK();
+        delete m_map;
+
+        m_map = new Map;
+        if (!m_map->loadSnapshot(m_path.c_str()))
+            TURF_DEBUG_BREAK();
+        checkKeys();
+        delete m_map;
+        m_map = NULL;
+        // The loaded tables may still lie in the file until DefaultQSBR frees them, so unlink it rather than
+        // overwriting it next time.
+        remove(m_path.c_str());
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTFLATTREEDEPTH_H
@@ -0,0 +1,106 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTSINGLEMAPCHURN_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTSINGLEMAPCHURN_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <junction/SingleMap_Leapfrog.h>
+#include <turf/Heap.h>
+
+// Erases and inserts keys over a rotating window in a SingleMap_Leapfrog. Erased cells are freed right away, so once
+// the table is big enough for the window, the map must never migrate again. Each migration allocates a new table,
+// so the test counts allocations to catch them. Runs on a single thread.
+class TestSingleMapChurn {
+public:
+    static const ureg KeysToMaintain = 1000;
+    static const ureg ChurnSteps = 100000;
+
+    struct CountingAllocator {
+        ureg* numAllocs;
+
+        CountingAllocator(ureg* numAllocs = NULL) : numAllocs(numAllocs) {
+        }
+
+        void* alloc(ureg size) {
+            if (numAllocs)
+                (*numAllocs)++;
+            return TURF_HEAP.alloc(size);
+        }
+
+        void free(void* ptr, ureg size) {
+            TURF_UNUSED(size);
+            TURF_HEAP.free(ptr);
+        }
+    };
+
+    typedef junction::SingleMap_Leapfrog<u32, void*, junction::DefaultKeyTraits<u32>, junction::DefaultValueTraits<void*>,
+                                         CountingAllocator>
+        Map;
+
+    TestEnvironment& m_env;
+
+    TestSingleMapChurn(TestEnvironment& env) : m_env(env) {
+    }
+
+    static u32 keyForIndex(ureg index) {
+        return u32(index + 1);
+    }
+
+    static void* valueForIndex(ureg index) {
+        return (void*) ((uptr(index) + 1) << 2);
+    }
+
+    void checkMutatorErase(Map& map) {
+        // After erase(), the Mutator stays valid and can insert the key again.
+        u32 key = keyForIndex(ChurnSteps + KeysToMaintain);
+        Map::Mutator mutator = map.insertOrFindKey(key);
+        mutator.exchangeValue(valueForIndex(1));
+        if (mutator.erase() != valueForIndex(1))
+            TURF_DEBUG_BREAK();
+        if (!mutator.isValid() || mutator.getValue() != NULL || map.get(key) != NULL)
+            TURF_DEBUG_BREAK();
+        if (mutator.erase() != NULL)
+            TURF_DEBUG_BREAK();
+        mutator.exchangeValue(valueForIndex(2));
+        if (map.get(key) != valueForIndex(2))
+            TURF_DEBUG_BREAK();
+        map.erase(key);
+    }
+
+    void run() {
+        ureg numAllocs = 0;
+        Map map(8, CountingAllocator(&numAllocs));
+        map.reserve(KeysToMaintain);
+        for (ureg i = 0; i < KeysToMaintain; i++)
+            map.set(keyForIndex(i), valueForIndex(i));
+        ureg allocsAfterWarmUp = numAllocs;
+        for (ureg i = 0; i < ChurnSteps; i++) {
+            if (map.erase(keyForIndex(i)) != valueForIndex(i))
+                TURF_DEBUG_BREAK();
+            map.set(keyForIndex(i + KeysToMaintain), valueForIndex(i + KeysToMaintain));
+            if (map.get(keyForIndex(i)) != NULL)
+                TURF_DEBUG_BREAK();
+        }
+        // No migrations, whether to purge deleted cells or to grow.
+        if (numAllocs != allocsAfterWarmUp)
+            TURF_DEBUG_BREAK();
+        for (ureg i = ChurnSteps; i < ChurnSteps + KeysToMaintain; i++) {
+            if (map.get(keyForIndex(i)) != valueForIndex(i))
+                TURF_DEBUG_BREAK();
+        }
+        checkMutatorErase(map);
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTSINGLEMAPCHURN_H
@@ -0,0 +1,189 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTSINGLEMAPREUSE_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTSINGLEMAPREUSE_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include "TestSingleMapChurn.h"
+#include <junction/SingleMap_Linear.h>
+#include <junction/TableArena.h>
+#include <utility>
+
+// Checks the ways a single-threaded map hands its table on: move construction and move assignment, after which the
+// moved-from map must still work as an empty map; clear(), after which refilling the map must not allocate; and
+// TableArena, which must hand the tables of a destroyed map to the next map of the same shape. SingleMap is either
+// SingleMap_Leapfrog or SingleMap_Linear. Runs on a single thread.
+template <template <typename, typename, class, class, class> class SingleMap>
+class TestSingleMapReuse {
+public:
+    static const ureg NumKeys = 1000;
+
+    typedef TestSingleMapChurn::CountingAllocator CountingAllocator;
+    typedef SingleMap<u32, void*, junction::DefaultKeyTraits<u32>, junction::DefaultValueTraits<void*>, CountingAllocator>
+        CountingMap;
+    typedef SingleMap<u32, void*, junction::DefaultKeyTraits<u32>, junction::DefaultValueTraits<void*>,
+                      junction::TableArena::Allocator>
+        ArenaMap;
+
+    TestEnvironment& m_env;
+
+    TestSingleMapReuse(TestEnvironment& env) : m_env(env) {
+    }
+
+    static u32 keyForIndex(ureg index) {
+        return u32(index + 1);
+    }
+
+    static void* valueForIndex(ureg index) {
+        return (void*) ((uptr(index) + 1) << 2);
+    }
+
+    // SingleMap_Leapfrog calls it set() and SingleMap_Linear calls it assign().
+    template <class KT, class VT, class A>
+    static void put(junction::SingleMap_Leapfrog<u32, void*, KT, VT, A>& map, u32 key, void* value) {
+        map.set(key, value);
+    }
+
+    template <class KT, class VT, class A>
+    static void put(junction::SingleMap_Linear<u32, void*, KT, VT, A>& map, u32 key, void* value) {
+        map.assign(key, value);
+    }
+
+    template <class Map>
+    static void fill(Map& map, ureg first, ureg last) {
+        for (ureg i = first; i < last; i++)
+            put(map, keyForIndex(i), valueForIndex(i));
+    }
+
+    template <class Map>
+    static void check(Map& map, ureg first, ureg last) {
+        for (ureg i = first; i < last; i++) {
+            if (map.get(keyForIndex(i)) != valueForIndex(i))
+                TURF_DEBUG_BREAK();
+        }
+    }
+
+    template <class Map>
+    static void checkAbsent(Map& map, ureg first, ureg last) {
+        for (ureg i = first; i < last; i++) {
+            if (map.get(keyForIndex(i)) != NULL)
+                TURF_DEBUG_BREAK();
+        }
+    }
+
+    template <class Map>
+    static void checkEmpty(Map& map, ureg first, ureg last) {
+        checkAbsent(map, first, last);
+        if (map.collectStats().numCellsInUse != 0)
+            TURF_DEBUG_BREAK();
+    }
+
+    void testMove() {
+        ureg numAllocs = 0;
+        CountingMap a(8, CountingAllocator(&numAllocs));
+        fill(a, 0, NumKeys);
+
+        CountingMap b(std::move(a));
+        check(b, 0, NumKeys);
+        // The moved-from map is empty, and works like any other map.
+        checkEmpty(a, 0, NumKeys);
+        fill(a, NumKeys, NumKeys * 2);
+        check(a, NumKeys, NumKeys * 2);
+        a.clear();
+        checkEmpty(a, NumKeys, NumKeys * 2);
+
+        CountingMap c(8, CountingAllocator(&numAllocs));
+        fill(c, NumKeys * 2, NumKeys * 3);
+        ureg allocsBeforeAssign = numAllocs;
+        c = std::move(b);
+        // Move assignment takes b's table without allocating, and hands c's old table to b.
+        if (numAllocs != allocsBeforeAssign)
+            TURF_DEBUG_BREAK();
+        check(c, 0, NumKeys);
+        checkAbsent(c, NumKeys * 2, NumKeys * 3);
+        check(b, NumKeys * 2, NumKeys * 3);
+        b.clear();
+        checkEmpty(b, 0, NumKeys * 3);
+        fill(b, 0, NumKeys);
+        check(b, 0, NumKeys);
+
+        // Moving a map onto itself leaves it alone.
+        CountingMap& self = c;
+        c = std::move(self);
+        check(c, 0, NumKeys);
+    }
+
+    void testClear() {
+        ureg numAllocs = 0;
+        CountingMap map(8, CountingAllocator(&numAllocs));
+        fill(map, 0, NumKeys);
+        ureg capacity = map.getCapacity();
+        ureg allocsAfterFill = numAllocs;
+        for (ureg round = 0; round < 4; round++) {
+            map.clear();
+            checkEmpty(map, 0, NumKeys);
+            if (map.getCapacity() != capacity)
+                TURF_DEBUG_BREAK();
+            fill(map, 0, NumKeys);
+            check(map, 0, NumKeys);
+        }
+        // The cleared table was big enough to take the same keys again.
+        if (numAllocs != allocsAfterFill)
+            TURF_DEBUG_BREAK();
+    }
+
+    void testArena() {
+        junction::TableArena arena;
+        ureg tablesKept;
+        {
+            ArenaMap map(8, junction::TableArena::Allocator(arena));
+            fill(map, 0, NumKeys);
+            check(map, 0, NumKeys);
+        }
+        // Growing the map freed every smaller table to the arena, and destroying it freed the last one.
+        tablesKept = arena.getNumKeptTables();
+        if (tablesKept == 0)
+            TURF_DEBUG_BREAK();
+        for (ureg round = 0; round < 4; round++) {
+            {
+                ArenaMap map(8, junction::TableArena::Allocator(arena));
+                fill(map, 0, NumKeys);
+                check(map, 0, NumKeys);
+                // The map grows through the same sizes as before, so every table it asked for came from the arena,
+                // and only the one it's using is missing.
+                if (arena.getNumKeptTables() != tablesKept - 1)
+                    TURF_DEBUG_BREAK();
+                // A moved-from map takes its new empty table from the arena too.
+                ArenaMap other(std::move(map));
+                check(other, 0, NumKeys);
+                checkEmpty(map, 0, NumKeys);
+                if (arena.getNumKeptTables() != tablesKept - 2)
+                    TURF_DEBUG_BREAK();
+            }
+            if (arena.getNumKeptTables() != tablesKept)
+                TURF_DEBUG_BREAK();
+        }
+        arena.trim();
+        if (arena.getNumKeptTables() != 0)
+            TURF_DEBUG_BREAK();
+    }
+
+    void run() {
+        testMove();
+        testClear();
+        testArena();
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTSINGLEMAPREUSE_H
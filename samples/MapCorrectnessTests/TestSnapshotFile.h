@@ -0,0 +1,132 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTSNAPSHOTFILE_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTSNAPSHOTFILE_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <junction/details/Snapshot.h>
+#include <junction/MapTraits.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Saves a map to a snapshot file, loads it into another map, and checks every key. Then every thread inserts enough
+// new keys to migrate each table that lies in the file, so that the tables release their references to the mapping
+// and the last one unmaps it. For a map with more than one table, it also checks that loadSnapshot() rejects a file
+// whose tables overlap, or whose tables don't match their flattree slots. Those are written to a second path, since
+// the first file must not be modified while tables waiting for DefaultQSBR still lie in it.
+template <class Map>
+class TestSnapshotFile {
+public:
+    static const ureg LeafSize = ureg(1) << junction::DefaultTuningTraits::LeafSizeBits;
+    static const ureg KeysToSave = LeafSize * 8;
+    static const ureg KeysPerThread = KeysToSave;
+
+    TestEnvironment& m_env;
+    std::string m_path;
+    std::string m_badPath;
+    Map* m_map;
+
+    TestSnapshotFile(TestEnvironment& env, const char* path)
+        : m_env(env), m_path(path), m_badPath(m_path + ".bad"), m_map(NULL) {
+    }
+
+    static uptr valueForKey(u32 key) {
+        return uptr(key) << 2;
+    }
+
+    void checkKeys(ureg numKeys) {
+        for (ureg i = 0; i < numKeys; i++) {
+            u32 key = u32(i + 1);
+            if (m_map->get(key) != valueForKey(key))
+                TURF_DEBUG_BREAK();
+        }
+    }
+
+    void insertKeys(ureg threadIndex) {
+        for (ureg i = 0; i < KeysPerThread; i++) {
+            u32 key = u32(KeysToSave + threadIndex * KeysPerThread + i + 1);
+            m_map->assign(key, valueForKey(key));
+        }
+        m_env.threads[threadIndex].update();
+    }
+
+    bool readFile(std::vector<u8>& contents) {
+        FILE* file = fopen(m_path.c_str(), "rb");
+        if (!file)
+            return false;
+        fseek(file, 0, SEEK_END);
+        contents.resize(ureg(ftell(file)));
+        fseek(file, 0, SEEK_SET);
+        bool ok = fread(contents.data(), 1, contents.size(), file) == contents.size();
+        fclose(file);
+        return ok;
+    }
+
+    static bool writeFile(const std::string& path, const std::vector<u8>& contents) {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+        bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        return fclose(file) == 0 && ok;
+    }
+
+    // Corrupts the second table's record in a copy of the file, and checks that the map refuses to load it.
+    void checkRejected(const std::vector<u8>& original, bool overlap) {
+        std::vector<u8> contents = original;
+        junction::details::SnapshotTable* records =
+            (junction::details::SnapshotTable*) (contents.data() + sizeof(junction::details::SnapshotHeader));
+        if (overlap)
+            records[1].offset = records[0].offset; // Overlaps the first table
+        else
+            records[1].baseHash ^= records[1].baseHash & -records[1].baseHash; // Doesn't match its slots
+        if (!writeFile(m_badPath, contents))
+            TURF_DEBUG_BREAK();
+        Map map;
+        if (map.loadSnapshot(m_badPath.c_str()))
+            TURF_DEBUG_BREAK();
+        remove(m_badPath.c_str());
+    }
+
+    void run() {
+        m_map = new Map;
+        for (ureg i = 0; i < KeysToSave; i++)
+            m_map->assign(u32(i + 1), valueForKey(u32(i + 1)));
+        if (!m_map->saveSnapshot(m_path.c_str()))
+            TURF_DEBUG_BREAK();
+        delete m_map;
+
+        m_map = new Map;
+        if (!m_map->loadSnapshot(m_path.c_str()))
+            TURF_DEBUG_BREAK();
+        checkKeys(KeysToSave);
+        m_env.dispatcher.kick(&TestSnapshotFile::insertKeys, *this);
+        checkKeys(KeysToSave + KeysPerThread * m_env.numThreads);
+        delete m_map;
+        m_map = NULL;
+
+        std::vector<u8> contents;
+        if (!readFile(contents))
+            TURF_DEBUG_BREAK();
+        const junction::details::SnapshotHeader* header = (const junction::details::SnapshotHeader*) contents.data();
+        if (header->numTables > 1) {
+            checkRejected(contents, true);
+            checkRejected(contents, false);
+        }
+        // Unlinked rather than overwritten, for the same reason.
+        remove(m_path.c_str());
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTSNAPSHOTFILE_H
@@ -0,0 +1,131 @@
+/*------------------------------------------------------------------------
+  Junction: Concurrent data structures in C++
+  Copyright (c) 2016 Jeff Preshing
+
+  Distributed under the Simplified BSD License.
+  Original location: https://github.com/preshing/junction
+
+  This software is distributed WITHOUT ANY WARRANTY; without even the
+  implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the LICENSE file for more information.
+------------------------------------------------------------------------*/
+
+#ifndef SAMPLES_MAPCORRECTNESSTESTS_TESTSNAPSHOTSCAN_H
+#define SAMPLES_MAPCORRECTNESSTESTS_TESTSNAPSHOTSCAN_H
+
+#include <junction/Core.h>
+#include "TestEnvironment.h"
+#include <vector>
+
+// Runs snapshot() on thread 0 over a set of stable keys, while every other thread overwrites the stable keys and
+// inserts and erases keys of its own in a map that starts out tiny, so that the snapshot keeps running into
+// migrations. The sink calls QSBR::update() for every entry, so tables the snapshot left behind can be freed under it.
+// Every stable key must be passed exactly once per snapshot, with one of its two values.
+template <class Map>
+class TestSnapshotScan {
+public:
+    static const ureg NumStableKeys = 2000;
+    static const u32 FillerKeyBase = 0x10000000;
+    static const ureg FillersPerRound = 1000;
+    static const ureg NumRounds = 8;
+    static const ureg OverwritePeriod = 4;
+
+    struct CountingSink {
+        std::vector<ureg>& counts;
+        MapAdapter::ThreadContext* context; // Updated after every entry, if not NULL
+
+        CountingSink(std::vector<ureg>& counts, MapAdapter::ThreadContext* context) : counts(counts), context(context) {
+        }
+
+        void operator()(u32 key, uptr value) {
+            if (key >= 1 && key <= NumStableKeys) {
+                if ((value & ~uptr(2)) != valueForKey(key, false))
+                    TURF_DEBUG_BREAK();
+                counts[key - 1]++;
+            } else if (key < FillerKeyBase || value != valueForKey(key, false)) {
+                TURF_DEBUG_BREAK();
+            }
+            if (context)
+                context->update();
+        }
+    };
+
+    TestEnvironment& m_env;
+    Map* m_map;
+    turf::Atomic<ureg> m_numWritersRunning;
+
+    TestSnapshotScan(TestEnvironment& env) : m_env(env), m_map(NULL) {
+    }
+
+    // The low two bits keep values clear of NullValue and Redirect, and tell the two values of a key apart.
+    static uptr valueForKey(u32 key, bool overwritten) {
+        return (uptr(key) << 2) | (overwritten ? 2 : 0);
+    }
+
+    static void checkCounts(std::vector<ureg>& counts) {
+        for (ureg i = 0; i < NumStableKeys; i++) {
+            if (counts[i] != 1)
+                TURF_DEBUG_BREAK();
+            counts[i] = 0;
+        }
+    }
+
+    void write(ureg threadIndex) {
+        u32 fillerKey = u32(FillerKeyBase + threadIndex * FillersPerRound * NumRounds);
+        for (ureg r = 0; r < NumRounds; r++) {
+            // Fresh keys each round, so that erased cells pile up and force migrations too.
+            for (ureg i = 0; i < FillersPerRound; i++) {
+                m_map->assign(u32(fillerKey + i), valueForKey(u32(fillerKey + i), false));
+                if (i % OverwritePeriod == 0) {
+                    u32 key = u32((r * FillersPerRound + i + threadIndex * 97) % NumStableKeys + 1);
+                    m_map->assign(key, valueForKey(key, (r + i / OverwritePeriod) % 2 != 0));
+                }
+            }
+            for (ureg i = 0; i < FillersPerRound; i++) {
+                if (m_map->erase(u32(fillerKey + i)) != valueForKey(u32(fillerKey + i), false))
+                    TURF_DEBUG_BREAK();
+            }
+            fillerKey += FillersPerRound;
+            m_env.threads[threadIndex].update();
+        }
+    }
+
+    void scanOrWrite(ureg threadIndex) {
+        if (threadIndex != 0) {
+            write(threadIndex);
+            m_numWritersRunning.fetchSub(1, turf::Relaxed);
+            return;
+        }
+        std::vector<ureg> counts(NumStableKeys, 0);
+        MapAdapter::ThreadContext* context = &m_env.threads[threadIndex];
+        for (ureg pass = 0;; pass++) {
+            // Alternate between a named sink and a temporary one.
+            if (pass % 2 == 0) {
+                CountingSink sink(counts, context);
+                m_map->snapshot(sink);
+            } else {
+                m_map->snapshot(CountingSink(counts, context));
+            }
+            checkCounts(counts);
+            if (m_numWritersRunning.load(turf::Relaxed) == 0)
+                break;
+        }
+        context->update();
+    }
+
+    void run() {
+        m_map = new Map;
+        for (ureg i = 0; i < NumStableKeys; i++)
+            m_map->assign(u32(i + 1), valueForKey(u32(i + 1), false));
+        m_numWritersRunning.storeNonatomic(m_env.numThreads - 1);
+        m_env.dispatcher.kick(&TestSnapshotScan::scanOrWrite, *this);
+        // Every filler is gone, so only the stable keys remain.
+        std::vector<ureg> counts(NumStableKeys, 0);
+        m_map->snapshot(CountingSink(counts, NULL));
+        checkCounts(counts);
+        delete m_map;
+        m_map = NULL;
+    }
+};
+
+#endif // SAMPLES_MAPCORRECTNESSTESTS_TESTSNAPSHOTSCAN_H
@@ -20,6 +20,7 @@ ALL_MAPS = [
     ('linear',          colorTuple('ff4040')),
     ('grampa',          colorTuple('ff4040')),
     ('leapfrog',        colorTuple('ff4040')),
+    ('leapfrog_seeded', colorTuple('ff9090')),
 ]
 
 #---------------------------------------------------
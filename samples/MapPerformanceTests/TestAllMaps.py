@@ -10,8 +10,10 @@ CMAKE = os.getenv('CMAKE', 'cmake')
 ALL_MAPS = [
     ('null', 'junction/extra/impl/MapAdapter_Null.h', [], ['-i256', '-c10']),
     ('michael', 'junction/extra/impl/MapAdapter_CDS_Michael.h', ['-DJUNCTION_WITH_CDS=1', '-DTURF_WITH_EXCEPTIONS=1'], ['-i256', '-c10']),
+    ('crudeplus', 'junction/extra/impl/MapAdapter_CrudePlus.h', [], ['-i256', '-c10']),
     ('linear', 'junction/extra/impl/MapAdapter_Linear.h', [], ['-i256', '-c10']),
     ('leapfrog', 'junction/extra/impl/MapAdapter_Leapfrog.h', [], ['-i256', '-c10']),
+    ('leapfrog_seeded', 'junction/extra/impl/MapAdapter_Leapfrog_Seeded.h', [], ['-i256', '-c10']),
     ('grampa', 'junction/extra/impl/MapAdapter_Grampa.h', [], ['-i256', '-c10']),
     ('stdmap', 'junction/extra/impl/MapAdapter_StdMap.h', [], ['-i256', '-c10']),
     ('folly', 'junction/extra/impl/MapAdapter_Folly.h', ['-DJUNCTION_WITH_FOLLY=1', '-DTURF_WITH_EXCEPTIONS=1'], ['-i256', '-c1']),
@@ -20,6 +20,7 @@ ALL_MAPS = [
     ('cuckoo',          colorTuple('d040d0')),
     ('grampa',          colorTuple('ff6040')),
     ('leapfrog',        colorTuple('ff8040')),
+    ('leapfrog_seeded', colorTuple('ffb080')),
 ]
 
 #---------------------------------------------------
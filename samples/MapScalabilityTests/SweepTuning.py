@@ -0,0 +1,65 @@
+#!/usr/bin/env python
+import os
+import subprocess
+import sys
+
+# Default CMake command is just 'cmake' but you can override it by setting
+# the CMAKE environment variable:
+CMAKE = os.getenv('CMAKE', 'cmake')
+
+# Builds and runs MapScalabilityTests once per tuning value, using MapAdapter_Tuned.h.
+# Each constant is swept on its own, with the others left at their defaults.
+ALL_MAPS = [
+    ('leapfrog', 0),
+    ('grampa', 1),
+]
+
+SWEEPS = [
+    ('TABLE_MIGRATION_UNIT_SIZE', [8, 16, 32, 64, 128, 256, 1024], ['leapfrog', 'grampa']),
+    ('MAX_MIGRATION_UNITS_PER_CLAIM', [1, 4, 16, 64], ['leapfrog', 'grampa']),
+    ('LINEAR_SEARCH_LIMIT', [16, 32, 64, 128, 255], ['leapfrog', 'grampa']),
+    ('CELLS_IN_USE_SAMPLE', [16, 32, 64, 128], ['leapfrog', 'grampa']),
+    ('CHURN_SIZE_FACTOR', [2, 4, 8], ['leapfrog', 'grampa']),
+    ('INITIAL_SIZE', [8, 64, 1024], ['leapfrog', 'grampa']),
+    ('FLATTREE_NODE_BITS', [4, 6, 8, 10, 12], ['grampa']),
+    ('LEAF_SIZE_BITS', [8, 10, 12, 14, 16], ['grampa']),
+]
+
+# Scan arguments for path to CMakeLists.txt and args to pass through.
+passThroughArgs = []
+pathArgs = []
+for arg in sys.argv[1:]:
+    if arg.startswith('-'):
+        passThroughArgs.append(arg)
+    else:
+        pathArgs.append(arg)
+if len(pathArgs) != 1:
+    sys.stderr.write('You must provide exactly one path argument.\n')
+    exit(1)
+
+listFilePath = os.path.abspath(pathArgs[0])
+for mapName, isGrampa in ALL_MAPS:
+    for name, values, maps in SWEEPS:
+        if mapName not in maps:
+            continue
+        for value in values:
+            subdir = 'build-tuned-%s-%s-%d' % (mapName, name.lower(), value)
+            if not os.path.exists(subdir):
+                os.mkdir(subdir)
+            os.chdir(subdir)
+            print('Configuring in %s...' % subdir)
+            with open('junction_userconfig.h.in', 'w') as f:
+                f.write('#define JUNCTION_IMPL_MAPADAPTER_PATH "junction/extra/impl/MapAdapter_Tuned.h"\n')
+                f.write('#define JUNCTION_TUNED_MAP_GRAMPA %d\n' % isGrampa)
+                f.write('#define JUNCTION_TUNED_%s %d\n' % (name, value))
+            userConfigCMakePath = os.path.abspath('junction_userconfig.h.in')
+            if os.sep != '/':
+                userConfigCMakePath = userConfigCMakePath.replace(os.sep, '/')
+            if subprocess.call([CMAKE, listFilePath, '-DCMAKE_BUILD_TYPE=RelWithDebInfo', '-DCMAKE_INSTALL_PREFIX=TestAllMapsInstallFolder',
+                               '-DJUNCTION_USERCONFIG=%s' % userConfigCMakePath] + passThroughArgs) == 0:
+                subprocess.check_call([CMAKE, '--build', '.', '--target', 'install', '--config', 'RelWithDebInfo'])
+                print('Running in %s...' % subdir)
+                results = subprocess.check_output([os.path.join('TestAllMapsInstallFolder', 'bin', 'MapScalabilityTests'), '-i10000', '-c200'])
+                with open('results.txt', 'wb') as f:
+                    f.write(results)
+            os.chdir('..')